@@ -0,0 +1,123 @@
+/*!
+ *  @file ClockSync.h
+ *
+ *  Client estimate of a server's sys::micros() clock.
+ *
+ *  json_client::sync_clock() asks the server for its time (":") a few
+ *  times and keeps the exchange with the shortest round trip, like NTP:
+ *  the server read its clock about halfway through the round trip, so
+ *
+ *      offset = server_us - (send_us + recv_us) / 2,  error <= rtt / 2
+ *
+ *  Crystals differ by tens of ppm, so the offset drifts by a few
+ *  microseconds per second. Two syncs at least CLOCK_SYNC_MIN_BASELINE_US
+ *  apart also give the drift rate, which to_server() applies between
+ *  syncs. Sync again every few seconds to minutes, and at least every
+ *  half hour because 32-bit microsecond clocks wrap.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __CLOCKSYNC_H__
+    #define __CLOCKSYNC_H__
+
+    #include <stdint.h> // for uint32_t, int32_t, int64_t
+
+    /** Shortest time between syncs to update the drift estimate */
+    #ifndef CLOCK_SYNC_MIN_BASELINE_US
+        #define CLOCK_SYNC_MIN_BASELINE_US 1000000L
+    #endif
+
+    /** Longest drift baseline, well inside the 32-bit wrap */
+    #ifndef CLOCK_SYNC_MAX_BASELINE_US
+        #define CLOCK_SYNC_MAX_BASELINE_US 600000000L
+    #endif
+
+namespace rdl {
+
+    class clock_sync {
+     public:
+        clock_sync() { reset(); }
+
+        /** Forget all samples */
+        void reset() {
+            samples_       = 0;
+            base_client_   = 0;
+            base_offset_   = 0;
+            anchor_client_ = 0;
+            anchor_offset_ = 0;
+            drift_         = 0.0;
+            rtt_us_        = 0;
+        }
+
+        /**
+         * Add one time exchange.
+         *
+         * @param client_us     client time halfway through the round trip
+         * @param server_us     server time in the reply
+         * @param rtt_us        round trip time of the exchange
+         */
+        void add_sample(uint32_t client_us, uint32_t server_us, uint32_t rtt_us) {
+            int32_t offset = static_cast<int32_t>(server_us - client_us);
+            if (samples_ == 0) {
+                anchor_client_ = client_us;
+                anchor_offset_ = offset;
+            } else {
+                int32_t elapsed = static_cast<int32_t>(client_us - anchor_client_);
+                if (elapsed >= CLOCK_SYNC_MIN_BASELINE_US)
+                    drift_ = static_cast<double>(offset - anchor_offset_) / elapsed;
+                if (elapsed >= CLOCK_SYNC_MAX_BASELINE_US || elapsed < 0) {
+                    anchor_client_ = client_us;
+                    anchor_offset_ = offset;
+                }
+            }
+            base_client_ = client_us;
+            base_offset_ = offset;
+            rtt_us_      = rtt_us;
+            samples_++;
+        }
+
+        /** Server time at a client time */
+        uint32_t to_server(uint32_t client_us) const {
+            return client_us + static_cast<uint32_t>(offset_at(client_us));
+        }
+
+        /** Client time at a server time */
+        uint32_t to_client(uint32_t server_us) const {
+            // offset changes by ppm, so one correction step is enough
+            uint32_t guess = server_us - static_cast<uint32_t>(base_offset_);
+            return server_us - static_cast<uint32_t>(offset_at(guess));
+        }
+
+        /** Server clock minus client clock at client_us */
+        int32_t offset_at(uint32_t client_us) const {
+            int32_t dt = static_cast<int32_t>(client_us - base_client_);
+            double dd  = drift_ * dt;
+            return base_offset_ + static_cast<int32_t>(dd < 0 ? dd - 0.5 : dd + 0.5);
+        }
+
+        /** Server clock rate minus client clock rate, e.g. 20e-6 for 20 ppm fast */
+        double drift() const { return drift_; }
+
+        /** Worst case error of the last sync, half its round trip */
+        uint32_t uncertainty_us() const { return rtt_us_ / 2; }
+
+        bool synced() const { return samples_ > 0; }
+
+     protected:
+        long samples_;
+        uint32_t base_client_;   ///< client time of the latest sample
+        int32_t base_offset_;    ///< offset at base_client_
+        uint32_t anchor_client_; ///< start of the drift baseline
+        int32_t anchor_offset_;
+        double drift_;
+        uint32_t rtt_us_;
+    };
+
+} // namespace rdl
+
+#endif // __CLOCKSYNC_H__
@@ -0,0 +1,308 @@
+/*!
+ *  @file CobsInPlace.h
+ *
+ *  Library for in-place COBS (Consistent Overhead Byte Stuffing) encoding
+ *  and decoding.
+ *
+ *  COBS replaces every NUL in a packet by the distance to the next one, so
+ *  the encoded packet never contains NUL and a single NUL ends the frame.
+ *  Overhead is bounded at one byte per 254 bytes of packet plus the code
+ *  byte and frame end, where SLIP can double a packet full of specials.
+ *  The encoders and decoders share the static encoded_size/encode/
+ *  decoded_size/decode API of the SlipInPlace codecs.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __COBSINPLACE_H__
+    #define __COBSINPLACE_H__
+
+    #include "Common.h"
+    #include "std_type_traits.h" // for enable_if
+    #include <stdint.h>          // for uint8_t
+    #include <string.h>          // for memmove
+
+namespace rdl {
+
+    namespace svc {
+
+        /**************************************************************************************
+         * Base for both encoders and decoders
+         **************************************************************************************/
+
+        /**
+         * @brief Base container for COBS codes.
+         *
+         * @tparam _CharT       unsigned char or char
+         */
+        template <typename _CharT>
+        struct cobs_base {
+            using char_type = _CharT;
+            static constexpr _CharT end_code() noexcept { return (_CharT)0; } ///< frame end (NUL)
+
+            /** Longest run of non-NUL bytes a code byte can describe */
+            static constexpr size_t max_run = 254;
+
+            /** COBS output never contains NUL */
+            static constexpr bool is_null_encoded = true;
+
+            /** Worst case encoded size of srcsize bytes, including the frame end */
+            static constexpr size_t max_encoded_size(size_t srcsize) noexcept {
+                return srcsize + srcsize / max_run + 2;
+            }
+
+         protected:
+            /** Code bytes hold 1 + the length of the run that follows */
+            static constexpr uint8_t max_code = max_run + 1;
+        };
+
+        /**************************************************************************************
+         * Base encoder
+         **************************************************************************************/
+
+        /**
+         * @brief COBS encoder.
+         *
+         * Automatically handles out-of-place encoding via copy or in-place encoding given
+         * a buffer of sufficient size.
+         *
+         * @tparam _CharT       unsigned char or char
+         */
+        template <typename _CharT>
+        struct cobs_encoder_base : public cobs_base<_CharT> {
+            using BASE = cobs_base<_CharT>;
+            using BASE::end_code;
+            using BASE::max_run;
+            using BASE::max_code;
+            using BASE::is_null_encoded;
+            using BASE::max_encoded_size;
+
+            /**
+             * @brief Pre-calculate the size after COBS encoding.
+             *
+             * @param src       pointer to source buffer
+             * @param srcsize   size of source buffer to parse
+             * @return size_t   size needed to encode this buffer, including the frame end
+             */
+            static inline size_t encoded_size(const _CharT* src, size_t srcsize) noexcept {
+                const _CharT* send = src + srcsize;
+                size_t ncodes      = 1;
+                size_t run         = 0;
+                for (; src < send; src++) {
+                    if (src[0] == end_code()) {
+                        run = 0; // the NUL becomes the next code byte
+                    } else if (++run == max_run && src + 1 < send) {
+                        run = 0; // full run, one extra code byte
+                        ncodes++;
+                    }
+                }
+                return srcsize + ncodes + 1;
+            }
+
+            /**
+             * @brief Encode a buffer using COBS.
+             *
+             * Automatically handles out-of-place encoding via copy or in-place encoding given
+             * a buffer of sufficient size.
+             *
+             * For in-place encoding, the algorithm first copies the string to the end of
+             * the destination buffer, then begins encoding left-to-right. The output only
+             * runs ahead of the input by the code bytes written so far, which encoded_size()
+             * has already reserved.
+             *
+             * > :warning: Encode in-place clobbers the end of the destiation buffer past
+             * >            the returned size!
+             *
+             * @param dest      destination buffer
+             * @param destsize  dest buffer size - must be sufficiently large
+             * @param src       source buffer
+             * @param srcsize   size of source to encode
+             * @return size_t   final encoded size or 0 if there was an error while encoding
+             */
+            static inline size_t encode(_CharT* dest, size_t destsize, const _CharT* src, size_t srcsize) noexcept {
+                static constexpr size_t BAD_ENCODE = 0;
+                const _CharT* send                 = src + srcsize;
+                _CharT* dstart                     = dest;
+                _CharT* dend                       = dest + destsize;
+                if (!dest || !src || destsize < srcsize + 2)
+                    return BAD_ENCODE;
+                if (dest <= src && src <= dend) { // sbuf somewhere in dbuf. So in-place
+                    src  = (_CharT*)memmove(dest + destsize - srcsize, src, srcsize);
+                    send = src + srcsize;
+                }
+
+                _CharT* code_ptr = dest++; // filled in when the run ends
+                uint8_t code     = 1;
+                while (src < send) {
+                    if (src[0] == end_code()) {
+                        *code_ptr = (_CharT)code;
+                        if (dest >= dend) return BAD_ENCODE;
+                        code_ptr = dest++;
+                        code     = 1;
+                        src++;
+                        continue;
+                    }
+                    if (dest >= dend) return BAD_ENCODE;
+                    *(dest++) = *(src++);
+                    if (++code == max_code && src < send) {
+                        *code_ptr = (_CharT)code;
+                        if (dest >= dend) return BAD_ENCODE;
+                        code_ptr = dest++;
+                        code     = 1;
+                    }
+                }
+                *code_ptr = (_CharT)code;
+
+                if (dest >= dend)
+                    return BAD_ENCODE;
+                *(dest++) = end_code();
+                return dest - dstart;
+            }
+
+            /**
+             * @copydoc encoded_size
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t encoded_size(const _FromT* src, size_t srcsize) noexcept {
+                return encoded_size(reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+
+            /**
+             * @copydoc encode
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t encode(_FromT* dest, size_t destsize, const _FromT* src, size_t srcsize) noexcept {
+                return encode(reinterpret_cast<_CharT*>(dest), destsize, reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+        };
+
+        /**************************************************************************************
+         * Base decoder
+         **************************************************************************************/
+
+        /**
+         * @brief COBS decoder.
+         *
+         * Automatically handles both out-of-place and in-place decoding.
+         *
+         * @tparam _CharT       unsigned char or char
+         */
+        template <typename _CharT>
+        struct cobs_decoder_base : public cobs_base<_CharT> {
+            using BASE = cobs_base<_CharT>;
+            using BASE::end_code;
+            using BASE::max_run;
+            using BASE::max_code;
+            using BASE::is_null_encoded;
+
+            /**
+             * @brief Pre-calculate the size after COBS decoding.
+             *
+             * Does not check the validity of the code bytes, just their positions.
+             *
+             * @param src       pointer to source buffer
+             * @param srcsize   size of source buffer to parse
+             * @return size_t   size needed to decode this buffer
+             */
+            static inline size_t decoded_size(const _CharT* src, size_t srcsize) noexcept {
+                const _CharT* send = src + srcsize;
+                size_t size        = 0;
+                while (src < send && src[0] != end_code()) {
+                    uint8_t code = (uint8_t)src[0];
+                    src += code;
+                    size += code - 1;
+                    if (code != max_code && src < send && src[0] != end_code())
+                        size++; // implied NUL
+                }
+                return size;
+            }
+
+            /**
+             * @brief Decode a COBS encoded buffer.
+             *
+             * Automatically handles both out-of-place and in-place decoding.
+             *
+             * Since the decoded size is always smaller, in-place decoding works
+             * witout copying.
+             *
+             * > :warning: The end of destiation buffer past the returned size is not cleared.
+             *
+             * @param dest      destination buffer
+             * @param destsize  dest buffer size - must be sufficiently large
+             * @param src       source buffer
+             * @param srcsize   size of source to decode
+             * @return size_t   final decoded size or 0 if there was an error while decoding
+             */
+            static inline size_t decode(_CharT* dest, size_t destsize, const _CharT* src, size_t srcsize) noexcept {
+                static constexpr size_t BAD_DECODE = 0;
+                const _CharT* send                 = src + srcsize;
+                _CharT* dstart                     = dest;
+                _CharT* dend                       = dest + destsize;
+                if (!dest || !src || srcsize < 1 || destsize < 1) return BAD_DECODE;
+
+                while (src < send && src[0] != end_code()) {
+                    uint8_t code = (uint8_t)*(src++);
+                    size_t run   = code - 1;
+                    if (run > (size_t)(send - src) || run > (size_t)(dend - dest))
+                        return BAD_DECODE; // truncated frame or not enough room for results
+                    for (; run > 0; run--) {
+                        if (src[0] == end_code()) return BAD_DECODE; // frame ended inside a run
+                        *(dest++) = *(src++);
+                    }
+                    if (code != max_code && src < send && src[0] != end_code()) {
+                        if (dest >= dend) return BAD_DECODE;
+                        *(dest++) = end_code(); // implied NUL
+                    }
+                }
+                return dest - dstart;
+            }
+
+            /**
+             * @copydoc decoded_size
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t decoded_size(const _FromT* src, size_t srcsize) noexcept {
+                return decoded_size(reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+
+            /**
+             * @copydoc decode
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t decode(_FromT* dest, size_t destsize, const _FromT* src, size_t srcsize) noexcept {
+                return decode(reinterpret_cast<_CharT*>(dest), destsize, reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+        };
+
+    }; // namespace svc
+
+    /**************************************************************************************
+     * COBS encoders and decoders
+     **************************************************************************************/
+
+    /** COBS encoder template */
+    template <typename _CharT>
+    using cobs_encoder_base = svc::cobs_encoder_base<_CharT>;
+    /** COBS decoder template */
+    template <typename _CharT>
+    using cobs_decoder_base = svc::cobs_decoder_base<_CharT>;
+
+    /** byte-oriented COBS encoder */
+    using cobs_encoder = cobs_encoder_base<uint8_t>;
+    /** byte-oriented COBS decoder */
+    using cobs_decoder = cobs_decoder_base<uint8_t>;
+}
+
+#endif // __COBSINPLACE_H__
@@ -19,6 +19,7 @@
 
     #include "std_utility.h"
     #include <assert.h>
+    #include <stddef.h> // for size_t
     #include <tuple>
 
 namespace rdl {
@@ -0,0 +1,265 @@
+/*!
+ *  @file DeltaPack.h
+ *
+ *  Packed uploads of integer sequences.
+ *
+ *  Smooth waveforms change by small steps, so a sequence of integers packs
+ *  into far fewer bytes as differences than as JSON numbers. The packed
+ *  bytes are:
+ *
+ *  | field                          | meaning                                  |
+ *  |:-------------------------------|:-----------------------------------------|
+ *  | `varint(zigzag(first))`        | first value                              |
+ *  | `varint(zigzag(delta)*2 + r)`  | next value is the last one plus delta    |
+ *  | `varint(n)` if r is set        | n more values with the same delta        |
+ *
+ *  A varint stores 7 bits per byte, low bits first, with the high bit set
+ *  on every byte but the last. Zig-zag maps small negative numbers to small
+ *  unsigned ones (0,-1,1,-2,... -> 0,1,2,3,...). The bytes are sent as an
+ *  unpadded base64 string, which needs no escaping in JSON, SLIP or COBS.
+ *  A 1000 point ramp packs into a handful of characters. Each packed string
+ *  is self-contained, so long sequences go up as a series of strings.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __DELTAPACK_H__
+    #define __DELTAPACK_H__
+
+    #include <limits.h> // for LONG_MIN, LONG_MAX
+    #include <stddef.h> // for size_t
+    #include <stdint.h> // for uint8_t, uint64_t
+
+namespace rdl {
+
+    namespace svc {
+        inline const char* base64_chars() {
+            static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            return chars;
+        }
+
+        /** 6-bit value of a base64 character, or -1 */
+        inline int base64_value(char c) {
+            if (c >= 'A' && c <= 'Z') return c - 'A';
+            if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if (c >= '0' && c <= '9') return c - '0' + 52;
+            if (c == '+') return 62;
+            if (c == '/') return 63;
+            return -1;
+        }
+
+        inline uint64_t zigzag(int64_t v) {
+            return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+        }
+
+        inline int64_t unzigzag(uint64_t u) {
+            return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+        }
+
+        /** Append a varint to buf[size..max). Returns false if it does not fit. */
+        inline bool put_varint(uint8_t* buf, size_t& size, size_t max, uint64_t u) {
+            size_t pos = size;
+            do {
+                if (pos >= max)
+                    return false;
+                uint8_t b = u & 0x7F;
+                u >>= 7;
+                buf[pos++] = u ? (b | 0x80) : b;
+            } while (u);
+            size = pos;
+            return true;
+        }
+
+        /** Reads the base64 text of a packed sequence one varint at a time */
+        class packed_reader {
+         public:
+            explicit packed_reader(const char* text) : text_(text), bits_(0), nbits_(0) {}
+
+            /** @return false at the end of the text or on a bad character */
+            bool varint(uint64_t& u) {
+                u         = 0;
+                int shift = 0;
+                uint8_t b;
+                do {
+                    if (!byte(b) || shift > 63)
+                        return false;
+                    u |= static_cast<uint64_t>(b & 0x7F) << shift;
+                    shift += 7;
+                } while (b & 0x80);
+                return true;
+            }
+
+            bool at_end() {
+                // leftover bits of the last character are padding
+                while (nbits_ < 8 && *text_) {
+                    if (base64_value(*text_) < 0)
+                        return false;
+                    bits_ = (bits_ << 6) | base64_value(*(text_++));
+                    nbits_ += 6;
+                }
+                return nbits_ < 8;
+            }
+
+         protected:
+            bool byte(uint8_t& b) {
+                while (nbits_ < 8) {
+                    int v = *text_ ? base64_value(*text_) : -1;
+                    if (v < 0)
+                        return false;
+                    text_++;
+                    bits_ = (bits_ << 6) | static_cast<unsigned>(v);
+                    nbits_ += 6;
+                }
+                nbits_ -= 8;
+                b = static_cast<uint8_t>(bits_ >> nbits_);
+                bits_ &= (1u << nbits_) - 1;
+                return true;
+            }
+
+            const char* text_;
+            unsigned bits_;
+            int nbits_;
+        };
+
+        /**
+         * Move value n steps of delta. A run is monotonic, so checking its
+         * last value covers every step.
+         * @return false if the run leaves the range of long
+         */
+        inline bool advance(int64_t& value, int64_t delta, uint64_t n) {
+            uint64_t mag = delta < 0 ? 0 - static_cast<uint64_t>(delta) : static_cast<uint64_t>(delta);
+            if (mag != 0 && n > static_cast<uint64_t>(INT64_MAX) / mag)
+                return false;
+            uint64_t span = mag * n;
+            uint64_t room = delta < 0 ? static_cast<uint64_t>(value) - static_cast<uint64_t>(static_cast<int64_t>(LONG_MIN))
+                                      : static_cast<uint64_t>(static_cast<int64_t>(LONG_MAX)) - static_cast<uint64_t>(value);
+            if (span > room)
+                return false;
+            value = static_cast<int64_t>(delta < 0 ? static_cast<uint64_t>(value) - span : static_cast<uint64_t>(value) + span);
+            return true;
+        }
+
+        /**
+         * Decode the whole text, calling add() for the first limit values.
+         * @return number of values added, or -1 if the text is corrupt
+         */
+        template <typename FnT>
+        long delta_walk(const char* text, long limit, FnT&& add) {
+            packed_reader reader(text);
+            uint64_t u;
+            if (reader.at_end())
+                return 0;
+            if (!reader.varint(u))
+                return -1;
+            int64_t value = unzigzag(u);
+            if (value < LONG_MIN || value > LONG_MAX)
+                return -1;
+            long count = 0;
+            if (count < limit) {
+                add(static_cast<long>(value));
+                count++;
+            }
+            while (!reader.at_end()) {
+                uint64_t run = 0;
+                if (!reader.varint(u) || ((u & 1) && !reader.varint(run)))
+                    return -1;
+                int64_t delta  = unzigzag(u >> 1);
+                uint64_t steps = run + 1;
+                int64_t last   = value;
+                if (steps == 0 || !advance(last, delta, steps))
+                    return -1;
+                // a long run costs no more than limit steps
+                for (; steps > 0 && count < limit; steps--) {
+                    value += delta;
+                    add(static_cast<long>(value));
+                    count++;
+                }
+                value = last;
+            }
+            return count;
+        }
+    }; // namespace svc
+
+    /**
+     * Pack as many values as fit into a null-terminated base64 string.
+     *
+     * @param text      destination text buffer
+     * @param textsize  size of text, including the terminator
+     * @param values    integer values to pack
+     * @param count     number of values
+     * @param packed    set to the number of values that fit
+     * @return size_t   length of the text
+     */
+    template <typename T>
+    size_t delta_pack(char* text, size_t textsize, const T* values, size_t count, size_t& packed) {
+        packed = 0;
+        if (!text || textsize < 1)
+            return 0;
+        // bytes that fit in textsize-1 base64 characters
+        size_t max  = (textsize - 1) * 6 / 8;
+        uint8_t* buf = reinterpret_cast<uint8_t*>(text + textsize) - max; // encoded in place from the back
+        size_t size  = 0;
+        if (count > 0 && svc::put_varint(buf, size, max, svc::zigzag(static_cast<int64_t>(values[0]))))
+            packed = 1;
+        while (packed > 0 && packed < count) {
+            int64_t delta = static_cast<int64_t>(values[packed]) - static_cast<int64_t>(values[packed - 1]);
+            size_t run    = 1;
+            while (packed + run < count && static_cast<int64_t>(values[packed + run]) - static_cast<int64_t>(values[packed + run - 1]) == delta)
+                run++;
+            size_t mark = size;
+            uint64_t op = svc::zigzag(delta) << 1;
+            bool fits   = (run > 1) ? svc::put_varint(buf, size, max, op | 1) && svc::put_varint(buf, size, max, run - 1)
+                                    : svc::put_varint(buf, size, max, op);
+            if (!fits) {
+                size = mark;
+                break;
+            }
+            packed += run;
+        }
+        // base64 front to back; each character reads bytes at or after its position
+        const char* chars = svc::base64_chars();
+        size_t len        = 0;
+        unsigned bits     = 0;
+        int nbits         = 0;
+        for (size_t i = 0; i < size; i++) {
+            bits = (bits << 8) | buf[i];
+            nbits += 8;
+            while (nbits >= 6) {
+                nbits -= 6;
+                text[len++] = chars[(bits >> nbits) & 0x3F];
+            }
+            bits &= (1u << nbits) - 1;
+        }
+        if (nbits > 0)
+            text[len++] = chars[(bits << (6 - nbits)) & 0x3F];
+        text[len] = 0;
+        return len;
+    }
+
+    /**
+     * Unpack a delta_pack string, calling add(long value) for each of the
+     * first limit values. The whole text is checked before anything is
+     * added, so corrupt text adds nothing.
+     *
+     * @param text      packed values
+     * @param limit     most values to add, e.g. the free space for them
+     * @param add       called with each value
+     * @return number of values added, at most limit, or -1 if the text is
+     *         corrupt or a value is out of the range of long
+     */
+    template <typename FnT>
+    long delta_unpack(const char* text, long limit, FnT&& add) {
+        if (!text || limit < 0)
+            return -1;
+        if (svc::delta_walk(text, 0, [](long) {}) < 0)
+            return -1;
+        return svc::delta_walk(text, limit, add);
+    }
+
+} // namespace rdl
+
+#endif // __DELTAPACK_H__
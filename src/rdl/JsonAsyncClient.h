@@ -0,0 +1,327 @@
+/*!
+ *  @file JsonAsyncClient.h
+ *
+ *  Coroutine client for C++20 host builds.
+ *
+ *  json_client::call_get() blocks its thread until the reply arrives. An
+ *  async_json_client instead returns awaitables:
+ *
+ *      rpc_task watch(async_json_client<jsonrpc_default_keys>& client) {
+ *          auto pos = co_await client.async_call_get<int>("?pos", 2);
+ *          if (pos.ok())
+ *              ...pos.value...
+ *      }
+ *
+ *  The request goes out when async_call_get() is called, and the coroutine
+ *  suspends until check_messages() reads the matching reply or the call
+ *  times out. Several awaitables may be created before awaiting any of
+ *  them to pipeline requests. A server_loop (ServerLoop.h) drives
+ *  check_messages() for any number of clients on one thread, so hundreds
+ *  of calls to many devices can be outstanding at once.
+ *
+ *  Everything here is compiled only when <coroutine> is available;
+ *  embedded C++11 builds see an empty header and keep json_client.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __JSONASYNCCLIENT_H__
+    #define __JSONASYNCCLIENT_H__
+
+    #if defined(__has_include)
+        #if __cplusplus >= 202002L && __has_include(<coroutine>)
+            #define RDL_HAS_COROUTINES 1
+        #endif
+    #endif
+
+    #if RDL_HAS_COROUTINES
+
+        #include "JsonClient.h"
+        #include "TimerQueue.h"
+        #include <coroutine>
+        #include <exception>
+        #include <vector>
+
+namespace rdl {
+
+    /************************************************************************
+     * Fire-and-forget coroutine that awaits async_json_client calls. The
+     * frame frees itself when the coroutine returns.
+     ************************************************************************/
+    struct rpc_task {
+        struct promise_type {
+            rpc_task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    /** Error code and value of an awaited call_get */
+    template <typename RTYPE>
+    struct rpc_result {
+        int err;
+        RTYPE value;
+        bool ok() const { return err == ERROR_OK; }
+    };
+
+    /************************************************************************
+     * json_client with awaitable calls.
+     *
+     * check_messages() completes calls and handles pushes; it and every
+     * async call belong to one thread. Do not mix the blocking call()
+     * methods with outstanding async calls: they drop replies they did
+     * not ask for.
+     ************************************************************************/
+    template <class KeysT, class FramingT = slip_null_framing>
+    class async_json_client : public json_client<KeysT, FramingT>, protected timer_entry {
+     public:
+        using ClientT = json_client<KeysT, FramingT>;
+        using BaseT   = typename ClientT::BaseT;
+
+     protected:
+        /** A sent call waiting for its reply */
+        class pending_call {
+         public:
+            pending_call(const pending_call&) = delete;
+            pending_call& operator=(const pending_call&) = delete;
+
+            bool await_ready() const noexcept { return done_; }
+            void await_suspend(std::coroutine_handle<> handle) noexcept { handle_ = handle; }
+
+         protected:
+            friend class async_json_client;
+
+            pending_call(async_json_client& client, long id, int err)
+                : client_(client), id_(id), err_(err), done_(err != ERROR_OK), deadline_(0) {
+                if (!done_)
+                    client_.enlist(*this);
+            }
+            virtual ~pending_call() {
+                if (!done_)
+                    client_.delist(*this); // the awaiting coroutine was destroyed
+            }
+
+            /** Parse the reply into the result */
+            virtual int complete(JsonDocument& msg) = 0;
+
+            async_json_client& client_;
+            long id_;
+            int err_;
+            bool done_;
+            unsigned long deadline_;
+            std::coroutine_handle<> handle_;
+        };
+
+     public:
+        /** Awaitable for async_call(): resumes with the error code */
+        class call_awaiter : public pending_call {
+         public:
+            int await_resume() const noexcept { return this->err_; }
+
+         protected:
+            friend class async_json_client;
+            using pending_call::pending_call;
+            virtual int complete(JsonDocument& msg) override { return this->client_.parse_reply(msg, this->id_); }
+        };
+
+        /** Awaitable for async_call_get(): resumes with an rpc_result */
+        template <typename RTYPE>
+        class get_awaiter : public pending_call {
+         public:
+            rpc_result<RTYPE> await_resume() const { return {this->err_, value_}; }
+
+         protected:
+            friend class async_json_client;
+            using pending_call::pending_call;
+            virtual int complete(JsonDocument& msg) override { return this->client_.parse_reply(msg, this->id_, value_); }
+            RTYPE value_ {};
+        };
+
+        async_json_client(sys::StreamT& istream, sys::StreamT& ostream,
+                          unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : ClientT(istream, ostream, timeout_ms, 0), closing_(false) {}
+
+        ~async_json_client() {
+            // wake every waiting coroutine with a failure rather than leak it.
+            // Calls they make now fail at once.
+            closing_ = true;
+            fail_all(ERROR_JSON_NO_REPLY);
+            timer_queue::instance().cancel(*this);
+        }
+
+        /** Send a call; co_await the result for its error code */
+        template <typename... PARAMS>
+        call_awaiter async_call(const char* method, PARAMS... args) {
+            long msg_id = 0;
+            int err     = send<PARAMS...>(method, msg_id, args...);
+            return call_awaiter(*this, msg_id, err);
+        }
+
+        /** Send a call; co_await the result for an rpc_result<RTYPE> */
+        template <typename RTYPE, typename... PARAMS>
+        get_awaiter<RTYPE> async_call_get(const char* method, PARAMS... args) {
+            long msg_id = 0;
+            int err     = send<PARAMS...>(method, msg_id, args...);
+            return get_awaiter<RTYPE>(*this, msg_id, err);
+        }
+
+        /**
+         * Read waiting frames: replies resume their coroutines and pushes go
+         * to the push map. Also fails calls past their timeout. Returns
+         * immediately when nothing is available.
+         */
+        int check_messages() {
+            int err = ERROR_OK;
+            while (err == ERROR_OK && istream_.available() > 0) {
+                size_t msgsize;
+                if ((err = this->read_reply(msgsize)) != ERROR_OK)
+                    break;
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                if ((err = BaseT::deserialize_message(msg, msgsize)) != ERROR_OK)
+                    break;
+                if (BaseT::is_push(msg)) {
+                    this->dispatch_push(msg);
+                    continue;
+                }
+                pending_call* call = find(msg);
+                if (call == nullptr)
+                    continue; // late reply to an expired call
+                delist(*call);
+                call->err_ = call->complete(msg);
+                // msg may point into the receive buffer, which the next read reuses
+                msg.clear();
+                finish(*call);
+            }
+            expire();
+            return err;
+        }
+
+        /** Calls sent and not yet answered */
+        size_t pending() const { return waiting_.size(); }
+
+     protected:
+        template <typename... PARAMS>
+        int send(const char* method, long& msg_id, PARAMS... args) {
+            if (closing_)
+                return ERROR_JSON_SEND_ERROR;
+            svc::tx_gate::guard tx(gate_);
+            msg_id = nextid_++;
+            return this->template call_impl<PARAMS...>(method, msg_id, args...);
+        }
+
+        void enlist(pending_call& call) {
+            call.deadline_ = sys::millis() + timeout_ms_;
+            waiting_.push_back(&call);
+            if (!timer_entry::queued())
+                timer_queue::instance().schedule(*this, sys::micros() + timeout_ms_ * 1000);
+        }
+
+        void delist(pending_call& call) {
+            for (auto it = waiting_.begin(); it != waiting_.end(); ++it) {
+                if (*it == &call) {
+                    waiting_.erase(it);
+                    break;
+                }
+            }
+        }
+
+        pending_call* find(JsonDocument& msg) {
+            for (pending_call* call : waiting_) {
+                if (BaseT::is_reply_to(msg, call->id_))
+                    return call;
+            }
+            return nullptr;
+        }
+
+        /** Mark done and resume the coroutine, if it already awaits */
+        void finish(pending_call& call) {
+            call.done_ = true;
+            if (call.handle_)
+                call.handle_.resume(); // may send calls or destroy call
+        }
+
+        /** Fail every call past its deadline, oldest first */
+        void expire() {
+            unsigned long now = sys::millis();
+            while (!waiting_.empty() && static_cast<long>(now - waiting_.front()->deadline_) >= 0) {
+                pending_call* call = waiting_.front();
+                waiting_.erase(waiting_.begin());
+                call->err_ = ERROR_JSON_TIMEOUT;
+                finish(*call);
+            }
+        }
+
+        void fail_all(int err) {
+            while (!waiting_.empty()) {
+                pending_call* call = waiting_.front();
+                waiting_.erase(waiting_.begin());
+                call->err_ = err;
+                finish(*call);
+            }
+        }
+
+        /** Wakes a server_loop for the oldest call's timeout */
+        virtual void fire() override {
+            expire();
+            if (waiting_.empty())
+                return;
+            // the clock may pass the deadline after expire(): wake at once then
+            long left_ms     = static_cast<long>(waiting_.front()->deadline_ - sys::millis());
+            uint32_t left_us = (left_ms > 0) ? static_cast<uint32_t>(left_ms) * 1000 : 0;
+            timer_queue::instance().schedule(*this, sys::micros() + left_us);
+        }
+
+        using ClientT::gate_;
+        using ClientT::istream_;
+        using ClientT::nextid_;
+        using ClientT::timeout_ms_;
+        std::vector<pending_call*> waiting_; ///< in send order, so by deadline
+        bool closing_;
+    };
+
+    /************************************************************************
+     * async_json_client with static (non-heap) buffer storage
+     ***********************************************************************/
+    template <class KeysT, size_t BUFFER_SIZE, class FramingT = slip_null_framing, size_t TX_SIZE = 0>
+    class static_async_json_client : public async_json_client<KeysT, FramingT> {
+     public:
+        static_async_json_client(sys::StreamT& istream, sys::StreamT& ostream,
+                                 unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : async_json_client<KeysT, FramingT>(istream, ostream, timeout_ms) {
+            // MUST wait to initialize buffer until after static_buffer creation
+            if (TX_SIZE > 0)
+                async_json_client<KeysT, FramingT>::buffers(std::move(static_buffer_), std::move(static_txbuf_));
+            else
+                async_json_client<KeysT, FramingT>::buffer(std::move(static_buffer_));
+        }
+
+     protected:
+        static_arraybuf<uint8_t, BUFFER_SIZE> static_buffer_;
+        static_arraybuf<uint8_t, TX_SIZE ? TX_SIZE : 1> static_txbuf_;
+    };
+
+    /************************************************************************
+     * async_json_client with dynamic (heap) buffer storage
+     ***********************************************************************/
+    template <class KeysT, class FramingT = slip_null_framing>
+    class dynamic_async_json_client : public async_json_client<KeysT, FramingT> {
+     public:
+        dynamic_async_json_client(sys::StreamT& istream, sys::StreamT& ostream, size_t buffer_size,
+                                  unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : async_json_client<KeysT, FramingT>(istream, ostream, timeout_ms) {
+            // MUST wait to initialize buffer until after static_buffer creation
+            async_json_client<KeysT, FramingT>::buffers(dynamic_arraybuf<uint8_t>(buffer_size), dynamic_arraybuf<uint8_t>(buffer_size));
+        }
+    };
+
+} // namespace rdl
+
+    #endif // RDL_HAS_COROUTINES
+
+#endif // __JSONASYNCCLIENT_H__
@@ -3,11 +3,13 @@
 #ifndef __JSONCLIENT_H__
     #define __JSONCLIENT_H__
 
+    #include "ClockSync.h"
     #include "JsonDelegate.h"
     #include "JsonError.h"
     #include "JsonProtocol.h"
     #include "Logger.h"
     #include "SlipInPlace.h"
+    #include "TxPriority.h"
     #include "std_utility.h"
     #include "sys_PrintT.h"
     #include "sys_StreamT.h"
@@ -15,58 +17,74 @@
     #include "sys_timing.h"
     #include <ArduinoJson.h>
     #include <assert.h>
+    #include <string.h> // for memcpy
+
+    /** Time exchanges per json_client::sync_clock() */
+    #ifndef JSONRPC_CLOCK_SYNC_ROUNDS
+        #define JSONRPC_CLOCK_SYNC_ROUNDS 8
+    #endif
+
+    /**
+     * Bytes of server pushes a json_client holds back while it waits for
+     * a reply. Pushes that do not fit are dropped.
+     */
+    #ifndef JSONRPC_PUSH_QUEUE_SIZE
+        #define JSONRPC_PUSH_QUEUE_SIZE 256
+    #endif
 
 namespace rdl {
 
+    namespace svc {
+        /** Call every json_stub registered under a pushed method */
+        template <class MapT>
+        int call_push_map(void* map_ptr, const sys::StringT& method, JsonArray& args) {
+            MapT& map  = *static_cast<MapT*>(map_ptr);
+            auto range = map.equal_range(method);
+            if (range.first == range.second)
+                return ERROR_JSON_METHOD_NOT_FOUND;
+            StaticJsonDocument<JRESULT_SIZE> resultdoc;
+            JsonVariant result = resultdoc.to<JsonVariant>();
+            int err            = ERROR_OK;
+            for (auto it = range.first; it != range.second; ++it) {
+                int callerr = it->second.call(args, result);
+                if (callerr != ERROR_OK)
+                    err = callerr;
+            }
+            return err;
+        }
+    };
+
     /************************************************************************
      * CLIENT
+     *
+     * Every call or notify holds the client's transmit gate until it is
+     * done, so threads can share one client. Transactions inside a
+     * bulk_scope yield to waiting control transactions at each frame
+     * (see TxPriority.h).
+     *
+     * Server pushes that arrive while a call waits for its reply are
+     * queued and handled once the call is done, so push handlers may use
+     * the client themselves.
      ***********************************************************************/
-    template <class KeysT>
-    class json_client : protected protocol_base<KeysT> {
+    template <class KeysT, class FramingT = slip_null_framing>
+    class json_client : protected protocol_base<KeysT, FramingT> {
      public:
-        using BaseT = protocol_base<KeysT>;
+        using BaseT = protocol_base<KeysT, FramingT>;
         using BaseT::logger;
 
         template <typename... PARAMS>
         int call(const char* method, PARAMS... args) {
-            unsigned long starttime = sys::millis();
-            unsigned long endtime   = starttime + timeout_ms_;
-            unsigned long time;
-            int last_err = ERROR_OK;
-            size_t msgsize;
-            long msg_id = nextid_++;
-            last_err    = call_impl<PARAMS...>(method, msg_id, args...);
-            int attempt = 0;
-            while ((time = sys::millis()) < endtime) {
-                attempt++;
-                // give some time for the reply
-                if (retry_delay_ms_ > 0) {
-                    sys::delay(retry_delay_ms_);
-                } else {
-                    sys::yield();
-                }
-                DCS_BLK(logger_->print("CLIENT call read_reply attempt "); logger_->println(attempt));
-                // get reply
+            int err;
+            {
+                svc::tx_gate::guard tx(gate_);
+                long msg_id = nextid_++;
                 StaticJsonDocument<svc::JDOC_SIZE> msg;
-                last_err = read_reply(msgsize);
-                if (last_err == ERROR_OK) {
-                    last_err = BaseT::deserialize_reply(msg, msgsize, msg_id);
-                }
-                if (last_err != ERROR_OK) {
-                    if (last_err == ERROR_JSON_NO_REPLY) {
-                        DCS_BLK(logger_->println("CLIENT no reply yet"));
-                    } else {
-                        DCS_BLK(logger_->print("CLIENT bad reply ERROR "); logger_->println(last_err));
-                    }
-                    continue; // try again
-                }
-                DCS_BLK(logger_->print("CLIENT call success"));
-                DCS_BLK(logger_->print("\ttime ("); logger_->print(sys::millis() - starttime); logger_->println(" ms)"));
-
-                // all good
-                return ERROR_OK;
+                if ((err = call_impl<PARAMS...>(method, msg_id, args...)) == ERROR_OK &&
+                    (err = wait_reply(msg, msg_id)) == ERROR_OK)
+                    err = BaseT::parse_reply(msg, msg_id);
             }
-            return last_err;
+            dispatch_queued();
+            return err;
         }
 
         /** Call with no return and tuple of parameters */
@@ -77,28 +95,155 @@ namespace rdl {
 
         template <typename RTYPE, typename... PARAMS>
         int call_get(const char* method, RTYPE& ret, PARAMS... args) {
+            int err;
+            {
+                svc::tx_gate::guard tx(gate_);
+                long msg_id = nextid_++;
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                if ((err = call_impl<PARAMS...>(method, msg_id, args...)) == ERROR_OK &&
+                    (err = wait_reply(msg, msg_id)) == ERROR_OK)
+                    err = BaseT::parse_reply(msg, msg_id, ret);
+            }
+            dispatch_queued();
+            return err;
+        }
+
+        /** Call with return value and tuple of parameters */
+        template <typename RTYPE, typename TUPLE>
+        inline int call_get_tuple(const char* method, RTYPE& ret, TUPLE args) {
+            return call_get_tuple_impl<RTYPE>(method, ret, args, std::make_index_sequence<std::tuple_size<TUPLE>{}>{});
+        }
+
+        /**
+         * Call with a result too big for call_get, such as the "$" device
+         * snapshot. The reply is deserialized into replydoc and result
+         * refers into it. Strings in result are only valid until the
+         * next call, so pushes queued meanwhile wait for the next call or
+         * check_messages().
+         */
+        template <typename... PARAMS>
+        int call_get_doc(const char* method, JsonDocument& replydoc, JsonVariant& result, PARAMS... args) {
+            svc::tx_gate::guard tx(gate_);
+            long msg_id = nextid_++;
+            int err     = call_impl<PARAMS...>(method, msg_id, args...);
+            if (err != ERROR_OK)
+                return err;
+            if ((err = wait_reply(replydoc, msg_id)) != ERROR_OK)
+                return err;
+            return BaseT::parse_reply(replydoc, msg_id, result);
+        }
+
+        template <typename... PARAMS>
+        int notify(const char* method, PARAMS... args) {
+            svc::tx_gate::guard tx(gate_);
+            return call_impl(method, -1, args...);
+        }
+
+        /** Notify (no return) with tulple of parameters */
+        template <typename TUPLE>
+        inline int notify_tuple(const char* method, TUPLE args) {
+            return notify_tuple_impl(method, args, std::make_index_sequence<std::tuple_size<TUPLE>{}>{});
+        }
+
+        /**
+         * Estimate the server clock (":"). Keeps the exchange with the
+         * shortest round trip and adds it to clock.
+         * @see clock_sync
+         */
+        int sync_clock(clock_sync& clock, int rounds = JSONRPC_CLOCK_SYNC_ROUNDS) {
+            int err              = ERROR_JSON_NO_REPLY;
+            bool found           = false;
+            uint32_t best_client = 0, best_server = 0, best_rtt = 0;
+            for (int i = 0; i < rounds; i++) {
+                uint32_t server_us = 0;
+                uint32_t sent      = sys::micros();
+                err                = call_get(svc::CLOCK_METHOD, server_us);
+                uint32_t rtt       = sys::micros() - sent;
+                if (err != ERROR_OK)
+                    continue;
+                if (!found || rtt < best_rtt) {
+                    found       = true;
+                    best_client = sent + rtt / 2;
+                    best_server = server_us;
+                    best_rtt    = rtt;
+                }
+            }
+            if (!found)
+                return err;
+            clock.add_sample(best_client, best_server, best_rtt);
+            return ERROR_OK;
+        }
+
+        /**
+         * Route server pushes (e.g. "=brief" property changes) through a
+         * dispatch map of json_stubs, filled like the server's map. Every
+         * entry matching the pushed method is called, so a multimap may
+         * hold several handlers for the same method.
+         */
+        template <class MapT>
+        void push_map(MapT& map) {
+            push_stub_ = stub(&map, reinterpret_cast<stub::FnStubT>(&svc::call_push_map<MapT>));
+        }
+
+        /**
+         * Handle server pushes waiting on the input stream. Returns
+         * immediately when nothing is available, or when called from a
+         * push handler. Pushes that arrive during a call are handled when
+         * the call is done.
+         */
+        int check_messages() {
+            svc::tx_gate::guard tx(gate_);
+            if (dispatching_)
+                return ERROR_OK; // the outer check_messages() reads on
+            dispatch_queued();
+            size_t msgsize;
+            while (istream_.available() > 0) {
+                int err = read_reply(msgsize);
+                if (err != ERROR_OK)
+                    return err;
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                err = BaseT::deserialize_message(msg, msgsize);
+                if (err != ERROR_OK)
+                    return err;
+                // a late reply to a timed-out call is dropped
+                if (BaseT::is_push(msg)) {
+                    queue_push(msg);
+                    dispatch_queued();
+                }
+            }
+            return ERROR_OK;
+        }
+
+     protected:
+        /** Wait for the reply to msg_id, queueing any server pushes meanwhile */
+        int wait_reply(JsonDocument& msg, long msg_id) {
             unsigned long starttime = sys::millis();
             unsigned long endtime   = starttime + timeout_ms_;
-            unsigned long time;
-            int last_err = ERROR_OK;
+            int last_err            = ERROR_JSON_NO_REPLY;
             size_t msgsize;
-            long msg_id = nextid_++;
-            last_err    = call_impl<PARAMS...>(method, msg_id, args...);
             int attempt = 0;
-            while ((time = sys::millis()) < endtime) {
+            while (sys::millis() < endtime) {
                 attempt++;
                 // give some time for the reply
-                if (retry_delay_ms_ > 0) {
-                    sys::delay(retry_delay_ms_);
-                } else {
-                    sys::yield();
+                if (istream_.available() == 0) {
+                    if (retry_delay_ms_ > 0) {
+                        sys::delay(retry_delay_ms_);
+                    } else {
+                        sys::yield();
+                    }
                 }
-                DCS_BLK(logger_->print("CLIENT call read_reply attempt "); logger_->println(attempt));
+                DCS_BLK(logger_->print("CLIENT read_reply attempt "); logger_->println(attempt));
                 // get reply
-                StaticJsonDocument<svc::JDOC_SIZE> msg;
                 last_err = read_reply(msgsize);
                 if (last_err == ERROR_OK) {
-                    last_err = BaseT::deserialize_reply(msg, msgsize, msg_id, ret);
+                    last_err = BaseT::deserialize_message(msg, msgsize);
+                }
+                if (last_err == ERROR_OK && BaseT::is_push(msg)) {
+                    queue_push(msg);
+                    continue; // still waiting for our reply
+                }
+                if (last_err == ERROR_OK && !BaseT::is_reply_to(msg, msg_id)) {
+                    last_err = ERROR_JSON_INVALID_REPLY; // e.g. late reply to a timed-out call
                 }
                 if (last_err != ERROR_OK) {
                     if (last_err == ERROR_JSON_NO_REPLY) {
@@ -108,7 +253,7 @@ namespace rdl {
                     }
                     continue; // try again
                 }
-                DCS_BLK(logger_->print("CLIENT call_get success"));
+                DCS_BLK(logger_->print("CLIENT reply"));
                 DCS_BLK(logger_->print("\ttime ("); logger_->print(sys::millis() - starttime); logger_->println(" ms)"));
                 // all good
                 return ERROR_OK;
@@ -116,24 +261,59 @@ namespace rdl {
             return last_err;
         }
 
-        /** Call with return value and tuple of parameters */
-        template <typename RTYPE, typename TUPLE>
-        inline int call_get_tuple(const char* method, RTYPE& ret, TUPLE args) {
-            return call_get_tuple_impl<RTYPE>(method, ret, args, std::make_index_sequence<std::tuple_size<TUPLE>{}>{});
+        /**
+         * Copy a push out of the receive buffer, which the reply or a
+         * handler's own calls will overwrite, until dispatch_queued().
+         */
+        void queue_push(JsonDocument& msg) {
+            if (push_stub_.fnstub() == nullptr)
+                return;
+            size_t room   = sizeof(pushq_) - pushq_used_;
+            size_t needed = measureMessage(msg);
+            size_t size   = 0;
+            if (needed + sizeof(size) < room)
+                size = serializeMessage(msg, pushq_ + pushq_used_ + sizeof(size), room - sizeof(size));
+            if (size == 0 || size != needed) {
+                DCS_BLK(logger_->println("CLIENT push queue full, push dropped"));
+                return;
+            }
+            memcpy(pushq_ + pushq_used_, &size, sizeof(size));
+            pushq_used_ += sizeof(size) + size;
         }
 
-        template <typename... PARAMS>
-        int notify(const char* method, PARAMS... args) {
-            return call_impl(method, -1, args...);
+        /**
+         * Handle the queued pushes, outside any call waiting for a reply.
+         * Pushes queued by a handler's own calls are handled in the same
+         * pass.
+         */
+        void dispatch_queued() {
+            svc::tx_gate::guard tx(gate_);
+            if (dispatching_)
+                return;
+            dispatching_ = true;
+            for (size_t pos = 0; pos < pushq_used_;) {
+                size_t size;
+                memcpy(&size, pushq_ + pos, sizeof(size));
+                pos += sizeof(size);
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                if (deserializeMessage(msg, pushq_ + pos, size) == DeserializationError::Ok)
+                    dispatch_push(msg);
+                pos += size;
+            }
+            pushq_used_  = 0;
+            dispatching_ = false;
         }
 
-        /** Notify (no return) with tulple of parameters */
-        template <typename TUPLE>
-        inline int notify_tuple(const char* method, TUPLE args) {
-            return notify_tuple_impl(method, args, std::make_index_sequence<std::tuple_size<TUPLE>{}>{});
+        void dispatch_push(JsonDocument& msg) {
+            if (push_stub_.fnstub() == nullptr)
+                return;
+            sys::StringT method = msg[BaseT::key_method()].template as<sys::StringT>();
+            JsonArray args      = msg[BaseT::key_params()];
+            int err             = push_stub_.call<int, const sys::StringT&, JsonArray&>(method, args);
+            DCS_BLK(logger_->print("CLIENT push "); logger_->print(method); logger_->print(" -> "); logger_->println(err));
+            (void)err;
         }
 
-     protected:
         template <typename TUPLE, size_t... I>
         inline int call_tuple_impl(const char* method, TUPLE args, std::index_sequence<I...>) {
             return call(method, std::get<I>(args)...);
@@ -151,30 +331,27 @@ namespace rdl {
 
         template <typename... PARAMS>
         int call_impl(const char* method, long msg_id, PARAMS... args) {
-            assert(buffer_.valid());
+            assert(txbuf_.valid());
             int last_err = ERROR_OK;
             size_t msgsize;
             StaticJsonDocument<svc::JDOC_SIZE> msg;
             last_err = this->template serialize_call<PARAMS...>(msg, msgsize, method, msg_id, args...);
             if (last_err != ERROR_OK)
                 return last_err;
-            size_t writesize = ostream_.write(buffer_.data(), msgsize);
-            if (writesize < msgsize)
-                return ERROR_JSON_SEND_ERROR;
-            DCS_BLK(logger_->print("CLIENT >> "); print_escaped(*logger_, buffer_.data(), writesize, "'"); logger_->println());
-            return ERROR_OK;
+            DCS_BLK(logger_->print("CLIENT >> "); print_escaped(*logger_, BaseT::tx_frame(), msgsize, "'"); logger_->println());
+            return BaseT::send_frame(msgsize);
         }
 
         int read_reply(size_t& msgsize) {
-            assert(buffer_.valid());
+            assert(rxbuf_.valid());
             if (istream_.available() == 0) {
                 // Let the caller deal with timeouts
                 return ERROR_JSON_NO_REPLY;
             }
             DCS(unsigned long starttime = sys::millis());
 
-            msgsize = istream_.readBytesUntil(slip_std_codes::SLIP_END, buffer_.data(), buffer_.max_size());
-            DCS_BLK(logger_->print("CLIENT << "); print_escaped(*logger_, buffer_.data(), msgsize, "'"); logger_->println());
+            msgsize = istream_.readBytesUntil(BaseT::frame_end(), rxbuf_.data(), rxbuf_.max_size());
+            DCS_BLK(logger_->print("CLIENT << "); print_escaped(*logger_, rxbuf_.data(), msgsize, "'"); logger_->println());
             if (msgsize > 0) {
                 DCS_BLK(logger_->print("CLIENT read_reply found"));
                 DCS_BLK(logger_->print("\ttime ("); logger_->print(sys::millis() - starttime); logger_->println(" ms)"));
@@ -188,48 +365,65 @@ namespace rdl {
         json_client(sys::StreamT& istream, sys::StreamT& ostream,
                     unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                     unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : BaseT(istream, ostream, timeout_ms, retry_delay_ms), nextid_(1) {
+            : BaseT(istream, ostream, timeout_ms, retry_delay_ms), nextid_(1), push_stub_(), pushq_used_(0),
+              dispatching_(false) {
         }
 
         using BaseT::istream_;
         using BaseT::ostream_;
-        using BaseT::buffer_;
+        using BaseT::rxbuf_;
+        using BaseT::txbuf_;
         using BaseT::timeout_ms_;
         using BaseT::retry_delay_ms_;
         using BaseT::logger_;
         long nextid_;
+        stub push_stub_;
+        svc::tx_gate gate_;
+        uint8_t pushq_[JSONRPC_PUSH_QUEUE_SIZE]; ///< pushes held back by wait_reply(), each after its size
+        size_t pushq_used_;
+        bool dispatching_; ///< in dispatch_queued(), handlers may be running
     };
 
     /************************************************************************
      * json_client with static (non-heap) buffer storage
+     *
+     * Replies are read into BUFFER_SIZE bytes. By default calls are written
+     * from the same buffer. A TX_SIZE gives them a buffer of their own, so
+     * a call can be serialized while a reply or push is still being
+     * decoded, at the cost of that much more RAM.
      ***********************************************************************/
-    template <class KeysT, size_t BUFFER_SIZE>
-    class static_json_client : public json_client<KeysT> {
+    template <class KeysT, size_t BUFFER_SIZE, class FramingT = slip_null_framing, size_t TX_SIZE = 0>
+    class static_json_client : public json_client<KeysT, FramingT> {
      public:
         static_json_client(sys::StreamT& istream, sys::StreamT& ostream,
                            unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                            unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : json_client<KeysT>(istream, ostream, timeout_ms, retry_delay_ms) {
+            : json_client<KeysT, FramingT>(istream, ostream, timeout_ms, retry_delay_ms) {
             // MUST wait to initialize buffer until after static_buffer creation
-            protocol_base<KeysT>::buffer_ = std::move(static_buffer_);
+            if (TX_SIZE > 0)
+                json_client<KeysT, FramingT>::buffers(std::move(static_buffer_), std::move(static_txbuf_));
+            else
+                json_client<KeysT, FramingT>::buffer(std::move(static_buffer_));
         }
 
      protected:
         static_arraybuf<uint8_t, BUFFER_SIZE> static_buffer_;
+        static_arraybuf<uint8_t, TX_SIZE ? TX_SIZE : 1> static_txbuf_;
     };
 
     /************************************************************************
-     * json_client with dynamic (heap) buffer storage
+     * json_client with dynamic (heap) buffer storage. Replies and calls
+     * each get buffer_size bytes.
      ***********************************************************************/
-    template <class KeysT>
-    class dynamic_json_client : public json_client<KeysT> {
+    template <class KeysT, class FramingT = slip_null_framing>
+    class dynamic_json_client : public json_client<KeysT, FramingT> {
      public:
         dynamic_json_client(sys::StreamT& istream, sys::StreamT& ostream, size_t buffer_size,
                             unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                             unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : json_client<KeysT>(istream, ostream, timeout_ms, retry_delay_ms) {
+            : json_client<KeysT, FramingT>(istream, ostream, timeout_ms, retry_delay_ms) {
             // MUST wait to initialize buffer until after static_buffer creation
-            protocol_base<KeysT>::buffer_ = std::move(dynamic_arraybuf<uint8_t>(buffer_size));
+            json_client<KeysT, FramingT>::buffers(dynamic_arraybuf<uint8_t>(buffer_size), dynamic_arraybuf<uint8_t>(buffer_size));
         }
     };
 
@@ -21,6 +21,8 @@ namespace rdl {
     constexpr int ERROR_JSON_INVALID_REPLY  = -32005;
     constexpr int ERROR_SLIP_ENCODING_ERROR = -32006;
     constexpr int ERROR_SLIP_DECODING_ERROR = -32007;
+    constexpr int ERROR_LZSS_DECODING_ERROR = -32008;
+    constexpr int ERROR_JSON_SNAPSHOT_FULL  = -32009;
 
     constexpr int ERROR_JSON_DESER_ERROR_0          = -32090;
     constexpr int ERROR_JSON_DESER_EMPTY_INPUT      = ERROR_JSON_DESER_ERROR_0 - ArduinoJson::DeserializationError::EmptyInput;
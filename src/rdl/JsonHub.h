@@ -0,0 +1,371 @@
+/*!
+ *  @file JsonHub.h
+ *
+ *  Share one device between several client processes.
+ *
+ *  Only one process can own a serial port, so micro-manager and a
+ *  diagnostics tool cannot both open the same device. A json_hub owns the
+ *  device stream and relays frames between it and any number of client
+ *  streams (e.g. Stream_Sockets accepted by the ardulingua_hub daemon):
+ *
+ *  - calls get a hub-wide id before they go to the device, and the reply
+ *    gets the client's own id back, so clients may reuse ids freely
+ *  - notifications pass through unchanged
+ *  - server pushes ("=brief", "|brief") go to every client
+ *
+ *  Several calls may be in flight at once, up to JSONRPC_HUB_MAX_IN_FLIGHT,
+ *  and the frames collected in one poll() reach the device in a single
+ *  write, so the link stays busy while each client waits for its reply.
+ *  The device handles frames in arrival order; keep the in-flight limit
+ *  below what its receive buffer holds.
+ *
+ *  Frames are decoded and serialized again to rewrite ids. Compressed
+ *  frames (JSONRPC_USE_COMPRESSION) are forwarded uncompressed, which every
+ *  receiver accepts.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __JSONHUB_H__
+    #define __JSONHUB_H__
+
+    #include "Arraybuf.h"
+    #include "JsonError.h"
+    #include "JsonProtocol.h"
+    #include "sys_StreamT.h"
+    #include "sys_timing.h"
+    #include <ArduinoJson.h>
+    #include <stdint.h>
+
+    /** Client streams a hub can relay */
+    #ifndef JSONRPC_HUB_MAX_CLIENTS
+        #define JSONRPC_HUB_MAX_CLIENTS 8
+    #endif
+
+    /** Calls waiting for a device reply at one time */
+    #ifndef JSONRPC_HUB_MAX_IN_FLIGHT
+        #define JSONRPC_HUB_MAX_IN_FLIGHT 4
+    #endif
+
+    /** Document for any relayed message, large enough for a "$" snapshot reply */
+    #ifndef JSONRPC_HUB_DOC_SIZE
+        #define JSONRPC_HUB_DOC_SIZE (rdl::svc::SNAPSHOT_DOC_SIZE + rdl::svc::JDOC_SIZE)
+    #endif
+
+namespace rdl {
+
+    /************************************************************************
+     * Relay between one device stream and several client streams.
+     *
+     * Call poll() from one thread whenever any stream may have data. The
+     * hub reads and writes every stream, so a client stream must not be
+     * touched by anyone else while attached.
+     *
+     * @tparam KeysT        message keys, as for json_client
+     * @tparam FramingT     framing used by the device and every client
+     ************************************************************************/
+    template <class KeysT, class FramingT = slip_null_framing>
+    class json_hub {
+     public:
+        using encoder = typename FramingT::encoder;
+        using decoder = typename FramingT::decoder;
+        using ProtoT  = protocol_base<KeysT, FramingT>;
+
+        /**
+         * Add a client stream.
+         * @return slot number for detach(), or -1 if the hub is full
+         */
+        int attach(sys::StreamT& client) {
+            for (int slot = 0; slot < JSONRPC_HUB_MAX_CLIENTS; slot++) {
+                if (clients_[slot] == nullptr) {
+                    clients_[slot] = &client;
+                    return slot;
+                }
+            }
+            return -1;
+        }
+
+        /** Remove a client stream. Replies still due to it are dropped. */
+        void detach(int slot) {
+            if (slot < 0 || slot >= JSONRPC_HUB_MAX_CLIENTS)
+                return;
+            clients_[slot] = nullptr;
+            for (auto& call : calls_) {
+                if (call.slot == slot)
+                    call.slot = -1; // the reply still frees the entry
+            }
+        }
+
+        /**
+         * Relay waiting frames: device replies and pushes to the clients,
+         * then client frames to the device, taking clients in turn.
+         * @return ERROR_OK or the last error; errors drop only their frame
+         */
+        int poll() {
+            int err = ERROR_OK;
+            while (device_.available() > 0) {
+                int ferr = from_device();
+                if (ferr != ERROR_OK)
+                    err = ferr;
+            }
+            expire();
+            bool moved = true;
+            while (moved) {
+                moved = false;
+                for (int k = 0; k < JSONRPC_HUB_MAX_CLIENTS; k++) {
+                    int slot = (turn_ + k) % JSONRPC_HUB_MAX_CLIENTS;
+                    if (clients_[slot] == nullptr || clients_[slot]->available() <= 0)
+                        continue;
+                    if (in_flight_ >= JSONRPC_HUB_MAX_IN_FLIGHT)
+                        break;
+                    int ferr = from_client(slot);
+                    if (ferr != ERROR_OK)
+                        err = ferr;
+                    moved = true;
+                }
+                turn_ = (turn_ + 1) % JSONRPC_HUB_MAX_CLIENTS;
+            }
+            int ferr = flush();
+            return ferr != ERROR_OK ? ferr : err;
+        }
+
+        /** Calls sent to the device and not yet answered */
+        int in_flight() const { return in_flight_; }
+
+        unsigned long relayed() const { return relayed_; }
+        /** Frames that could not be decoded, replies nobody waits for, and expired calls */
+        unsigned long dropped() const { return dropped_; }
+
+        /** Give up on device replies after timeout_ms */
+        void timeout(unsigned long timeout_ms) { timeout_ms_ = timeout_ms; }
+
+     protected:
+        struct call_entry {
+            long hub_id;       ///< id sent to the device, 0 if the entry is free
+            long client_id;    ///< id the client used
+            int slot;          ///< client slot, -1 if the client left
+            unsigned long sent;
+        };
+
+        json_hub(sys::StreamT& device, unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : device_(device), rxbuf_(), batch_(), batched_(0), timeout_ms_(timeout_ms),
+              next_id_(1), in_flight_(0), turn_(0), relayed_(0), dropped_(0) {
+            for (auto& client : clients_)
+                client = nullptr;
+            for (auto& call : calls_)
+                call = call_entry{0, 0, -1, 0};
+        }
+
+        /** Read one frame into rxbuf_ and deserialize it (zero copy) */
+        int read_frame(sys::StreamT& from, JsonDocument& msg) {
+            size_t msgsize = from.readBytesUntil(ProtoT::frame_end(), rxbuf_.data(), rxbuf_.max_size());
+            if (msgsize == 0)
+                return ERROR_JSON_TIMEOUT;
+            msgsize = decoder::decode(rxbuf_.data(), rxbuf_.max_size(), rxbuf_.data(), msgsize);
+            if (msgsize == 0)
+                return ERROR_SLIP_DECODING_ERROR;
+    #if JSONRPC_USE_COMPRESSION
+            if (rxbuf_.data()[0] == JSONRPC_COMPRESSED_FLAG) {
+                msgsize = lzss_decoder::decode(rxbuf_.data(), rxbuf_.max_size(), rxbuf_.data() + 1, msgsize - 1);
+                if (msgsize == 0)
+                    return ERROR_LZSS_DECODING_ERROR;
+            }
+    #endif
+            DeserializationError derr = deserializeMessage(msg, rxbuf_.data(), msgsize);
+            if (derr != DeserializationError::Ok)
+                return ERROR_JSON_DESER_ERROR_0 - derr.code();
+            return ERROR_OK;
+        }
+
+        /** Serialize and frame msg at the end of the batch. @return size or 0 if it does not fit */
+        size_t frame_into_batch(JsonDocument& msg) {
+            uint8_t* dest = batch_.data() + batched_;
+            size_t room   = batch_.max_size() - batched_;
+            size_t size   = serializeMessage(msg, dest, room);
+            if (size == 0 || size >= room)
+                return 0;
+            return encoder::encode(dest, room, dest, size);
+        }
+
+        /** Relay one client frame toward the device */
+        int from_client(int slot) {
+            StaticJsonDocument<JSONRPC_HUB_DOC_SIZE> msg;
+            int err = read_frame(*clients_[slot], msg);
+            if (err != ERROR_OK) {
+                dropped_++;
+                return err;
+            }
+            call_entry* call = nullptr;
+            JsonVariant jvid = msg[ProtoT::key_id()];
+            if (!jvid.isNull()) {
+                call = free_entry();
+                if (call == nullptr) // poll() checks in_flight_ first
+                    return ERROR_JSON_INTERNAL_ERROR;
+                *call                   = call_entry{new_id(), jvid.as<long>(), slot, sys::millis()};
+                msg[ProtoT::key_id()] = call->hub_id;
+            }
+            size_t size = frame_into_batch(msg);
+            if (size == 0 && batched_ > 0) {
+                flush();
+                size = frame_into_batch(msg);
+            }
+            if (size == 0) {
+                if (call)
+                    call->hub_id = 0;
+                dropped_++;
+                return ERROR_SLIP_ENCODING_ERROR;
+            }
+            batched_ += size;
+            if (call)
+                in_flight_++;
+            relayed_++;
+            return ERROR_OK;
+        }
+
+        /** Relay one device frame: a reply to its caller or a push to everyone */
+        int from_device() {
+            StaticJsonDocument<JSONRPC_HUB_DOC_SIZE> msg;
+            int err = read_frame(device_, msg);
+            if (err != ERROR_OK) {
+                dropped_++;
+                return err;
+            }
+            if (ProtoT::is_push(msg))
+                return to_clients(msg, -1);
+            JsonVariant jvid = msg[ProtoT::key_id()];
+            call_entry* call = jvid.isNull() ? nullptr : find_entry(jvid.as<long>());
+            if (call == nullptr) {
+                dropped_++; // a reply to an expired call
+                return ERROR_OK;
+            }
+            int slot     = call->slot;
+            long id      = call->client_id;
+            call->hub_id = 0;
+            in_flight_--;
+            if (slot < 0) {
+                dropped_++;
+                return ERROR_OK;
+            }
+            msg[ProtoT::key_id()] = id;
+            return to_clients(msg, slot);
+        }
+
+        /** Send msg to one client slot, or to all for slot -1 */
+        int to_clients(JsonDocument& msg, int slot) {
+            // the batch is empty outside poll()'s client loop, so use it
+            size_t size = frame_into_batch(msg);
+            if (size == 0) {
+                dropped_++;
+                return ERROR_SLIP_ENCODING_ERROR;
+            }
+            int err = ERROR_OK;
+            for (int s = 0; s < JSONRPC_HUB_MAX_CLIENTS; s++) {
+                if (clients_[s] == nullptr || (slot >= 0 && s != slot))
+                    continue;
+                if (clients_[s]->write(batch_.data() + batched_, size) < size)
+                    err = ERROR_JSON_SEND_ERROR;
+            }
+            relayed_++;
+            return err;
+        }
+
+        /** Write the batched client frames to the device */
+        int flush() {
+            if (batched_ == 0)
+                return ERROR_OK;
+            size_t written = device_.write(batch_.data(), batched_);
+            int err        = written < batched_ ? ERROR_JSON_SEND_ERROR : ERROR_OK;
+            batched_       = 0;
+            return err;
+        }
+
+        /** Forget calls the device did not answer in time */
+        void expire() {
+            unsigned long now = sys::millis();
+            for (auto& call : calls_) {
+                if (call.hub_id != 0 && now - call.sent > timeout_ms_) {
+                    call.hub_id = 0;
+                    in_flight_--;
+                    dropped_++;
+                }
+            }
+        }
+
+        call_entry* free_entry() {
+            for (auto& call : calls_) {
+                if (call.hub_id == 0)
+                    return &call;
+            }
+            return nullptr;
+        }
+
+        call_entry* find_entry(long hub_id) {
+            for (auto& call : calls_) {
+                if (call.hub_id != 0 && call.hub_id == hub_id)
+                    return &call;
+            }
+            return nullptr;
+        }
+
+        /** Positive ids, never one still in flight */
+        long new_id() {
+            do {
+                next_id_ = next_id_ >= 0x7FFFFFFFL ? 1 : next_id_ + 1;
+            } while (find_entry(next_id_) != nullptr);
+            return next_id_;
+        }
+
+        sys::StreamT& device_;
+        sys::StreamT* clients_[JSONRPC_HUB_MAX_CLIENTS];
+        call_entry calls_[JSONRPC_HUB_MAX_IN_FLIGHT];
+        arraybuf<uint8_t> rxbuf_; ///< received frame, decoded in place
+        arraybuf<uint8_t> batch_; ///< frames on their way out
+        size_t batched_;
+        unsigned long timeout_ms_;
+        long next_id_;
+        int in_flight_;
+        int turn_;
+        unsigned long relayed_;
+        unsigned long dropped_;
+    };
+
+    /************************************************************************
+     * json_hub with static (non-heap) buffer storage. BUFFER_SIZE bounds
+     * one frame and a batch of frames to the device.
+     ***********************************************************************/
+    template <class KeysT, size_t BUFFER_SIZE, size_t BATCH_SIZE = 2 * BUFFER_SIZE, class FramingT = slip_null_framing>
+    class static_json_hub : public json_hub<KeysT, FramingT> {
+     public:
+        static_json_hub(sys::StreamT& device, unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : json_hub<KeysT, FramingT>(device, timeout_ms) {
+            // MUST wait to initialize buffers until after static_buffer creation
+            json_hub<KeysT, FramingT>::rxbuf_ = std::move(static_rxbuf_);
+            json_hub<KeysT, FramingT>::batch_ = std::move(static_batch_);
+        }
+
+     protected:
+        static_arraybuf<uint8_t, BUFFER_SIZE> static_rxbuf_;
+        static_arraybuf<uint8_t, BATCH_SIZE> static_batch_;
+    };
+
+    /************************************************************************
+     * json_hub with dynamic (heap) buffer storage
+     ***********************************************************************/
+    template <class KeysT, class FramingT = slip_null_framing>
+    class dynamic_json_hub : public json_hub<KeysT, FramingT> {
+     public:
+        dynamic_json_hub(sys::StreamT& device, size_t buffer_size, size_t batch_size,
+                         unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : json_hub<KeysT, FramingT>(device, timeout_ms) {
+            json_hub<KeysT, FramingT>::rxbuf_ = std::move(dynamic_arraybuf<uint8_t>(buffer_size));
+            json_hub<KeysT, FramingT>::batch_ = std::move(dynamic_arraybuf<uint8_t>(batch_size));
+        }
+    };
+
+} // namespace rdl
+
+#endif // __JSONHUB_H__
@@ -7,6 +7,8 @@
     #include "JsonDelegate.h"
     #include "JsonError.h"
     #include "Logger.h"
+    #include "CobsInPlace.h"
+    #include "LzssInPlace.h"
     #include "SlipInPlace.h"
     #include "std_utility.h"
     #include "sys_PrintT.h"
@@ -18,6 +20,7 @@
 
     #define JSONRPC_USE_SHORT_KEYS 1
 // #define JSONRPC_USE_MSGPACK 1
+// #define JSONRPC_USE_COMPRESSION 1
 // #define JSONRPC_DEBUG_CLIENTSERVER 1
 // #define JSONRPC_DEBUG_SERVER_DISPATCH 1
 
@@ -25,6 +28,21 @@
     #define JSONRPC_DEFAULT_RETRY_DELAY 1
     #define JSONRCP_BUFFER_SIZE 256
 
+    /**
+     * Size of the "$" device snapshot document: room for this many
+     * properties plus JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES channel values,
+     * summed over all channel properties. Properties and channel values
+     * share the space, so either may use what the other leaves. A device
+     * needing more gets ERROR_JSON_SNAPSHOT_FULL.
+     */
+    #ifndef JSONRPC_SNAPSHOT_MAX_VALUES
+        #define JSONRPC_SNAPSHOT_MAX_VALUES 16
+    #endif
+
+    #ifndef JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES
+        #define JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES JSONRPC_SNAPSHOT_MAX_VALUES
+    #endif
+
     // SWITCH TESTING
     #if defined(JSONRPC_USE_SHORT_KEYS) && (JSONRPC_USE_SHORT_KEYS != 0)
         #define JSONRPC_USE_SHORT_KEYS 1
@@ -38,6 +56,20 @@
         #define JSONRPC_USE_MSGPACK 0
     #endif
 
+    #if defined(JSONRPC_USE_COMPRESSION) && (JSONRPC_USE_COMPRESSION != 0)
+        #define JSONRPC_USE_COMPRESSION 1
+    #else
+        #define JSONRPC_USE_COMPRESSION 0
+    #endif
+
+    /** Smallest serialized message worth compressing (JSONRPC_USE_COMPRESSION) */
+    #ifndef JSONRPC_COMPRESS_MIN_SIZE
+        #define JSONRPC_COMPRESS_MIN_SIZE 64
+    #endif
+
+    /** First byte of a compressed message. No JSON or MessagePack message starts with it. */
+    #define JSONRPC_COMPRESSED_FLAG 0xFF
+
     #if defined(JSONRPC_DEBUG_CLIENTSERVER) && (JSONRPC_DEBUG_CLIENTSERVER != 0)
         #define JSONRPC_DEBUG_CLIENTSERVER 1
     #else
@@ -118,6 +150,30 @@ namespace rdl {
      * --> {"m": "gettfoo", "i": 4}
      * <-- {"r": 3.2, "i": 4}
      *
+     * ## Server push [SUBSCRIBE-PUSH]
+     * --> {"m": "@foo", "p": [true], "i": 5}
+     * <-- {"r": true, "i": 5}
+     * ... later, whenever foo changes on the server
+     * <-- {"m": "=foo", "p": [43]}
+     *
+     * ## Device snapshot [SNAPSHOT]
+     * --> {"m": "$", "p": [], "i": 6}
+     * <-- {"r": {"foo": 43, "bar": [1.1, 2.2]}, "i": 6}
+     *
+     * ## Server clock and scheduled set [CLOCK]
+     * --> {"m": ":", "p": [], "i": 7}
+     * <-- {"r": 81234567, "i": 7}
+     * --> {"m": ">foo", "p": [44, 81240000], "i": 8}
+     * <-- {"r": true, "i": 8}
+     * ... foo becomes 44 when the server's sys::micros() reaches 81240000
+     *
+     * ## Compressed frames [COMPRESSION]
+     * With JSONRPC_USE_COMPRESSION on both ends, serialized messages of at
+     * least JSONRPC_COMPRESS_MIN_SIZE bytes are LZSS compressed before
+     * framing when that makes them smaller. A compressed message starts
+     * with the JSONRPC_COMPRESSED_FLAG byte (0xFF); other messages are sent
+     * as they are.
+     *
      ***********************************************************************/
 
     struct jsonrpc_std_keys {
@@ -148,6 +204,11 @@ namespace rdl {
         return serializeMsgPack(source, buffer, bufferSize);
     }
 
+    template <typename TSource>
+    size_t measureMessage(const TSource& source) {
+        return measureMsgPack(source);
+    }
+
     template <typename TChar>
     DeserializationError deserializeMessage(JsonDocument& doc, TChar* input, size_t inputSize) {
         return deserializeMsgPack(doc, input, inputSize);
@@ -158,6 +219,11 @@ namespace rdl {
         return serializeJson(source, buffer, bufferSize);
     }
 
+    template <typename TSource>
+    size_t measureMessage(const TSource& source) {
+        return measureJson(source);
+    }
+
     template <typename TChar>
     DeserializationError deserializeMessage(JsonDocument& doc, TChar* input, size_t inputSize) {
         return deserializeJson(doc, input, inputSize);
@@ -169,6 +235,17 @@ namespace rdl {
         constexpr size_t JDOC_SIZE    = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(MAX_PARAMETERS);
         constexpr size_t JRESULT_SIZE = JSON_OBJECT_SIZE(1);
 
+        /** Method returning every property value, see json_server::snapshot() */
+        constexpr const char* SNAPSHOT_METHOD = "$";
+        /** Document holding a "$" reply with props properties and chans channel values in all */
+        constexpr size_t snapshot_doc_size(size_t props, size_t chans) {
+            return JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(props) + JSON_ARRAY_SIZE(chans);
+        }
+        constexpr size_t SNAPSHOT_DOC_SIZE = snapshot_doc_size(JSONRPC_SNAPSHOT_MAX_VALUES, JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES);
+
+        /** Method returning the server's sys::micros(), see json_client::sync_clock() */
+        constexpr const char* CLOCK_METHOD = ":";
+
     #if 0
         class buffer {
          public:
@@ -185,19 +262,49 @@ namespace rdl {
 
     #define SERVER_COL "\t\t\t\t"
 
+    /************************************************************************
+     * FRAMING
+     *
+     * Messages are encoded in place in the protocol buffer, then written
+     * as one frame ending with encoder::end_code(). Both sides of a link
+     * must use the same framing.
+     ***********************************************************************/
+
+    /** SLIP+NULL frames: no NUL bytes, but specials double in size */
+    struct slip_null_framing {
+        using encoder = slip_null_encoder;
+        using decoder = slip_null_decoder;
+    };
+
+    /**
+     * COBS frames: no NUL bytes inside a frame, which ends with NUL.
+     * Overhead is at most one byte per 254, so the buffer only needs
+     * cobs_encoder::max_encoded_size() of the serialized message.
+     */
+    struct cobs_framing {
+        using encoder = cobs_encoder;
+        using decoder = cobs_decoder;
+    };
+
     /************************************************************************
      * PROTOCOL BASE
      ***********************************************************************/
 
-    template <class KeysT>
+    template <class KeysT, class FramingT = slip_null_framing>
     class protocol_base {
      public:
+        using encoder = typename FramingT::encoder;
+        using decoder = typename FramingT::decoder;
+
         static constexpr const char* key_method() noexcept { return KeysT::RK_METHOD; }
         static constexpr const char* key_params() noexcept { return KeysT::RK_PARAMS; }
         static constexpr const char* key_id() noexcept { return KeysT::RK_ID; }
         static constexpr const char* key_result() noexcept { return KeysT::RK_RESULT; }
         static constexpr const char* key_error() noexcept { return KeysT::RK_ERROR; }
 
+        /** Last byte of every frame, for readBytesUntil */
+        static constexpr char frame_end() noexcept { return static_cast<char>(encoder::end_code()); }
+
         sys::PrintT* logger() { return logger_; }
 
         sys::PrintT* logger(sys::PrintT* logger) {
@@ -222,7 +329,7 @@ namespace rdl {
         // SEVER_METHOD
         /** Reply with return value or possible error */
         int serialize_reply(JsonDocument& msgdoc, size_t& msgsize, const int id, JsonVariant result, int error_code) {
-            assert(buffer_.valid());
+            assert(txbuf_.valid());
             // serialize the message
             if (error_code != ERROR_OK) {
                 msgdoc[key_error()] = error_code;
@@ -231,45 +338,42 @@ namespace rdl {
             }
             msgdoc[key_id()] = id;
             // serialize the message
-            msgsize = serializeMessage(msgdoc, buffer_.data(), buffer_.max_size());
-            if (msgsize == 0)
-                return ERROR_JSON_INTERNAL_ERROR;
+            int err = pack_message(msgdoc, msgsize, ERROR_JSON_INTERNAL_ERROR);
+            if (err != ERROR_OK)
+                return err;
             DCS_BLK(logger_->print(SERVER_COL "\tserialized"); println(*logger_, msgdoc));
-            msgsize = slip_null_encoder::encode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
-            if (msgsize == 0)
-                return ERROR_SLIP_ENCODING_ERROR;
             return ERROR_OK;
         }
 
         // SERVER_METHOD
         /** Reply with no return (void) but possible error */
         int serialize_reply(JsonDocument& msgdoc, size_t& msgsize, const int id, int error_code) {
-            assert(buffer_.valid());
+            assert(txbuf_.valid());
             // serialize the message
             if (error_code != ERROR_OK) {
                 msgdoc[key_error()] = error_code;
             }
             msgdoc[key_id()] = id;
             // serialize the message
-            msgsize = serializeMessage(msgdoc, buffer_.data(), buffer_.max_size());
-            if (msgsize == 0)
-                return ERROR_JSON_INTERNAL_ERROR;
+            int err = pack_message(msgdoc, msgsize, ERROR_JSON_INTERNAL_ERROR);
+            if (err != ERROR_OK)
+                return err;
             DCS_BLK(logger_->print(SERVER_COL "\tserialized"); println(*logger_, msgdoc));
-            msgsize = slip_null_encoder::encode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
-            if (msgsize == 0)
-                return ERROR_SLIP_ENCODING_ERROR;
             return ERROR_OK;
         }
 
         // SERVER_METHOD
         int deserialize_call(JsonDocument& msgdoc, size_t msgsize, sys::StringT& method, int& id, JsonArray& args) {
-            assert(buffer_.valid());
+            assert(rxbuf_.valid());
             // slip decode the message
-            msgsize = slip_null_decoder::decode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
+            msgsize = decoder::decode(rxbuf_.data(), rxbuf_.max_size(), rxbuf_.data(), msgsize);
             if (msgsize == 0)
                 return ERROR_SLIP_DECODING_ERROR;
+            int err = decompress_message(msgsize);
+            if (err != ERROR_OK)
+                return err;
             // deserialize the message
-            DeserializationError derr = deserializeMessage(msgdoc, buffer_.data(), msgsize);
+            DeserializationError derr = deserializeMessage(msgdoc, rxbuf_.data(), msgsize);
             if (derr != DeserializationError::Ok)
                 return ERROR_JSON_DESER_ERROR_0 - derr.code();
             DCS_BLK(logger_->print(SERVER_COL "\tdeserialized"); println(*logger_, msgdoc));
@@ -288,7 +392,7 @@ namespace rdl {
         // CLIENT METHOD
         template <typename... PARAMS>
         int serialize_call(JsonDocument& msgdoc, size_t& msgsize, sys::StringT method, const int id, PARAMS... args) {
-            assert(buffer_.valid());
+            assert(txbuf_.valid());
             // serialize the message
             msgdoc[key_method()] = method;
             JsonArray params     = msgdoc.createNestedArray(key_params());
@@ -298,28 +402,47 @@ namespace rdl {
             if (id >= 0)
                 msgdoc[key_id()] = id; // request reply
             // slip-encode message
-            msgsize = serializeMessage(msgdoc, buffer_.data(), buffer_.max_size());
-            if (msgsize == 0)
-                return ERROR_JSON_ENCODING_ERROR;
+            err = pack_message(msgdoc, msgsize, ERROR_JSON_ENCODING_ERROR);
+            if (err != ERROR_OK)
+                return err;
             DCS_BLK(logger_->print("\tserialized "); println(*logger_, msgdoc));
-            msgsize = slip_null_encoder::encode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
-            if (msgsize == 0)
-                return ERROR_SLIP_ENCODING_ERROR;
             return ERROR_OK;
         }
 
         // CLIENT METHOD
-        template <typename RTYPE>
-        int deserialize_reply(JsonDocument& msgdoc, size_t msgsize, long msg_id, RTYPE& ret) {
-            assert(buffer_.valid());
+        /** Decode and deserialize a received reply or server push */
+        int deserialize_message(JsonDocument& msgdoc, size_t msgsize) {
+            assert(rxbuf_.valid());
             // decode message
-            msgsize = slip_null_decoder::decode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
+            msgsize = decoder::decode(rxbuf_.data(), rxbuf_.max_size(), rxbuf_.data(), msgsize);
             if (msgsize == 0)
                 return ERROR_SLIP_DECODING_ERROR;
-            DeserializationError derr = deserializeMessage(msgdoc, buffer_.data(), msgsize);
+            int err = decompress_message(msgsize);
+            if (err != ERROR_OK)
+                return err;
+            DeserializationError derr = deserializeMessage(msgdoc, rxbuf_.data(), msgsize);
             if (derr != DeserializationError::Ok)
                 return ERROR_JSON_DESER_ERROR_0 - derr.code();
             DCS_BLK(logger_->print("\tdeserialized"); println(*logger_, msgdoc));
+            return ERROR_OK;
+        }
+
+        // CLIENT METHOD
+        /** Server pushes carry a method, replies never do */
+        static bool is_push(JsonDocument& msgdoc) {
+            return msgdoc.containsKey(key_method());
+        }
+
+        // CLIENT METHOD
+        /** Replies carry the id of the call they answer */
+        static bool is_reply_to(JsonDocument& msgdoc, long msg_id) {
+            JsonVariant jvid = msgdoc[key_id()];
+            return !jvid.isNull() && jvid.as<long>() == msg_id;
+        }
+
+        // CLIENT METHOD
+        template <typename RTYPE>
+        int parse_reply(JsonDocument& msgdoc, long msg_id, RTYPE& ret) {
             JsonVariant jvid = msgdoc[key_id()];
             // check for reply id
             if (jvid.isNull())
@@ -329,7 +452,7 @@ namespace rdl {
                 return ERROR_JSON_INVALID_REPLY;
             // check result in reply
             JsonVariant jvres = msgdoc[key_result()];
-            if (!jvid.isNull()) { // received good reply
+            if (!jvres.isNull()) { // received good reply
                 ret = jvres.as<RTYPE>();
                 return ERROR_OK;
             }
@@ -338,16 +461,7 @@ namespace rdl {
         }
 
         // CLIENT METHOD
-        int deserialize_reply(JsonDocument& msgdoc, size_t msgsize, long msg_id) {
-            assert(buffer_.valid());
-            // decode message
-            msgsize = slip_null_decoder::decode(buffer_.data(), buffer_.max_size(), buffer_.data(), msgsize);
-            if (msgsize == 0)
-                return ERROR_SLIP_DECODING_ERROR;
-            DeserializationError derr = deserializeMessage(msgdoc, buffer_.data(), msgsize);
-            if (derr != DeserializationError::Ok)
-                return ERROR_JSON_DESER_ERROR_0 - derr.code();
-            DCS_BLK(logger_->print("\tdeserialized"); println(*logger_, msgdoc));
+        int parse_reply(JsonDocument& msgdoc, long msg_id) {
             JsonVariant jvid = msgdoc[key_id()];
             // check for reply id
             if (jvid.isNull() || jvid.as<long>() != msg_id)
@@ -356,16 +470,135 @@ namespace rdl {
             return msgdoc[key_error()] | ERROR_OK;
         }
 
+        // CLIENT METHOD
+        template <typename RTYPE>
+        int deserialize_reply(JsonDocument& msgdoc, size_t msgsize, long msg_id, RTYPE& ret) {
+            int err = deserialize_message(msgdoc, msgsize);
+            if (err != ERROR_OK)
+                return err;
+            return parse_reply(msgdoc, msg_id, ret);
+        }
+
+        // CLIENT METHOD
+        int deserialize_reply(JsonDocument& msgdoc, size_t msgsize, long msg_id) {
+            int err = deserialize_message(msgdoc, msgsize);
+            if (err != ERROR_OK)
+                return err;
+            return parse_reply(msgdoc, msg_id);
+        }
+
      protected:
         protocol_base(sys::StreamT& istream, sys::StreamT& ostream,
                       unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                       unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : istream_(istream), ostream_(ostream), logger_(no_logger()), buffer_(),
+            : istream_(istream), ostream_(ostream), logger_(no_logger()), rxbuf_(), txbuf_(), txused_(0),
             timeout_ms_(timeout_ms), retry_delay_ms_(retry_delay_ms) {
         }
 
+        /** Use one buffer for receiving and sending, one message at a time */
         void buffer(arraybuf<uint8_t>&& rval_buffer) {
-            buffer_ = std::move(rval_buffer);
+            rxbuf_  = std::move(rval_buffer);
+            txbuf_  = arraybuf<uint8_t>(rxbuf_); // shares, does not free
+            txused_ = 0;
+        }
+
+        /**
+         * Receive into rx and send from tx. Outgoing frames can then queue
+         * in tx (see send_frame()) while the next request is read and decoded.
+         */
+        void buffers(arraybuf<uint8_t>&& rval_rx, arraybuf<uint8_t>&& rval_tx) {
+            rxbuf_  = std::move(rval_rx);
+            txbuf_  = std::move(rval_tx);
+            txused_ = 0;
+        }
+
+        /** Separate receive and transmit buffers */
+        bool duplex() { return txbuf_.data() != rxbuf_.data(); }
+
+        /** Where the next outgoing frame is packed: behind the queued ones */
+        uint8_t* tx_frame() { return txbuf_.data() + txused_; }
+        size_t tx_room() const { return txbuf_.max_size() - txused_; }
+
+        /**
+         * Serialize, compress and frame msgdoc at tx_frame(). Flushes the
+         * queued frames first if they leave too little room.
+         * @param serialize_err error to report if msgdoc does not fit
+         */
+        int pack_message(JsonDocument& msgdoc, size_t& msgsize, int serialize_err) {
+            size_t needed = measureMessage(msgdoc);
+            for (;;) {
+                int err = serialize_err;
+                // ArduinoJson truncates what does not fit rather than fail
+                msgsize = (needed <= tx_room()) ? serializeMessage(msgdoc, tx_frame(), tx_room()) : 0;
+                if (msgsize > 0) {
+                    msgsize = compress_message(msgdoc, msgsize);
+                    msgsize = encoder::encode(tx_frame(), tx_room(), tx_frame(), msgsize);
+                    err     = ERROR_SLIP_ENCODING_ERROR;
+                }
+                if (msgsize > 0)
+                    return ERROR_OK;
+                if (txused_ == 0 || flush_tx() != ERROR_OK)
+                    return err;
+            }
+        }
+
+        /**
+         * Send the msgsize byte frame packed at tx_frame(). With queue set,
+         * and duplex() buffers, it waits in txbuf_ and leaves with the next
+         * unqueued frame or flush_tx(), in one write.
+         */
+        int send_frame(size_t msgsize, bool queue = false) {
+            txused_ += msgsize;
+            if (queue && duplex())
+                return ERROR_OK;
+            return flush_tx();
+        }
+
+        /** Write every queued frame */
+        int flush_tx() {
+            size_t size = txused_;
+            if (size == 0)
+                return ERROR_OK;
+            txused_ = 0;
+            return ostream_.write(txbuf_.data(), size) < size ? ERROR_JSON_SEND_ERROR : ERROR_OK;
+        }
+
+        /**
+         * Compress a serialized message in the tx frame behind a JSONRPC_COMPRESSED_FLAG
+         * byte if it is large enough and gets smaller.
+         * @return size of the message to send
+         */
+        size_t compress_message(JsonDocument& msgdoc, size_t msgsize) {
+    #if JSONRPC_USE_COMPRESSION
+            if (msgsize < JSONRPC_COMPRESS_MIN_SIZE)
+                return msgsize;
+            uint8_t* data = tx_frame();
+            size_t zsize  = lzss_encoder::encode(data + 1, tx_room() - 1, data, msgsize);
+            if (zsize > 0 && zsize + 1 < msgsize) {
+                data[0] = JSONRPC_COMPRESSED_FLAG;
+                return zsize + 1;
+            }
+            // a failed compression clobbers the message, so serialize it again
+            return serializeMessage(msgdoc, data, tx_room());
+    #else
+            (void)msgdoc;
+            return msgsize;
+    #endif
+        }
+
+        /** Decompress a received message in rxbuf_ if it starts with JSONRPC_COMPRESSED_FLAG */
+        int decompress_message(size_t& msgsize) {
+    #if JSONRPC_USE_COMPRESSION
+            uint8_t* data = rxbuf_.data();
+            if (msgsize == 0 || data[0] != JSONRPC_COMPRESSED_FLAG)
+                return ERROR_OK;
+            msgsize = lzss_decoder::decode(data, rxbuf_.max_size(), data + 1, msgsize - 1);
+            if (msgsize == 0)
+                return ERROR_LZSS_DECODING_ERROR;
+    #else
+            (void)msgsize;
+    #endif
+            return ERROR_OK;
         }
 
         static sys::PrintT* no_logger() {
@@ -376,7 +609,9 @@ namespace rdl {
         sys::StreamT& istream_;
         sys::StreamT& ostream_;
         sys::PrintT* logger_;
-        arraybuf<uint8_t> buffer_; // should be set in derived constructor
+        arraybuf<uint8_t> rxbuf_; // should be set in derived constructor
+        arraybuf<uint8_t> txbuf_; // may share rxbuf_'s memory, see buffer()
+        size_t txused_;           ///< bytes of frames queued in txbuf_
         unsigned long timeout_ms_;
         unsigned long retry_delay_ms_;
     };
@@ -8,6 +8,7 @@
     #include "JsonProtocol.h"
     #include "Logger.h"
     #include "SlipInPlace.h"
+    #include "TimerQueue.h"
     #include "std_utility.h"
     #include "sys_PrintT.h"
     #include "sys_StreamT.h"
@@ -16,27 +17,174 @@
     #include <ArduinoJson.h>
     #include <assert.h>
 
+    /**
+     * Longest check_messages() keeps replies queued while more input
+     * waits. The input may be a partial frame or an endless flood, so
+     * replies then leave without waiting for it.
+     */
+    #ifndef JSONRPC_COALESCE_HOLD_US
+        #define JSONRPC_COALESCE_HOLD_US 1000
+    #endif
+
 namespace rdl {
 
     /************************************************************************
      * SERVER
      ***********************************************************************/
-    template <class MapT, class KeysT>
-    class json_server : public protocol_base<KeysT> {
+    template <class MapT, class KeysT, class FramingT = slip_null_framing>
+    class json_server : public protocol_base<KeysT, FramingT> {
      public:
-        using BaseT = protocol_base<KeysT>;
+        using BaseT = protocol_base<KeysT, FramingT>;
         using BaseT::logger;
 
+        /**
+         * Handle one waiting message. Also fires scheduled property sets
+         * that are due (timer_queue::instance()).
+         *
+         * While more messages wait, replies queue in the transmit buffer
+         * so pipelined requests share one write. They are written once the
+         * input is empty, the buffer fills or the first of them has waited
+         * the hold time (see coalesce()).
+         */
         int check_messages() {
-            assert(buffer_.valid());
+            assert(rxbuf_.valid() && txbuf_.valid());
+            if (txused_ == 0)
+                held_since_ = sys::micros();
+            holding_ = coalesce_;
+            timer_queue::instance().poll();
             size_t available = istream_.available();
             if (available == 0) {
                 // std::cout << ".";
-                return ERROR_OK;
+                holding_ = false;
+                return flush();
+            }
+            int senderr = ERROR_OK;
+            if (hold_expired()) {
+                // do not keep replies waiting while the next message is read
+                senderr     = flush();
+                held_since_ = sys::micros();
+            }
+            int err  = handle_message();
+            holding_ = false;
+            if ((istream_.available() == 0 || hold_expired()) && senderr == ERROR_OK)
+                senderr = flush();
+            return err != ERROR_OK ? err : senderr;
+        }
+
+        /**
+         * Handle waiting messages until the input is empty or budget_us has
+         * passed, at least one if any is waiting. Replies are collected in
+         * the transmit buffer and leave in as few writes as it allows, so a
+         * flood of notifications cannot starve the calls queued behind it.
+         * Also fires scheduled property sets that are due.
+         * @param handled   set to the number of messages handled
+         * @return ERROR_OK or the last error; errors lose only their message
+         */
+        int process_messages(uint32_t budget_us, size_t& handled) {
+            assert(rxbuf_.valid() && txbuf_.valid());
+            uint32_t start = sys::micros();
+            timer_queue::instance().poll();
+            handled  = 0;
+            int err  = ERROR_OK;
+            holding_ = true;
+            while (istream_.available() > 0) {
+                int msgerr = handle_message();
+                if (msgerr != ERROR_OK)
+                    err = msgerr;
+                handled++;
+                if (sys::micros() - start >= budget_us)
+                    break;
             }
+            holding_    = false;
+            int senderr = flush();
+            return senderr != ERROR_OK ? senderr : err;
+        }
+
+        int process_messages(uint32_t budget_us) {
+            size_t handled;
+            return process_messages(budget_us, handled);
+        }
+
+        /** Write the queued replies now, e.g. at the end of loop() */
+        int flush() { return BaseT::flush_tx(); }
+
+        /**
+         * Let check_messages() queue replies while more input waits (the
+         * default), for at most hold_us after the first. Off, it writes
+         * every reply at once. process_messages() always queues. Servers
+         * sharing one buffer for both directions never queue.
+         */
+        void coalesce(bool enable, uint32_t hold_us = JSONRPC_COALESCE_HOLD_US) {
+            coalesce_ = enable;
+            hold_us_  = hold_us;
+        }
+
+        /**
+         * Send a notification (no id, no reply) to the client, such as an
+         * "=brief" property change push. May be called from a dispatched
+         * method: the request is fully parsed by then and its reply is
+         * serialized afterwards, so the push simply goes out first.
+         *
+         * Not thread-safe: notifications share the transmit buffer and
+         * queue with replies, so call it (and any property set() that
+         * pushes) only from the thread running check_messages() or
+         * process_messages().
+         */
+        template <typename... PARAMS>
+        int notify(const char* method, PARAMS... args) {
+            assert(rxbuf_.valid() && txbuf_.valid());
+            size_t msgsize;
+            StaticJsonDocument<svc::JDOC_SIZE> msg;
+            int err = BaseT::serialize_call(msg, msgsize, method, -1, args...);
+            if (err != ERROR_OK)
+                return err;
+            DCS_BLK(logger_->print(SERVER_COL "SERVER push >> "); print_escaped(*logger_, tx_frame(), msgsize, "'"); logger_->println());
+            if ((err = send_frame(msgsize, holding_)) != ERROR_OK)
+                return err;
+            return ERROR_OK;
+        }
+
+        /**
+         * Let a property push its changes. Clients subscribe with
+         * "@brief" (see add_to) and then receive "=brief" notifications
+         * whenever the property's value changes.
+         */
+        template <class RootT>
+        void publish(RootT& prop) {
+            prop.publish_to(this);
+        }
+
+        /**
+         * Add every property value to values, keyed by brief. Properties
+         * take part through the "$brief" entries add_to() puts in the
+         * dispatch map; channel properties add an array of channel values.
+         * @return ERROR_JSON_SNAPSHOT_FULL if the document holding values
+         *         is too small (see svc::snapshot_doc_size())
+         */
+        int snapshot(JsonObject values) {
+            StaticJsonDocument<JSON_ARRAY_SIZE(0)> argdoc;
+            JsonArray args     = argdoc.to<JsonArray>();
+            JsonVariant target = values;
+            for (auto& entry : dispatch_map_) {
+                const sys::StringT& key = entry.first;
+                if (key.length() < 2 || key[0] != '$')
+                    continue;
+                int err = entry.second.call(args, target);
+                if (err != ERROR_OK)
+                    return err;
+            }
+            return ERROR_OK;
+        }
+
+     protected:
+        /** Replies are queued and the oldest has waited hold_us_ */
+        bool hold_expired() const { return txused_ > 0 && sys::micros() - held_since_ >= hold_us_; }
+
+        /** Read and answer one message. Input must be waiting. */
+        int handle_message() {
             // read message
-            size_t msgsize = istream_.readBytesUntil(slip_std_codes::SLIP_END, buffer_.data(), buffer_.max_size());
-            DCS_BLK(logger_->print(SERVER_COL "SERVER << "); print_escaped(*logger_, buffer_.data(), msgsize, "'"); logger_->println());
+            size_t msgsize = istream_.readBytesUntil(BaseT::frame_end(), rxbuf_.data(), rxbuf_.max_size());
+            DCS_BLK(logger_->print(SERVER_COL "SERVER << "); print_escaped(*logger_, rxbuf_.data(), msgsize, "'"); logger_->println());
             if (msgsize == 0)
                 return ERROR_JSON_TIMEOUT;
             StaticJsonDocument<svc::JDOC_SIZE> msg;
@@ -49,6 +197,10 @@ namespace rdl {
             for (;;) { // "try" clause. Always use break to exit
                 err = BaseT::deserialize_call(msg, msgsize, method, id, args);
                 if (err != ERROR_OK) break;
+                if (method == svc::SNAPSHOT_METHOD)
+                    return (id >= 0) ? reply_snapshot(id) : ERROR_OK;
+                if (method == svc::CLOCK_METHOD)
+                    return (id >= 0) ? reply_clock(id, sys::micros()) : ERROR_OK;
                 mapit = dispatch_map_.find(method);
                 err   = (mapit == dispatch_map_.end()) ? ERROR_JSON_METHOD_NOT_FOUND : ERROR_OK;
                 if (err == ERROR_JSON_METHOD_NOT_FOUND) {
@@ -80,60 +232,115 @@ namespace rdl {
                 }
                 if (err != ERROR_OK)
                     return err;
-                size_t writesize = ostream_.write(buffer_.data(), msgsize);
-                if (writesize < msgsize)
-                    return ERROR_JSON_SEND_ERROR;
-                DCS_BLK(logger_->print(SERVER_COL "SERVER >> "); print_escaped(*logger_, buffer_.data(), msgsize, "'"); logger_->println());
+                DCS_BLK(logger_->print(SERVER_COL "SERVER >> "); print_escaped(*logger_, tx_frame(), msgsize, "'"); logger_->println());
+                if ((err = send_frame(msgsize, holding_)) != ERROR_OK)
+                    return err;
             }
             return ERROR_OK;
         }
 
-     protected:
+
+        /** Reply to "$" with every property value in one message */
+        int reply_snapshot(int id) {
+            size_t msgsize;
+            StaticJsonDocument<svc::SNAPSHOT_DOC_SIZE> reply;
+            reply[BaseT::key_id()] = id; // first, so the values cannot crowd it out
+            JsonObject values      = reply.createNestedObject(BaseT::key_result());
+            int err           = snapshot(values);
+            if (err != ERROR_OK)
+                reply.clear(); // frees the partial values for the error reply
+            sys::yield();
+            err = BaseT::serialize_reply(reply, msgsize, id, err);
+            if (err != ERROR_OK)
+                return err;
+            DCS_BLK(logger_->print(SERVER_COL "SERVER snapshot >> "); print_escaped(*logger_, tx_frame(), msgsize, "'"); logger_->println());
+            if ((err = send_frame(msgsize, holding_)) != ERROR_OK)
+                return err;
+            return ERROR_OK;
+        }
+
+        /** Reply to ":" with the server clock, read as soon as the call was parsed */
+        int reply_clock(int id, uint32_t now_us) {
+            size_t msgsize;
+            StaticJsonDocument<svc::JDOC_SIZE> reply;
+            StaticJsonDocument<svc::JRESULT_SIZE> resultdoc;
+            JsonVariant result = resultdoc.to<JsonVariant>();
+            result.set(now_us);
+            int err = BaseT::serialize_reply(reply, msgsize, id, result, ERROR_OK);
+            if (err != ERROR_OK)
+                return err;
+            DCS_BLK(logger_->print(SERVER_COL "SERVER clock >> "); print_escaped(*logger_, tx_frame(), msgsize, "'"); logger_->println());
+            if ((err = send_frame(msgsize, holding_)) != ERROR_OK)
+                return err;
+            return ERROR_OK;
+        }
+
         json_server(sys::StreamT& istream, sys::StreamT& ostream, MapT& map,
                     unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                     unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : BaseT(istream, ostream, timeout_ms, retry_delay_ms), dispatch_map_(map) {
+            : BaseT(istream, ostream, timeout_ms, retry_delay_ms), dispatch_map_(map), holding_(false), coalesce_(true),
+              hold_us_(JSONRPC_COALESCE_HOLD_US), held_since_(0) {
         }
 
         using BaseT::istream_;
         using BaseT::ostream_;
-        using BaseT::buffer_;
+        using BaseT::rxbuf_;
+        using BaseT::txbuf_;
+        using BaseT::txused_;
+        using BaseT::tx_frame;
+        using BaseT::send_frame;
         using BaseT::timeout_ms_;
         using BaseT::retry_delay_ms_;
         using BaseT::logger_;
         MapT& dispatch_map_;
+        bool holding_; ///< replies queue in txbuf_
+        bool coalesce_;
+        uint32_t hold_us_;
+        uint32_t held_since_; ///< when the oldest queued reply was queued
     };
 
     /************************************************************************
      * json_server with static (non-heap) buffer storage
+     *
+     * Requests are read into BUFFER_SIZE bytes. By default replies are
+     * written from the same buffer, each on its own. A TX_SIZE gives them
+     * a buffer of their own, where replies to pipelined requests collect
+     * (see check_messages()), at the cost of that much more RAM.
      ***********************************************************************/
-    template <class MapT, class KeysT, size_t BUFFER_SIZE>
-    class static_json_server : public json_server<MapT, KeysT> {
+    template <class MapT, class KeysT, size_t BUFFER_SIZE, class FramingT = slip_null_framing, size_t TX_SIZE = 0>
+    class static_json_server : public json_server<MapT, KeysT, FramingT> {
      public:
+        using ServerT = json_server<MapT, KeysT, FramingT>;
+
         static_json_server(sys::StreamT& istream, sys::StreamT& ostream, MapT& map,
                            unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                            unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : json_server<MapT, KeysT>(istream, ostream, map, timeout_ms, retry_delay_ms) {
+            : ServerT(istream, ostream, map, timeout_ms, retry_delay_ms) {
             // MUST wait to initialize buffer until after static_buffer creation
-            protocol_base<KeysT>::buffer_ = std::move(static_buffer_);
+            if (TX_SIZE > 0)
+                ServerT::buffers(std::move(static_buffer_), std::move(static_txbuf_));
+            else
+                ServerT::buffer(std::move(static_buffer_));
         }
 
      protected:
         static_arraybuf<uint8_t, BUFFER_SIZE> static_buffer_;
+        static_arraybuf<uint8_t, TX_SIZE ? TX_SIZE : 1> static_txbuf_;
     };
 
     /************************************************************************
-     * json_server with dynamic (heap) buffer storage
+     * json_server with dynamic (heap) buffer storage. Requests and replies
+     * each get buffer_size bytes.
      ***********************************************************************/
-    template <class MapT, class KeysT>
-    class dynamic_json_server : public json_server<MapT, KeysT> {
+    template <class MapT, class KeysT, class FramingT = slip_null_framing>
+    class dynamic_json_server : public json_server<MapT, KeysT, FramingT> {
      public:
         dynamic_json_server(sys::StreamT& istream, sys::StreamT& ostream, MapT& map, size_t buffer_size,
                             unsigned long timeout_ms     = JSONRPC_DEFAULT_TIMEOUT,
                             unsigned long retry_delay_ms = JSONRPC_DEFAULT_RETRY_DELAY)
-            : json_server<MapT, KeysT>(istream, ostream, map, timeout_ms, retry_delay_ms) {
+            : json_server<MapT, KeysT, FramingT>(istream, ostream, map, timeout_ms, retry_delay_ms) {
             // MUST wait to initialize buffer until after static_buffer creation
-            protocol_base<KeysT>::buffer_ = std::move(dynamic_arraybuf<uint8_t>(buffer_size));
+            json_server<MapT, KeysT, FramingT>::buffers(dynamic_arraybuf<uint8_t>(buffer_size), dynamic_arraybuf<uint8_t>(buffer_size));
         }
     };
 } // namespace
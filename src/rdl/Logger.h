@@ -20,12 +20,12 @@ namespace rdl {
         virtual void flush() override {}
     };
 
-    size_t print(sys::PrintT& printer, JsonDocument& doc) {
+    inline size_t print(sys::PrintT& printer, JsonDocument& doc) {
         sys::StringT strdoc;
         ArduinoJson::serializeJson(doc, strdoc);
         return printer.print("JSON:") + printer.print(strdoc);
     }
-    size_t println(sys::PrintT& printer, JsonDocument& doc) {
+    inline size_t println(sys::PrintT& printer, JsonDocument& doc) {
         return print(printer, doc) + printer.println();
     }
 
@@ -0,0 +1,283 @@
+/*!
+ *  @file LzssInPlace.h
+ *
+ *  Library for in-place LZSS compression of message frames.
+ *
+ *  A byte-oriented LZ77 variant in the spirit of heatshrink: repeated
+ *  strings become two-byte back-references into the message itself, so
+ *  the only extra RAM is a small hash table on the stack while encoding
+ *  (2 << LZSS_HASH_BITS bytes) and nothing while decoding. Good for the
+ *  repeated keys and digits of large replies and sequence uploads; small
+ *  or random messages do not compress and are reported as such.
+ *
+ *  Compressed format, a series of tokens:
+ *
+ *  | token             | meaning                                           |
+ *  |:------------------|:--------------------------------------------------|
+ *  | `0nnnnnnn`        | n+1 literal bytes follow (1..128)                 |
+ *  | `1llllddd dddddddd` | copy l+3 bytes (3..18) from d+1 bytes back (1..2048) |
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __LZSSINPLACE_H__
+    #define __LZSSINPLACE_H__
+
+    #include "Common.h"
+    #include "std_type_traits.h" // for enable_if
+    #include <stdint.h>          // for uint8_t, uint16_t
+    #include <string.h>          // for memmove
+
+/**
+ * @brief log2 of the encoder's match table entries.
+ *
+ * Each entry is a uint16_t on the stack while encoding. Smaller tables
+ * find fewer matches.
+ */
+    #ifndef LZSS_HASH_BITS
+        #define LZSS_HASH_BITS 7
+    #endif
+
+namespace rdl {
+
+    namespace svc {
+
+        /**************************************************************************************
+         * Base for both encoders and decoders
+         **************************************************************************************/
+
+        template <typename _CharT>
+        struct lzss_base {
+            using char_type = _CharT;
+
+            static constexpr size_t min_match    = 3;    ///< shorter repeats stay literal
+            static constexpr size_t max_match    = 18;   ///< longest copy in one token
+            static constexpr size_t max_distance = 2048; ///< how far back a copy can reach
+            static constexpr size_t max_literals = 128;  ///< longest literal run in one token
+
+         protected:
+            static constexpr uint8_t match_flag = 0x80;
+
+            /** buffers overlap, so work in place */
+            static bool overlaps(const _CharT* dest, size_t destsize, const _CharT* src, size_t srcsize) {
+                return src < dest + destsize && dest < src + srcsize;
+            }
+        };
+
+        /**************************************************************************************
+         * Encoder
+         **************************************************************************************/
+
+        /**
+         * @brief LZSS encoder.
+         *
+         * Automatically handles out-of-place encoding via copy or in-place encoding,
+         * including a source that starts just before the destination.
+         *
+         * @tparam _CharT       unsigned char or char
+         */
+        template <typename _CharT>
+        struct lzss_encoder_base : public lzss_base<_CharT> {
+            using BASE = lzss_base<_CharT>;
+            using BASE::min_match;
+            using BASE::max_match;
+            using BASE::max_distance;
+            using BASE::max_literals;
+
+            /**
+             * @brief Compress a buffer.
+             *
+             * For in-place encoding, the source is first copied to the end of the
+             * destination buffer. Compression gives up as soon as the output would
+             * catch up with the unread input, so the free space past srcsize limits
+             * how much of an incompressible message can be written.
+             *
+             * > :warning: Encode in-place clobbers the source, even when it fails!
+             *
+             * @param dest      destination buffer
+             * @param destsize  dest buffer size - at least srcsize
+             * @param src       source buffer
+             * @param srcsize   size of source to encode (at most 65535)
+             * @return size_t   compressed size, or 0 if the result would not be
+             *                  smaller than srcsize or there was an error while encoding
+             */
+            static inline size_t encode(_CharT* dest, size_t destsize, const _CharT* src, size_t srcsize) noexcept {
+                static constexpr size_t BAD_ENCODE = 0;
+                static constexpr uint16_t EMPTY    = 0xFFFF;
+                if (!dest || !src || srcsize <= min_match || srcsize >= EMPTY || destsize < srcsize)
+                    return BAD_ENCODE;
+                bool inplace = BASE::overlaps(dest, destsize, src, srcsize);
+                if (inplace)
+                    src = (const _CharT*)memmove(dest + destsize - srcsize, src, srcsize);
+
+                uint16_t table[1 << LZSS_HASH_BITS];
+                for (size_t i = 0; i < (1 << LZSS_HASH_BITS); i++)
+                    table[i] = EMPTY;
+
+                _CharT* out  = dest;
+                _CharT* oend = dest + srcsize - 1; // must beat the input
+                size_t lit   = 0;                  // first pending literal
+                size_t pos   = 0;
+                while (pos + min_match <= srcsize) {
+                    size_t h    = hash(src + pos);
+                    size_t cand = table[h];
+                    size_t len  = 0;
+                    table[h]    = static_cast<uint16_t>(pos);
+                    // in place, earlier input is gone once the output passes it
+                    if (cand != EMPTY && pos - cand <= max_distance && (!inplace || src + cand >= out)) {
+                        size_t maxlen = srcsize - pos < max_match ? srcsize - pos : max_match;
+                        while (len < maxlen && src[cand + len] == src[pos + len])
+                            len++;
+                    }
+                    if (len < min_match) {
+                        pos++;
+                        continue;
+                    }
+                    if (!put_literals(out, oend, src + lit, pos - lit, inplace))
+                        return BAD_ENCODE;
+                    size_t dist = pos - cand - 1;
+                    pos += len;
+                    lit = pos;
+                    if (out + 2 > oend || (inplace && out + 2 > src + pos))
+                        return BAD_ENCODE;
+                    *(out++) = (_CharT)(BASE::match_flag | ((len - min_match) << 3) | (dist >> 8));
+                    *(out++) = (_CharT)(dist & 0xFF);
+                }
+                if (!put_literals(out, oend, src + lit, srcsize - lit, inplace))
+                    return BAD_ENCODE;
+                return out - dest;
+            }
+
+            /**
+             * @copydoc encode
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t encode(_FromT* dest, size_t destsize, const _FromT* src, size_t srcsize) noexcept {
+                return encode(reinterpret_cast<_CharT*>(dest), destsize, reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+
+         protected:
+            static __ALWAYS_INLINE__ size_t hash(const _CharT* p) {
+                uint32_t v = ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint8_t)p[2];
+                return (v * 2654435761u) >> (32 - LZSS_HASH_BITS);
+            }
+
+            /** Write literal runs, staying behind the unread input when in place */
+            static inline bool put_literals(_CharT*& out, _CharT* oend, const _CharT* lits, size_t n, bool inplace) {
+                while (n > 0) {
+                    size_t run = n < max_literals ? n : max_literals;
+                    if (out + 1 + run > oend || (inplace && out + 1 > lits))
+                        return false;
+                    *(out++) = (_CharT)(run - 1);
+                    memmove(out, lits, run);
+                    out += run;
+                    lits += run;
+                    n -= run;
+                }
+                return true;
+            }
+        };
+
+        /**************************************************************************************
+         * Decoder
+         **************************************************************************************/
+
+        /**
+         * @brief LZSS decoder.
+         *
+         * Automatically handles out-of-place and in-place decoding, including a
+         * source that starts just after the destination.
+         *
+         * @tparam _CharT       unsigned char or char
+         */
+        template <typename _CharT>
+        struct lzss_decoder_base : public lzss_base<_CharT> {
+            using BASE = lzss_base<_CharT>;
+            using BASE::min_match;
+
+            /**
+             * @brief Decompress a buffer.
+             *
+             * For in-place decoding, the source is first copied to the end of the
+             * destination buffer and decoded output must never catch up with the
+             * unread input.
+             *
+             * > :warning: The end of destiation buffer past the returned size is not cleared.
+             *
+             * @param dest      destination buffer
+             * @param destsize  dest buffer size - must hold the decompressed message
+             * @param src       source buffer
+             * @param srcsize   size of source to decode
+             * @return size_t   decompressed size or 0 if there was an error while decoding
+             */
+            static inline size_t decode(_CharT* dest, size_t destsize, const _CharT* src, size_t srcsize) noexcept {
+                static constexpr size_t BAD_DECODE = 0;
+                if (!dest || !src || srcsize < 1 || destsize < srcsize)
+                    return BAD_DECODE;
+                bool inplace = BASE::overlaps(dest, destsize, src, srcsize);
+                if (inplace)
+                    src = (const _CharT*)memmove(dest + destsize - srcsize, src, srcsize);
+                const _CharT* send = src + srcsize;
+                _CharT* out        = dest;
+                _CharT* dend       = dest + destsize;
+
+                while (src < send) {
+                    uint8_t token = (uint8_t)*(src++);
+                    if (!(token & BASE::match_flag)) {
+                        size_t run = token + 1;
+                        if (run > (size_t)(send - src) || run > (size_t)(dend - out))
+                            return BAD_DECODE;
+                        memmove(out, src, run);
+                        out += run;
+                        src += run;
+                        continue;
+                    }
+                    if (src >= send)
+                        return BAD_DECODE;
+                    size_t len  = ((token >> 3) & 0x0F) + min_match;
+                    size_t dist = (((size_t)(token & 0x07) << 8) | (uint8_t)*(src++)) + 1;
+                    if (dist > (size_t)(out - dest) || len > (size_t)(dend - out))
+                        return BAD_DECODE;
+                    if (inplace && out + len > src)
+                        return BAD_DECODE; // buffer too small to decode in place
+                    // byte by byte, copies may overlap their own output
+                    const _CharT* from = out - dist;
+                    for (; len > 0; len--)
+                        *(out++) = *(from++);
+                }
+                return out - dest;
+            }
+
+            /**
+             * @copydoc decode
+             * @tparam _FromT must have same element size as _CharT
+             */
+            template <typename _FromT,
+                      typename std::enable_if<sizeof(_FromT) == sizeof(_CharT), bool>::type = true>
+            static inline size_t decode(_FromT* dest, size_t destsize, const _FromT* src, size_t srcsize) noexcept {
+                return decode(reinterpret_cast<_CharT*>(dest), destsize, reinterpret_cast<const _CharT*>(src), srcsize);
+            }
+        };
+
+    }; // namespace svc
+
+    /** LZSS encoder template */
+    template <typename _CharT>
+    using lzss_encoder_base = svc::lzss_encoder_base<_CharT>;
+    /** LZSS decoder template */
+    template <typename _CharT>
+    using lzss_decoder_base = svc::lzss_decoder_base<_CharT>;
+
+    /** byte-oriented LZSS encoder */
+    using lzss_encoder = lzss_encoder_base<uint8_t>;
+    /** byte-oriented LZSS decoder */
+    using lzss_decoder = lzss_decoder_base<uint8_t>;
+}
+
+#endif // __LZSSINPLACE_H__
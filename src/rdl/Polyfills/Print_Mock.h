@@ -24,6 +24,7 @@
 #include "../std_type_traits.h"
 #include "Print_MockHelp.h"
 #include "Printable_Mock.h"
+#include <string.h> // for strlen
 
 #define DEC 10
 #define HEX 16
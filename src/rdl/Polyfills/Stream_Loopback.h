@@ -0,0 +1,275 @@
+#pragma once
+
+#ifndef __STREAM_LOOPBACK_H__
+    #define __STREAM_LOOPBACK_H__
+
+    #include "../sys_timing.h"
+    #include "Stream_Mock.h"
+    #include <algorithm> // for std::min
+    #include <atomic>
+    #include <cstring> // for memcpy, memchr
+    #include <limits>
+    #include <memory>
+
+    /** Time a Stream_Loopback reader spins (yielding) before falling back to sleep-polling. */
+    #ifndef LOOPBACK_SPIN_USEC
+        #define LOOPBACK_SPIN_USEC 100
+    #endif
+
+    #ifndef LOOPBACK_DEFAULT_CAPACITY
+        #define LOOPBACK_DEFAULT_CAPACITY 4096
+    #endif
+
+namespace sys {
+
+    namespace svc {
+
+        /************************************************************************
+         * Lock-free single-producer/single-consumer byte ring buffer.
+         *
+         * Exactly one thread may call the producer methods (write, writable)
+         * and exactly one thread may call the consumer methods (read, peek,
+         * read_until, readable). Head and tail are free-running counters, so
+         * the capacity is rounded up to a power of two.
+         ************************************************************************/
+        class spsc_ring {
+         public:
+            explicit spsc_ring(size_t capacity)
+                : mask_(round_pow2(capacity) - 1), data_(new uint8_t[mask_ + 1]), head_(0), tail_(0) {}
+
+            spsc_ring(const spsc_ring&) = delete;
+            spsc_ring& operator=(const spsc_ring&) = delete;
+
+            size_t capacity() const { return mask_ + 1; }
+
+            ////// PRODUCER //////
+
+            /** Free space for writing. */
+            size_t writable() const {
+                return capacity() - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+            }
+
+            /** Copy up to n bytes in. Returns number of bytes written (never blocks). */
+            size_t write(const uint8_t* src, size_t n) {
+                size_t head = head_.load(std::memory_order_relaxed);
+                size_t room = capacity() - (head - tail_.load(std::memory_order_acquire));
+                if (n > room) n = room;
+                size_t pos   = head & mask_;
+                size_t first = std::min(n, capacity() - pos);
+                memcpy(data_.get() + pos, src, first);
+                memcpy(data_.get(), src + first, n - first);
+                head_.store(head + n, std::memory_order_release);
+                return n;
+            }
+
+            ////// CONSUMER //////
+
+            /** Bytes waiting to be read. */
+            size_t readable() const {
+                return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+            }
+
+            /** Next byte without consuming it, or -1 if empty. */
+            int peek() const {
+                size_t tail = tail_.load(std::memory_order_relaxed);
+                if (head_.load(std::memory_order_acquire) == tail) return -1;
+                return data_[tail & mask_];
+            }
+
+            /** Copy up to n bytes out. Returns number of bytes read (never blocks). */
+            size_t read(uint8_t* dest, size_t n) {
+                size_t tail  = tail_.load(std::memory_order_relaxed);
+                size_t avail = head_.load(std::memory_order_acquire) - tail;
+                if (n > avail) n = avail;
+                size_t pos   = tail & mask_;
+                size_t first = std::min(n, capacity() - pos);
+                memcpy(dest, data_.get() + pos, first);
+                memcpy(dest + first, data_.get(), n - first);
+                tail_.store(tail + n, std::memory_order_release);
+                return n;
+            }
+
+            /**
+             * Copy bytes out until the terminator, n bytes, or the ring is empty.
+             * Scans each contiguous segment with memchr. A found terminator is
+             * consumed but not copied. As with sys::Stream::readBytesUntil, a
+             * terminator directly after n bytes is left unread.
+             *
+             * @param found     set true if the terminator was consumed
+             * @return size_t   number of bytes copied to dest
+             */
+            size_t read_until(uint8_t terminator, uint8_t* dest, size_t n, bool& found) {
+                size_t tail  = tail_.load(std::memory_order_relaxed);
+                size_t avail = head_.load(std::memory_order_acquire) - tail;
+                size_t count = 0;
+                found        = false;
+                while (count < n && avail > 0) {
+                    size_t pos           = tail & mask_;
+                    size_t seg           = std::min(std::min(avail, n - count), capacity() - pos);
+                    const uint8_t* start = data_.get() + pos;
+                    const uint8_t* term  = static_cast<const uint8_t*>(memchr(start, terminator, seg));
+                    size_t ncopy         = term ? static_cast<size_t>(term - start) : seg;
+                    memcpy(dest + count, start, ncopy);
+                    count += ncopy;
+                    tail += ncopy;
+                    avail -= ncopy;
+                    if (term) {
+                        tail++; // consume terminator
+                        found = true;
+                        break;
+                    }
+                }
+                tail_.store(tail, std::memory_order_release);
+                return count;
+            }
+
+         protected:
+            static size_t round_pow2(size_t n) {
+                size_t p = 1;
+                while (p < n) p <<= 1;
+                return p;
+            }
+
+            const size_t mask_;
+            std::unique_ptr<uint8_t[]> data_;
+            alignas(64) std::atomic<size_t> head_; // written by producer
+            alignas(64) std::atomic<size_t> tail_; // written by consumer
+        };
+    } // namespace svc
+
+    /************************************************************************
+     * One end of an in-memory full-duplex link.
+     *
+     * Reads come from one spsc_ring and writes go to another. Each
+     * direction is lock-free, so an endpoint may be read by one thread and
+     * written by another, but not read (or written) by two threads at once.
+     * Create endpoints in connected pairs with Stream_LoopbackPair.
+     *
+     * Like Stream_PosixFd, writes wait for room up to the stream timeout
+     * and return short only when it runs out, so a full ring never splits
+     * a frame.
+     ************************************************************************/
+    class Stream_Loopback : public sys::Stream {
+     public:
+        Stream_Loopback(svc::spsc_ring& rx, svc::spsc_ring& tx) : _rx(rx), _tx(tx) {}
+
+        virtual size_t write(const uint8_t byte) override { return write(&byte, 1); }
+
+        /** Write all n bytes, waiting up to the stream timeout for room */
+        virtual size_t write(const uint8_t* str, size_t n) override {
+            size_t count      = _tx.write(str, n);
+            unsigned long now = 0, start = sys::millis();
+            while (count < n && (now = sys::millis() - start) < _timeout) {
+                waitWritable(_timeout - now);
+                count += _tx.write(str + count, n - count);
+            }
+            return count;
+        }
+
+        /** write() waits for room, so callers need not limit themselves */
+        virtual int availableForWrite() override { return std::numeric_limits<int>::max(); }
+
+        virtual int available() override { return static_cast<int>(_rx.readable()); }
+        virtual int peek() override { return _rx.peek(); }
+        virtual int read() override {
+            uint8_t c;
+            return _rx.read(&c, 1) ? c : -1;
+        }
+
+        /** Spin briefly, then fall back to sleep-polling until data or timeout. */
+        virtual bool waitAvailable(unsigned long timeout_ms) override {
+            uint64_t start = sys::nanos();
+            uint64_t limit = static_cast<uint64_t>(timeout_ms) * 1000000ULL;
+            uint64_t spin  = static_cast<uint64_t>(LOOPBACK_SPIN_USEC) * 1000ULL;
+            uint64_t elapsed;
+            while (_rx.readable() == 0) {
+                elapsed = sys::nanos() - start;
+                if (elapsed >= limit) return false;
+                if (elapsed < spin)
+                    sys::yield();
+                else
+                    sys::delayMicroseconds(STREAM_POLL_INTERVAL_USEC);
+            }
+            return true;
+        }
+
+        /** As waitAvailable(), until the reader makes room in the ring. */
+        bool waitWritable(unsigned long timeout_ms) {
+            uint64_t start = sys::nanos();
+            uint64_t limit = static_cast<uint64_t>(timeout_ms) * 1000000ULL;
+            uint64_t spin  = static_cast<uint64_t>(LOOPBACK_SPIN_USEC) * 1000ULL;
+            uint64_t elapsed;
+            while (_tx.writable() == 0) {
+                elapsed = sys::nanos() - start;
+                if (elapsed >= limit) return false;
+                if (elapsed < spin)
+                    sys::yield();
+                else
+                    sys::delayMicroseconds(STREAM_POLL_INTERVAL_USEC);
+            }
+            return true;
+        }
+
+        /** Bulk read. Waits up to the stream timeout for all length bytes. */
+        virtual size_t readBytes(char* buffer, size_t length) override {
+            uint8_t* dest     = reinterpret_cast<uint8_t*>(buffer);
+            size_t count      = _rx.read(dest, length);
+            unsigned long now = 0, start = sys::millis();
+            while (count < length && (now = sys::millis() - start) < _timeout) {
+                waitAvailable(_timeout - now);
+                count += _rx.read(dest + count, length - count);
+            }
+            return count;
+        }
+
+        /** Bulk read up to a terminator. Waits up to the stream timeout for the terminator. */
+        virtual size_t readBytesUntil(char terminator, char* buffer, size_t length) override {
+            uint8_t* dest     = reinterpret_cast<uint8_t*>(buffer);
+            uint8_t term      = static_cast<uint8_t>(terminator);
+            bool found        = false;
+            size_t count      = _rx.read_until(term, dest, length, found);
+            unsigned long now = 0, start = sys::millis();
+            while (!found && count < length && (now = sys::millis() - start) < _timeout) {
+                waitAvailable(_timeout - now);
+                count += _rx.read_until(term, dest + count, length - count, found);
+            }
+            return count;
+        }
+
+        using sys::Stream::readBytes;
+        using sys::Stream::readBytesUntil;
+
+     protected:
+        svc::spsc_ring& _rx;
+        svc::spsc_ring& _tx;
+    };
+
+    /************************************************************************
+     * Two connected Stream_Loopback endpoints.
+     *
+     * Bytes written to client() are read from server() and vice versa.
+     * @code{.cpp}
+     * sys::Stream_LoopbackPair link;
+     * auto client = static_json_client<jsonrpc_default_keys, 512>(link.client(), link.client());
+     * auto server = static_json_server<MapT, jsonrpc_default_keys, 512>(link.server(), link.server(), map);
+     * @endcode
+     ************************************************************************/
+    class Stream_LoopbackPair {
+     public:
+        explicit Stream_LoopbackPair(size_t capacity = LOOPBACK_DEFAULT_CAPACITY)
+            : _toserver(capacity), _toclient(capacity),
+              _client(_toclient, _toserver), _server(_toserver, _toclient) {}
+
+        Stream_Loopback& client() { return _client; }
+        Stream_Loopback& server() { return _server; }
+
+     protected:
+        svc::spsc_ring _toserver;
+        svc::spsc_ring _toclient;
+        Stream_Loopback _client;
+        Stream_Loopback _server;
+    };
+
+} // namespace sys
+
+#endif // __STREAM_LOOPBACK_H__
@@ -23,6 +23,12 @@
     #include "../sys_StringT.h"
     #include "../sys_timing.h"
     #include "Print_Mock.h"
+    #include <string.h> // for strlen
+
+    /** Polling interval of the default Stream::waitAvailable readiness fallback. */
+    #ifndef STREAM_POLL_INTERVAL_USEC
+        #define STREAM_POLL_INTERVAL_USEC 100
+    #endif
 
 namespace sys {
 
@@ -46,13 +52,15 @@ namespace sys {
                                     // private method to read stream with timeout
         virtual int timedRead() {
             int c;
+            unsigned long elapsed;
             _startMillis = sys::millis();
             do {
                 c = read();
                 if (c >= 0) return c;
-                sys::yield();
-                sys::delay(1);
-            } while (sys::millis() - _startMillis < _timeout);
+                elapsed = sys::millis() - _startMillis;
+                if (elapsed >= _timeout) break;
+                waitAvailable(_timeout - elapsed);
+            } while (true);
             return -1; // -1 indicates timeout
         }
 
@@ -61,13 +69,15 @@ namespace sys {
         // discards non-numeric characters
         virtual int timedPeek() {
             int c;
+            unsigned long elapsed;
             _startMillis = sys::millis();
             do {
                 c = peek();
                 if (c >= 0) return c;
-                sys::yield();
-                sys::delay(1);
-            } while (sys::millis() - _startMillis < _timeout);
+                elapsed = sys::millis() - _startMillis;
+                if (elapsed >= _timeout) break;
+                waitAvailable(_timeout - elapsed);
+            } while (true);
             return -1; // -1 indicates timeout
         }
 
@@ -106,6 +116,27 @@ namespace sys {
         virtual int read()      = 0;
         virtual int peek()      = 0;
 
+        /**
+         * Readiness hook used by the timed read methods.
+         *
+         * Block until data might be available to read or until timeout_ms
+         * elapses. Returns true if data is (probably) available. Spurious
+         * wakeups are allowed; callers always re-check with read() or peek().
+         *
+         * The default implementation is a polling fallback that yields and
+         * sleeps for STREAM_POLL_INTERVAL_USEC. Streams that can be notified
+         * when data arrives (e.g. with a condition variable) should override
+         * this so timed reads wake up as soon as data is written.
+         */
+        virtual bool waitAvailable(unsigned long timeout_ms) {
+            sys::yield();
+            unsigned long poll_usec = STREAM_POLL_INTERVAL_USEC;
+            if (timeout_ms * 1000UL < poll_usec)
+                poll_usec = timeout_ms * 1000UL;
+            sys::delayMicroseconds(poll_usec);
+            return available() > 0;
+        }
+
         // reads data from the stream until the target string of given length is found
         // returns true if target string is found, false if timed out
         virtual bool find(const char* target, size_t length) {
@@ -5,6 +5,10 @@
 
     #include "../sys_StringT.h"
     #include "Stream_Mock.h"
+    #include <algorithm> // for std::min
+    #include <chrono>
+    #include <condition_variable>
+    #include <cstring> // for memchr, memcpy
     #include <iomanip>
     #include <ios>
     #include <mutex>
@@ -32,6 +36,10 @@ namespace sys {
 
     /************************************************************************
      * Stream adapter for std::iostream
+     *
+     * Writers signal a condition variable so a reader blocked in
+     * timedRead/timedPeek (via waitAvailable) wakes as soon as data arrives
+     * instead of polling.
      * 
      * @tparam IOSTREAM     type of stream to adapt
      ************************************************************************/
@@ -48,13 +56,23 @@ namespace sys {
         }
 
         virtual size_t write(const uint8_t byte) override {
-            std::lock_guard<std::mutex> _(_guard);
-            char cc = static_cast<char>(byte);
-            return _canput && _ios.rdbuf()->sputc(cc) == cc ? 1 : 0;
+            size_t ret;
+            {
+                std::lock_guard<std::mutex> _(_guard);
+                char cc = static_cast<char>(byte);
+                ret     = _canput && _ios.rdbuf()->sputc(cc) == cc ? 1 : 0;
+            }
+            _readable.notify_all();
+            return ret;
         }
         virtual size_t write(const uint8_t* str, size_t n) override {
-            std::lock_guard<std::mutex> _(_guard);
-            return _canput ? _ios.rdbuf()->sputn(reinterpret_cast<const char*>(str), n) : 0;
+            size_t ret;
+            {
+                std::lock_guard<std::mutex> _(_guard);
+                ret = _canput ? _ios.rdbuf()->sputn(reinterpret_cast<const char*>(str), n) : 0;
+            }
+            _readable.notify_all();
+            return ret;
         }
         virtual int availableForWrite() override {
             std::lock_guard<std::mutex> _(_guard);
@@ -74,11 +92,13 @@ namespace sys {
          */
         virtual int available() override {
             std::lock_guard<std::mutex> _(_guard);
-            if (!_canget)
-                return 0;
-            // force update of input buffer pointers
-            _ios.rdbuf()->sgetc();
-            return static_cast<int>(_ios.rdbuf()->in_avail());
+            return available_impl();
+        }
+
+        /** Wait on the write notification rather than polling. */
+        virtual bool waitAvailable(unsigned long timeout_ms) override {
+            std::unique_lock<std::mutex> lock(_guard);
+            return wait_impl(lock, timeout_ms);
         }
 
         virtual int read() override {
@@ -100,9 +120,109 @@ namespace sys {
             return ret;
         }
 
+        /**
+         * Bulk version of Stream::readBytesUntil.
+         *
+         * Holds the lock once for the whole frame and scans the streambuf
+         * get area for the terminator with memchr instead of reading one
+         * character at a time. Same semantics as the base version: the
+         * terminator is consumed but not stored, and the call waits up to
+         * the stream timeout for the terminator to arrive.
+         */
+        virtual size_t readBytesUntil(char terminator, char* buffer, size_t length) override {
+            std::unique_lock<std::mutex> lock(_guard);
+            bool found          = false;
+            size_t count        = readBytesUntil_impl(terminator, buffer, length, found);
+            unsigned long start = sys::millis(), elapsed;
+            while (!found && count < length && (elapsed = sys::millis() - start) < _timeout) {
+                wait_impl(lock, _timeout - elapsed);
+                count += readBytesUntil_impl(terminator, buffer + count, length - count, found);
+            }
+            update_buf();
+            return count;
+        }
+
+        using sys::Stream::readBytes;
+        using sys::Stream::readBytesUntil;
+
      protected:
         virtual void update_buf() {}
 
+        /** Access to the protected get area pointers of a streambuf. */
+        struct accessor : std::streambuf {
+            static char* gptr_of(std::streambuf* sb) {
+                char* (std::streambuf::*fn)() const = &accessor::gptr;
+                return (sb->*fn)();
+            }
+            static char* egptr_of(std::streambuf* sb) {
+                char* (std::streambuf::*fn)() const = &accessor::egptr;
+                return (sb->*fn)();
+            }
+            static void gbump_of(std::streambuf* sb, int n) {
+                void (std::streambuf::*fn)(int) = &accessor::gbump;
+                (sb->*fn)(n);
+            }
+        };
+
+        /**
+         * Copy characters from the get area until the terminator or length.
+         * Does not wait for more input.
+         *
+         * @param found     set true if the terminator was consumed
+         * @return size_t   number of characters copied
+         */
+        size_t readBytesUntil_impl(char terminator, char* buffer, size_t length, bool& found) {
+            found = false;
+            if (!_canget)
+                return 0;
+            std::streambuf* sb = _ios.rdbuf();
+            size_t count       = 0;
+            while (count < length) {
+                // sgetc forces underflow() to refresh the get area
+                if (std::streambuf::traits_type::eq_int_type(sb->sgetc(), std::streambuf::traits_type::eof()))
+                    break;
+                char* gp     = accessor::gptr_of(sb);
+                size_t seg   = std::min(static_cast<size_t>(accessor::egptr_of(sb) - gp), length - count);
+                char* term   = static_cast<char*>(memchr(gp, terminator, seg));
+                size_t ncopy = term ? static_cast<size_t>(term - gp) : seg;
+                memcpy(buffer + count, gp, ncopy);
+                accessor::gbump_of(sb, static_cast<int>(ncopy));
+                count += ncopy;
+                if (term) {
+                    sb->sbumpc(); // consume terminator
+                    found = true;
+                    break;
+                }
+            }
+            return count;
+        }
+
+        /**
+         * Wait up to timeout_ms for input. Only writes through this adapter
+         * notify _readable, and the iostream may also be filled directly,
+         * so look again every STREAM_POLL_INTERVAL_USEC.
+         */
+        bool wait_impl(std::unique_lock<std::mutex>& lock, unsigned long timeout_ms) {
+            using clock = std::chrono::steady_clock;
+            const clock::duration slice = std::chrono::microseconds(STREAM_POLL_INTERVAL_USEC);
+            clock::time_point deadline  = clock::now() + std::chrono::milliseconds(timeout_ms);
+            while (available_impl() == 0) {
+                clock::time_point now = clock::now();
+                if (now >= deadline)
+                    return false;
+                _readable.wait_for(lock, std::min(slice, deadline - now));
+            }
+            return true;
+        }
+
+        int available_impl() {
+            if (!_canget)
+                return 0;
+            // force update of input buffer pointers
+            _ios.rdbuf()->sgetc();
+            return static_cast<int>(_ios.rdbuf()->in_avail());
+        }
+
         void init() {
             _canget = _ios.tellg() >= 0;
             _canput = _ios.tellp() >= 0;
@@ -115,6 +235,7 @@ namespace sys {
         IOSTREAM& _ios;
         bool _canget, _canput;
         mutable std::mutex _guard;
+        std::condition_variable _readable;
     };
 
     /************************************************************************
@@ -141,8 +262,11 @@ namespace sys {
             return _ss.str();
         }
         void str(const sys::StringT s) {
-            std::lock_guard<std::mutex> _(_guard);
-            _ss.str(s);
+            {
+                std::lock_guard<std::mutex> _(_guard);
+                _ss.str(s);
+            }
+            _readable.notify_all();
         }
         void clear() {
             std::lock_guard<std::mutex> _(_guard);
@@ -0,0 +1,330 @@
+#pragma once
+
+#ifndef __STREAM_POSIXFD_H__
+    #define __STREAM_POSIXFD_H__
+
+    #include "../sys_timing.h"
+    #include "Stream_Mock.h"
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <limits>
+    #include <string.h> // for memcpy, memchr
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+    #include <poll.h>
+    #ifdef __linux__
+        #include <sys/epoll.h>
+    #endif
+
+    /** Read-ahead buffer of a Stream_PosixFd, serving available(), peek() and read() */
+    #ifndef POSIX_STREAM_RX_BUFFER
+        #define POSIX_STREAM_RX_BUFFER 512
+    #endif
+
+namespace sys {
+
+    namespace svc {
+
+        /************************************************************************
+         * Waits until one file descriptor is ready for reading or writing.
+         *
+         * Uses its own epoll instance on Linux and poll() elsewhere. Keep one
+         * waiter per direction so a reader and a writer thread never share one.
+         * The epoll instance is only created by the first wait(), so streams
+         * driven by an event loop (ServerLoop.h) cost no extra descriptors.
+         ************************************************************************/
+        class fd_waiter {
+         public:
+            fd_waiter() : fd_(-1), events_(0), epfd_(-1) {}
+            ~fd_waiter() { close(); }
+
+            fd_waiter(const fd_waiter&) = delete;
+            fd_waiter& operator=(const fd_waiter&) = delete;
+
+            /** Watch fd for readable (write == false) or writable data */
+            bool open(int fd, bool write) {
+                close();
+                fd_     = fd;
+                events_ = write ? POLLOUT : POLLIN;
+                return fd >= 0;
+            }
+
+            void close() {
+                if (epfd_ >= 0)
+                    ::close(epfd_);
+                epfd_ = -1;
+                fd_   = -1;
+            }
+
+            /**
+             * Block until the descriptor is ready, it hangs up, or timeout_ms
+             * passes. Spurious wakeups are allowed.
+             * @return true if ready (or hung up, so the next read sees it)
+             */
+            bool wait(unsigned long timeout_ms) {
+                if (fd_ < 0)
+                    return false;
+                int timeout = timeout_ms > static_cast<unsigned long>(std::numeric_limits<int>::max())
+                                  ? std::numeric_limits<int>::max()
+                                  : static_cast<int>(timeout_ms);
+                int n;
+    #ifdef __linux__
+                if (epfd_ >= 0 || create_epoll()) {
+                    struct epoll_event ev;
+                    do {
+                        n = ::epoll_wait(epfd_, &ev, 1, timeout);
+                    } while (n < 0 && errno == EINTR);
+                    return n > 0;
+                }
+    #endif
+                struct pollfd pfd = {fd_, static_cast<short>(events_), 0};
+                do {
+                    n = ::poll(&pfd, 1, timeout);
+                } while (n < 0 && errno == EINTR);
+                return n > 0;
+            }
+
+         protected:
+    #ifdef __linux__
+            bool create_epoll() {
+                epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+                if (epfd_ < 0)
+                    return false;
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events  = events_ == POLLOUT ? EPOLLOUT : EPOLLIN;
+                ev.data.fd = fd_;
+                if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd_, &ev) == 0)
+                    return true;
+                ::close(epfd_);
+                epfd_ = -1;
+                return false;
+            }
+    #endif
+
+            int fd_;
+            short events_;
+            int epfd_;
+        };
+
+    } // namespace svc
+
+    /************************************************************************
+     * Stream over a non-blocking POSIX file descriptor.
+     *
+     * Base of the host transports (Stream_PosixSerial). Reads go through a
+     * POSIX_STREAM_RX_BUFFER read-ahead buffer, bulk reads bypass it, and
+     * writes wait for room up to the stream timeout instead of dropping
+     * bytes. Readiness waits use epoll on Linux, so timed reads wake as soon
+     * as data arrives. fd() can also go into an application's own event loop.
+     *
+     * Like Stream_Loopback, one thread may read while another writes.
+     ************************************************************************/
+    class Stream_PosixFd : public sys::Stream {
+     public:
+        Stream_PosixFd() : _fd(-1), _own(false), _eof(false), _rxhead(0), _rxtail(0) {}
+
+        /** Wrap an open descriptor, e.g. a pty master or a socket */
+        explicit Stream_PosixFd(int fd, bool own = true) : Stream_PosixFd() { attach(fd, own); }
+
+        virtual ~Stream_PosixFd() { close(); }
+
+        Stream_PosixFd(const Stream_PosixFd&) = delete;
+        Stream_PosixFd& operator=(const Stream_PosixFd&) = delete;
+
+        /**
+         * Use fd for this stream and make it non-blocking. If own is set,
+         * close() and the destructor close the descriptor.
+         * @return false if fd is not a usable descriptor
+         */
+        bool attach(int fd, bool own = true) {
+            close();
+            if (fd < 0)
+                return false;
+            int flags = ::fcntl(fd, F_GETFL, 0);
+            if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+                return false;
+            _fd  = fd;
+            _own = own;
+            _eof = false;
+            if (!_rxwait.open(fd, false) || !_txwait.open(fd, true)) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        virtual void close() {
+            _rxwait.close();
+            _txwait.close();
+            if (_fd >= 0 && _own)
+                ::close(_fd);
+            _fd     = -1;
+            _rxhead = _rxtail = 0;
+        }
+
+        bool isOpen() const { return _fd >= 0; }
+        int fd() const { return _fd; }
+
+        /** The other end closed (read returned end of file or an error) */
+        bool hungUp() const { return _eof; }
+
+        ////// PRINT //////
+
+        virtual size_t write(const uint8_t byte) override { return write(&byte, 1); }
+
+        /** Write all n bytes, waiting up to the stream timeout for room */
+        virtual size_t write(const uint8_t* str, size_t n) override {
+            size_t count        = 0;
+            unsigned long start = sys::millis(), now;
+            while (count < n && _fd >= 0) {
+                ssize_t w = write_some(str + count, n - count);
+                if (w > 0) {
+                    count += static_cast<size_t>(w);
+                    continue;
+                }
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    break;
+                if ((now = sys::millis() - start) >= _timeout)
+                    break;
+                _txwait.wait(_timeout - now);
+            }
+            return count;
+        }
+
+        /** write() waits for room, so callers need not limit themselves */
+        virtual int availableForWrite() override {
+            return _fd >= 0 ? std::numeric_limits<int>::max() : 0;
+        }
+
+        ////// STREAM //////
+
+        virtual int available() override {
+            fill();
+            int pending = 0;
+            if (_fd >= 0 && ::ioctl(_fd, FIONREAD, &pending) < 0)
+                pending = 0;
+            return static_cast<int>(_rxtail - _rxhead) + pending;
+        }
+
+        virtual int peek() override { return fill() ? _rxbuf[_rxhead] : -1; }
+
+        virtual int read() override { return fill() ? _rxbuf[_rxhead++] : -1; }
+
+        virtual bool waitAvailable(unsigned long timeout_ms) override {
+            if (_rxhead < _rxtail)
+                return true;
+            return _rxwait.wait(timeout_ms);
+        }
+
+        /** Bulk read. Waits up to the stream timeout for all length bytes. */
+        virtual size_t readBytes(char* buffer, size_t length) override {
+            uint8_t* dest       = reinterpret_cast<uint8_t*>(buffer);
+            size_t count        = take(dest, length);
+            unsigned long start = sys::millis(), now;
+            while (count < length && _fd >= 0) {
+                // large reads skip the read-ahead buffer
+                ssize_t r = ::read(_fd, dest + count, length - count);
+                if (r > 0) {
+                    count += static_cast<size_t>(r);
+                    continue;
+                }
+                if (!again(r) || (now = sys::millis() - start) >= _timeout)
+                    break;
+                _rxwait.wait(_timeout - now);
+            }
+            return count;
+        }
+
+        /** Bulk read up to a terminator. Waits up to the stream timeout for the terminator. */
+        virtual size_t readBytesUntil(char terminator, char* buffer, size_t length) override {
+            uint8_t* dest       = reinterpret_cast<uint8_t*>(buffer);
+            uint8_t term        = static_cast<uint8_t>(terminator);
+            size_t count        = 0;
+            unsigned long start = sys::millis(), now;
+            while (true) {
+                if (_rxhead < _rxtail) {
+                    const uint8_t* first = _rxbuf + _rxhead;
+                    size_t seg           = _rxtail - _rxhead;
+                    const uint8_t* found = static_cast<const uint8_t*>(memchr(first, term, seg));
+                    size_t ncopy         = found ? static_cast<size_t>(found - first) : seg;
+                    if (ncopy > length - count)
+                        ncopy = length - count;
+                    memcpy(dest + count, first, ncopy);
+                    count += ncopy;
+                    _rxhead += ncopy;
+                    // as sys::Stream, a full buffer leaves a following terminator unread
+                    if (count == length)
+                        return count;
+                    if (found) {
+                        _rxhead++; // consume terminator
+                        return count;
+                    }
+                }
+                if (fill())
+                    continue;
+                if (_fd < 0 || _eof || (now = sys::millis() - start) >= _timeout)
+                    return count;
+                _rxwait.wait(_timeout - now);
+            }
+        }
+
+        using sys::Stream::readBytes;
+        using sys::Stream::readBytesUntil;
+
+     protected:
+        /** One non-blocking write(2). Sockets override it to suppress SIGPIPE */
+        virtual ssize_t write_some(const uint8_t* str, size_t n) { return ::write(_fd, str, n); }
+
+        /** Top up an empty read-ahead buffer without blocking. @return true if bytes are buffered */
+        bool fill() {
+            if (_rxhead < _rxtail)
+                return true;
+            _rxhead = _rxtail = 0;
+            if (_fd < 0)
+                return false;
+            ssize_t r;
+            do {
+                r = ::read(_fd, _rxbuf, sizeof(_rxbuf));
+            } while (r < 0 && errno == EINTR);
+            if (r > 0) {
+                _rxtail = static_cast<size_t>(r);
+                return true;
+            }
+            again(r);
+            return false;
+        }
+
+        /** Copy out buffered bytes */
+        size_t take(uint8_t* dest, size_t n) {
+            size_t avail = _rxtail - _rxhead;
+            if (n > avail)
+                n = avail;
+            memcpy(dest, _rxbuf + _rxhead, n);
+            _rxhead += n;
+            return n;
+        }
+
+        /** @return true if a failed read may succeed later; notes end of file */
+        bool again(ssize_t r) {
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return true;
+            _eof = true; // 0 is end of file; EIO is a closed pty
+            return false;
+        }
+
+        int _fd;
+        bool _own;
+        bool _eof;
+        svc::fd_waiter _rxwait;
+        svc::fd_waiter _txwait;
+        uint8_t _rxbuf[POSIX_STREAM_RX_BUFFER];
+        size_t _rxhead;
+        size_t _rxtail;
+    };
+
+} // namespace sys
+
+#endif // __STREAM_POSIXFD_H__
@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef __STREAM_POSIXSERIAL_H__
+    #define __STREAM_POSIXSERIAL_H__
+
+    #include "Stream_PosixFd.h"
+    #include <sys/file.h> // for flock
+    #include <termios.h>
+
+namespace sys {
+
+    /************************************************************************
+     * Serial port on a POSIX host, such as /dev/ttyACM0 or a pty.
+     *
+     * Lets host tools and benchmarks talk to a device without the
+     * micro-manager core (compare rdlmm::Stream_HubSerial). begin() opens
+     * the port in raw 8N1 mode with no flow control and discards stale
+     * input, so the first frame read is a fresh one. The port is opened
+     * exclusively (flock and TIOCEXCL): while it is open, other opens fail
+     * with EBUSY, so a hub daemon cannot share it unnoticed.
+     *
+     * @code{.cpp}
+     * sys::Stream_PosixSerial port;
+     * if (!port.begin("/dev/ttyACM0", 115200))
+     *     perror("open");
+     * auto client = static_json_client<jsonrpc_default_keys, 512>(port, port);
+     * @endcode
+     ************************************************************************/
+    class Stream_PosixSerial : public Stream_PosixFd {
+     public:
+        Stream_PosixSerial() : Stream_PosixFd() {}
+
+        Stream_PosixSerial(const char* path, unsigned long baud) : Stream_PosixFd() { begin(path, baud); }
+
+        /**
+         * Open and configure the port.
+         * @return false on failure, with errno set by the failing call
+         */
+        bool begin(const char* path, unsigned long baud) {
+            close();
+            speed_t speed;
+            if (!baud_to_speed(baud, speed)) {
+                errno = EINVAL;
+                return false;
+            }
+            int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+            if (::flock(fd, LOCK_EX | LOCK_NB) < 0) {
+                int err = errno;
+                ::close(fd);
+                errno = (err == EWOULDBLOCK) ? EBUSY : err;
+                return false;
+            }
+            // flock only binds cooperating processes; TIOCEXCL stops other opens of the tty
+            ::ioctl(fd, TIOCEXCL);
+            struct termios tio;
+            if (::tcgetattr(fd, &tio) < 0) {
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                return false;
+            }
+            ::cfmakeraw(&tio);
+            tio.c_cflag |= CLOCAL | CREAD;
+            tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+            tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+            // with VMIN 0 an empty read returns 0, which looks like a hang up;
+            // with VMIN 1 and O_NONBLOCK it fails with EAGAIN instead
+            tio.c_cc[VMIN]  = 1;
+            tio.c_cc[VTIME] = 0;
+            ::cfsetispeed(&tio, speed);
+            ::cfsetospeed(&tio, speed);
+            if (::tcsetattr(fd, TCSANOW, &tio) < 0) {
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                return false;
+            }
+            ::tcflush(fd, TCIOFLUSH);
+            _baud = baud;
+            return attach(fd, true);
+        }
+
+        void end() { close(); }
+
+        unsigned long baud() const { return _baud; }
+
+        /** Wait until every written byte has left the port */
+        virtual void flush() override {
+            if (_fd >= 0)
+                ::tcdrain(_fd);
+        }
+
+        /** termios speed constant for a baud rate. @return false if unsupported */
+        static bool baud_to_speed(unsigned long baud, speed_t& speed) {
+            switch (baud) {
+                case 9600: speed = B9600; return true;
+                case 19200: speed = B19200; return true;
+                case 38400: speed = B38400; return true;
+                case 57600: speed = B57600; return true;
+                case 115200: speed = B115200; return true;
+                case 230400: speed = B230400; return true;
+    #ifdef B460800
+                case 460800: speed = B460800; return true;
+    #endif
+    #ifdef B921600
+                case 921600: speed = B921600; return true;
+    #endif
+    #ifdef B1000000
+                case 1000000: speed = B1000000; return true;
+    #endif
+    #ifdef B2000000
+                case 2000000: speed = B2000000; return true;
+    #endif
+    #ifdef B3000000
+                case 3000000: speed = B3000000; return true;
+    #endif
+    #ifdef B4000000
+                case 4000000: speed = B4000000; return true;
+    #endif
+                default: return false;
+            }
+        }
+
+     protected:
+        unsigned long _baud = 0;
+    };
+
+} // namespace sys
+
+#endif // __STREAM_POSIXSERIAL_H__
@@ -0,0 +1,290 @@
+#pragma once
+
+#ifndef __STREAM_SOCKET_H__
+    #define __STREAM_SOCKET_H__
+
+    #include "Stream_PosixFd.h"
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <stdio.h> // for snprintf
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+
+    #ifndef SOCKET_LISTEN_BACKLOG
+        #define SOCKET_LISTEN_BACKLOG 4
+    #endif
+
+namespace sys {
+
+    namespace svc {
+        /** Fill a sockaddr_un. @return false if path is too long */
+        inline bool unix_address(const char* path, struct sockaddr_un& addr) {
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (strlen(path) >= sizeof(addr.sun_path))
+                return false;
+            strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+            return true;
+        }
+
+        /** socket() that is not inherited by child processes */
+        inline int open_socket(int domain, int type, int protocol) {
+            int fd = ::socket(domain, type, protocol);
+            if (fd >= 0)
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            return fd;
+        }
+
+        /** Socket options every connected socket gets */
+        inline void tune_socket(int fd, bool tcp) {
+            int one = 1;
+    #ifdef SO_NOSIGPIPE
+            ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+    #endif
+            // frames are small and latency bound: send them right away
+            if (tcp)
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    } // namespace svc
+
+    /************************************************************************
+     * Connected Unix-domain or TCP socket stream.
+     *
+     * Runs a json_client and a json_server in separate processes over a
+     * kernel transport, e.g. a device simulator for benchmarks. TCP
+     * sockets disable Nagle's algorithm so each frame goes out at once, and
+     * writes to a closed peer fail instead of raising SIGPIPE.
+     *
+     * @code{.cpp}
+     * sys::Stream_Socket link;
+     * if (!link.connectTcp("127.0.0.1", 5555))
+     *     perror("connect");
+     * auto client = static_json_client<jsonrpc_default_keys, 512>(link, link);
+     * @endcode
+     ************************************************************************/
+    class Stream_Socket : public Stream_PosixFd {
+     public:
+        Stream_Socket() : Stream_PosixFd() {}
+
+        /** @return false on failure, with errno set */
+        bool connectUnix(const char* path) {
+            close();
+            struct sockaddr_un addr;
+            if (!svc::unix_address(path, addr)) {
+                errno = ENAMETOOLONG;
+                return false;
+            }
+            int fd = svc::open_socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+            if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+                return fail(fd);
+            svc::tune_socket(fd, false);
+            return attach(fd, true);
+        }
+
+        /** @return false on failure, with errno set (EHOSTUNREACH if host is unknown) */
+        bool connectTcp(const char* host, uint16_t port) {
+            close();
+            struct addrinfo hints, *found = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family   = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            char service[8];
+            snprintf(service, sizeof(service), "%u", static_cast<unsigned>(port));
+            if (::getaddrinfo(host, service, &hints, &found) != 0) {
+                errno = EHOSTUNREACH;
+                return false;
+            }
+            int fd = -1;
+            for (struct addrinfo* ai = found; ai; ai = ai->ai_next) {
+                fd = svc::open_socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0)
+                    continue;
+                if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+                    break;
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                fd    = -1;
+            }
+            ::freeaddrinfo(found);
+            if (fd < 0)
+                return false;
+            svc::tune_socket(fd, true);
+            return attach(fd, true);
+        }
+
+        /** TCP_NODELAY is set (false for Unix-domain sockets) */
+        bool noDelay() const {
+            int value     = 0;
+            socklen_t len = sizeof(value);
+            return _fd >= 0 && ::getsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &value, &len) == 0 && value != 0;
+        }
+
+     protected:
+        friend class Socket_Listener;
+
+        virtual ssize_t write_some(const uint8_t* str, size_t n) override {
+    #ifdef MSG_NOSIGNAL
+            return ::send(_fd, str, n, MSG_NOSIGNAL);
+    #else
+            return ::send(_fd, str, n, 0); // SO_NOSIGPIPE set in tune_socket
+    #endif
+        }
+
+        static bool fail(int fd) {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+    };
+
+    /************************************************************************
+     * Listening Unix-domain or TCP socket that hands out Stream_Sockets.
+     *
+     * @code{.cpp}
+     * sys::Socket_Listener listener;
+     * listener.listenTcp("127.0.0.1", 0); // any free port, see port()
+     * sys::Stream_Socket link;
+     * while (!listener.accept(link, 1000)) {}
+     * auto server = static_json_server<MapT, jsonrpc_default_keys, 512>(link, link, map);
+     * @endcode
+     ************************************************************************/
+    class Socket_Listener {
+     public:
+        Socket_Listener() : _fd(-1), _tcp(false), _port(0) { _path[0] = '\0'; }
+        ~Socket_Listener() { close(); }
+
+        Socket_Listener(const Socket_Listener&) = delete;
+        Socket_Listener& operator=(const Socket_Listener&) = delete;
+
+        /**
+         * Listen at path, replacing a stale socket file. A socket someone
+         * still listens on is left alone.
+         * @return false on failure, with errno set (EADDRINUSE if in use)
+         */
+        bool listenUnix(const char* path) {
+            close();
+            struct sockaddr_un addr;
+            if (!svc::unix_address(path, addr)) {
+                errno = ENAMETOOLONG;
+                return false;
+            }
+            if (!remove_stale(addr))
+                return false;
+            int fd = svc::open_socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+            if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+                return Stream_Socket::fail(fd);
+            strncpy(_path, addr.sun_path, sizeof(_path) - 1);
+            _path[sizeof(_path) - 1] = '\0';
+            return start(fd, false);
+        }
+
+        /**
+         * Listen on an IPv4 address such as "127.0.0.1" or "0.0.0.0".
+         * Port 0 picks a free port, see port().
+         * @return false on failure, with errno set
+         */
+        bool listenTcp(const char* address, uint16_t port) {
+            close();
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port   = htons(port);
+            if (::inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+                errno = EINVAL;
+                return false;
+            }
+            int fd = svc::open_socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+                return Stream_Socket::fail(fd);
+            socklen_t len = sizeof(addr);
+            ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+            _port = ntohs(addr.sin_port);
+            return start(fd, true);
+        }
+
+        /**
+         * Wait up to timeout_ms for a connection and attach it to stream.
+         * @return false if none arrived
+         */
+        bool accept(Stream_Socket& stream, unsigned long timeout_ms) {
+            if (_fd < 0)
+                return false;
+            int fd = ::accept(_fd, nullptr, nullptr);
+            if (fd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && _wait.wait(timeout_ms))
+                fd = ::accept(_fd, nullptr, nullptr);
+            if (fd < 0)
+                return false;
+            // accepted sockets do not inherit O_NONBLOCK everywhere; attach() sets it
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            svc::tune_socket(fd, _tcp);
+            return stream.attach(fd, true);
+        }
+
+        /** Stop listening and remove a Unix-domain socket file */
+        void close() {
+            _wait.close();
+            if (_fd >= 0)
+                ::close(_fd);
+            if (_path[0])
+                ::unlink(_path);
+            _fd      = -1;
+            _path[0] = '\0';
+        }
+
+        bool isListening() const { return _fd >= 0; }
+        int fd() const { return _fd; }
+        uint16_t port() const { return _port; }
+
+     protected:
+        /** Unlink the socket file at addr if nothing accepts connections there */
+        static bool remove_stale(const struct sockaddr_un& addr) {
+            struct stat st;
+            if (::lstat(addr.sun_path, &st) < 0 || !S_ISSOCK(st.st_mode))
+                return true; // nothing there, or bind() reports what is
+            int probe = svc::open_socket(AF_UNIX, SOCK_STREAM, 0);
+            if (probe < 0)
+                return false;
+            bool live = ::connect(probe, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)) == 0;
+            int err   = errno;
+            ::close(probe);
+            if (live) {
+                errno = EADDRINUSE;
+                return false;
+            }
+            if (err == ECONNREFUSED)
+                ::unlink(addr.sun_path);
+            return true;
+        }
+
+        bool start(int fd, bool tcp) {
+            int flags = ::fcntl(fd, F_GETFL, 0);
+            if (::listen(fd, SOCKET_LISTEN_BACKLOG) < 0 || flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+                return Stream_Socket::fail(fd);
+            _fd  = fd;
+            _tcp = tcp;
+            return _wait.open(fd, false);
+        }
+
+        int _fd;
+        bool _tcp;
+        uint16_t _port;
+        char _path[sizeof(((struct sockaddr_un*)nullptr)->sun_path)];
+        svc::fd_waiter _wait;
+    };
+
+} // namespace sys
+
+#endif // __STREAM_SOCKET_H__
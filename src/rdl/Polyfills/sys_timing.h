@@ -3,7 +3,7 @@
 #ifndef __SYS_TIMING_H__
     #define __SYS_TIMING_H__
 
-    #include <ctype.h> // for uint32_t;
+    #include <stdint.h> // for uint32_t, uint64_t
 
     #ifdef __has_include
         #if __has_include(<Arduino.h>)
@@ -14,19 +14,40 @@ inline void sys_delay(uint32_t msec) { delay(msec); }
 inline void sys_delayMicroseconds(uint32_t usec) { delayMicroseconds(usec); }
 inline uint32_t sys_millis(void) { return millis(); }
 inline uint32_t sys_micros(void) { return micros(); }
+inline uint64_t sys_nanos(void) { return static_cast<uint64_t>(micros()) * 1000ULL; }
         #else
             #include <chrono>
             #include <thread>
+
+            /** Final microseconds of sys_delayMicroseconds() spun rather than slept */
+            #ifndef SYS_TIMING_SPIN_USEC
+                #define SYS_TIMING_SPIN_USEC 200
+            #endif
+
 inline void sys_yield(void) { std::this_thread::yield(); }
 inline void sys_delay(uint32_t msec) { std::this_thread::sleep_for(std::chrono::milliseconds(msec)); }
-inline void sys_delayMicroseconds(uint32_t usec) { std::this_thread::sleep_for(std::chrono::milliseconds(usec / 1000)); }
+inline std::chrono::steady_clock::time_point sys_epoch(void) {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+inline void sys_delayMicroseconds(uint32_t usec) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(usec);
+    if (usec > SYS_TIMING_SPIN_USEC)
+        std::this_thread::sleep_for(std::chrono::microseconds(usec - SYS_TIMING_SPIN_USEC));
+    while (std::chrono::steady_clock::now() < deadline) {
+    }
+}
 inline uint32_t sys_millis(void) {
-    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto now = std::chrono::steady_clock::now() - sys_epoch();
     return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
 }
 inline uint32_t sys_micros(void) {
-    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto now = std::chrono::steady_clock::now() - sys_epoch();
     return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+inline uint64_t sys_nanos(void) {
+    auto now = std::chrono::steady_clock::now() - sys_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
 }
         #endif
     #endif
@@ -0,0 +1,333 @@
+/*!
+ *  @file ServerLoop.h
+ *
+ *  One host thread serving many simulated devices.
+ *
+ *  A server_loop holds any number of (Stream_PosixFd, json_server) pairs,
+ *  e.g. socketpair or pty ends in a test rig with hundreds of simulated
+ *  devices. run() sleeps in epoll (poll() outside Linux) until a stream
+ *  is readable or the next scheduled property set is due, then calls
+ *  check_messages() on just the servers with input. Idle devices cost no
+ *  CPU, unlike one polling thread per server.
+ *
+ *  Each wakeup handles at most SERVER_LOOP_FRAME_BUDGET frames per stream
+ *  so one chatty client cannot starve the rest. Streams with frames left
+ *  over are served again on the next pass without waiting.
+ *
+ *  check_messages() reads a whole frame, so a stream holding only part of
+ *  one blocks the loop for up to that stream's timeout. Keep the timeouts
+ *  of streams served here short.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __SERVERLOOP_H__
+    #define __SERVERLOOP_H__
+
+    #include "JsonError.h"
+    #include "TimerQueue.h"
+    #include "sys_StreamT.h"
+    #include "sys_timing.h"
+
+    #if defined(__unix__) || defined(__APPLE__)
+
+        #include <algorithm>
+        #include <atomic>
+        #include <memory>
+        #include <vector>
+        #include <errno.h>
+        #include <fcntl.h>
+        #include <poll.h>
+        #include <string.h>
+        #include <unistd.h>
+        #ifdef __linux__
+            #include <sys/epoll.h>
+        #endif
+
+        /** Frames handled per stream on each wakeup */
+        #ifndef SERVER_LOOP_FRAME_BUDGET
+            #define SERVER_LOOP_FRAME_BUDGET 16
+        #endif
+
+        /** Ready streams collected by one epoll_wait() */
+        #ifndef SERVER_LOOP_MAX_EVENTS
+            #define SERVER_LOOP_MAX_EVENTS 64
+        #endif
+
+namespace rdl {
+
+    /************************************************************************
+     * Event loop over many json_servers.
+     *
+     * add(), remove() and run_once() belong to the loop's thread; only
+     * stop() may be called from elsewhere. Servers run on the loop's thread,
+     * so they share timer_queue::instance() safely. Streams that hang up
+     * are removed automatically.
+     ************************************************************************/
+    class server_loop {
+     public:
+        server_loop() : epfd_(-1), dispatching_(false), stopping_(false), frames_(0), errors_(0) {
+            wake_[0] = wake_[1] = -1;
+            if (::pipe(wake_) != 0) {
+                wake_[0] = wake_[1] = -1;
+                return;
+            }
+            for (int fd : wake_) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        #ifdef __linux__
+            epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+            if (epfd_ >= 0 && !watch(wake_[0], nullptr)) {
+                ::close(epfd_);
+                epfd_ = -1;
+            }
+        #endif
+        }
+
+        ~server_loop() {
+            if (epfd_ >= 0)
+                ::close(epfd_);
+            for (int fd : wake_) {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+        }
+
+        server_loop(const server_loop&) = delete;
+        server_loop& operator=(const server_loop&) = delete;
+
+        /** The wakeup pipe (and epoll instance on Linux) could be created */
+        bool valid() const {
+        #ifdef __linux__
+            return epfd_ >= 0;
+        #else
+            return wake_[0] >= 0;
+        #endif
+        }
+
+        /**
+         * Serve stream with server, which must read from it (any class with
+         * int check_messages()). Both must outlive the registration.
+         * @return false if the stream is closed or could not be watched
+         */
+        template <class ServerT>
+        bool add(sys::Stream_PosixFd& stream, ServerT& server) {
+            if (!valid() || !stream.isOpen())
+                return false;
+            std::unique_ptr<entry> e(new entry(stream, &server, &check<ServerT>));
+        #ifdef __linux__
+            if (!watch(stream.fd(), e.get()))
+                return false;
+        #endif
+            entries_.push_back(std::move(e));
+            return true;
+        }
+
+        /** Stop serving stream. Safe from inside a dispatched method. */
+        bool remove(sys::Stream_PosixFd& stream) {
+            for (auto& e : entries_) {
+                if (e->stream == &stream) {
+                    drop(*e);
+                    if (!dispatching_)
+                        compact();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** Streams being served */
+        size_t size() const {
+            size_t n = 0;
+            for (auto& e : entries_)
+                n += e->stream != nullptr;
+            return n;
+        }
+
+        /**
+         * Wait for input or a due timer, then serve it.
+         * @param timeout_ms longest wait; negative waits until something happens
+         * @return frames handled
+         */
+        size_t run_once(int timeout_ms = -1) {
+            if (!valid())
+                return 0;
+            timeout_ms     = wait_time(timeout_ms);
+            size_t handled = 0;
+            dispatching_   = true;
+            // serve streams that still had frames after their last budget
+            std::vector<entry*> again;
+            again.swap(pending_);
+            for (entry* e : again)
+                e->queued = false;
+        #ifdef __linux__
+            struct epoll_event events[SERVER_LOOP_MAX_EVENTS];
+            int n;
+            do {
+                n = ::epoll_wait(epfd_, events, SERVER_LOOP_MAX_EVENTS, timeout_ms);
+            } while (n < 0 && errno == EINTR);
+            for (int i = 0; i < n; i++) {
+                entry* e = static_cast<entry*>(events[i].data.ptr);
+                if (e == nullptr)
+                    drain_wake();
+                else
+                    handled += serve(*e);
+            }
+        #else
+            std::vector<struct pollfd> fds;
+            fds.reserve(entries_.size() + 1);
+            fds.push_back({wake_[0], POLLIN, 0});
+            for (auto& e : entries_)
+                fds.push_back({e->stream->fd(), POLLIN, 0});
+            int n;
+            do {
+                n = ::poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms);
+            } while (n < 0 && errno == EINTR);
+            if (n > 0) {
+                if (fds[0].revents)
+                    drain_wake();
+                size_t count = entries_.size(); // serving may remove entries
+                for (size_t i = 0; i < count; i++) {
+                    if (fds[i + 1].revents)
+                        handled += serve(*entries_[i]);
+                }
+            }
+        #endif
+            for (entry* e : again) {
+                if (!e->served)
+                    handled += serve(*e);
+            }
+            for (auto& e : entries_)
+                e->served = false;
+            timer_queue::instance().poll();
+            dispatching_ = false;
+            compact();
+            frames_ += handled;
+            return handled;
+        }
+
+        /** Serve until stop() */
+        void run() {
+            while (!stopping_.load(std::memory_order_acquire))
+                run_once(-1);
+            stopping_ = false;
+        }
+
+        /** Make run() return soon. May be called from any thread or a dispatched method. */
+        void stop() {
+            stopping_.store(true, std::memory_order_release);
+            const char byte = 0;
+            if (wake_[1] >= 0 && ::write(wake_[1], &byte, 1) < 0) {
+                // pipe full: a wakeup is already waiting
+            }
+        }
+
+        /** Frames handled since construction */
+        unsigned long frames() const { return frames_; }
+        /** check_messages() calls that returned an error */
+        unsigned long errors() const { return errors_; }
+
+     protected:
+        using check_fn = int (*)(void*);
+
+        template <class ServerT>
+        static int check(void* server) { return static_cast<ServerT*>(server)->check_messages(); }
+
+        struct entry {
+            entry(sys::Stream_PosixFd& s, void* srv, check_fn c) : stream(&s), server(srv), check(c), served(false), queued(false) {}
+            sys::Stream_PosixFd* stream; ///< nullptr once removed
+            void* server;
+            check_fn check;
+            bool served; ///< already served in this pass
+            bool queued; ///< in pending_
+        };
+
+        /** Handle up to the frame budget from one stream */
+        size_t serve(entry& e) {
+            size_t n = 0;
+            if (e.stream == nullptr)
+                return 0;
+            e.served = true;
+            while (n < SERVER_LOOP_FRAME_BUDGET && e.stream->available() > 0) {
+                if (e.check(e.server) != ERROR_OK)
+                    errors_++;
+                n++;
+                if (e.stream == nullptr) // removed by the dispatched method
+                    return n;
+            }
+            if (e.stream->hungUp()) {
+                drop(e);
+            } else if (n == SERVER_LOOP_FRAME_BUDGET && !e.queued && e.stream->available() > 0) {
+                // bytes in the read-ahead buffer do not wake epoll
+                e.queued = true;
+                pending_.push_back(&e);
+            }
+            return n;
+        }
+
+        int wait_time(int timeout_ms) const {
+            if (!pending_.empty())
+                return 0;
+            uint32_t due;
+            if (timer_queue::instance().next_due(due)) {
+                int32_t us = static_cast<int32_t>(due - sys::micros());
+                int ms     = us <= 0 ? 0 : static_cast<int>((us + 999) / 1000);
+                if (timeout_ms < 0 || ms < timeout_ms)
+                    timeout_ms = ms;
+            }
+            return timeout_ms;
+        }
+
+        void drop(entry& e) {
+        #ifdef __linux__
+            if (e.stream->fd() >= 0)
+                ::epoll_ctl(epfd_, EPOLL_CTL_DEL, e.stream->fd(), nullptr);
+        #endif
+            e.stream = nullptr;
+        }
+
+        /** Free removed entries once no event can refer to them */
+        void compact() {
+            pending_.erase(std::remove_if(pending_.begin(), pending_.end(), [](entry* e) { return e->stream == nullptr; }),
+                           pending_.end());
+            entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                          [](const std::unique_ptr<entry>& e) { return e->stream == nullptr; }),
+                           entries_.end());
+        }
+
+        #ifdef __linux__
+        bool watch(int fd, entry* e) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events   = EPOLLIN;
+            ev.data.ptr = e;
+            return ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+        }
+        #endif
+
+        void drain_wake() {
+            char bytes[64];
+            while (::read(wake_[0], bytes, sizeof(bytes)) > 0) {
+            }
+        }
+
+        int epfd_;
+        int wake_[2];
+        bool dispatching_;
+        std::atomic<bool> stopping_;
+        std::vector<std::unique_ptr<entry>> entries_;
+        std::vector<entry*> pending_;
+        unsigned long frames_;
+        unsigned long errors_;
+    };
+
+} // namespace rdl
+
+    #endif // __unix__ || __APPLE__
+
+#endif // __SERVERLOOP_H__
@@ -4,13 +4,20 @@
     #define __SERVERPROPERTY_H__
 
     #include "Arraybuf.h"
+    #include "DeltaPack.h"
     #include "JsonDelegate.h"
+    #include "TimerQueue.h"
     #include "std_utility.h"
     #include "sys_PrintT.h"
     #include "sys_StringT.h"
 
     #define SERVERPROP_LOGGING 0
 
+    /** max_size() of a stream_prop: the client can send sequences of any length */
+    #ifndef SERVERPROP_STREAM_MAX_SIZE
+        #define SERVERPROP_STREAM_MAX_SIZE 0x7FFFFFFFL
+    #endif
+
 namespace rdl {
 
     /************************************************************************
@@ -33,7 +40,11 @@ namespace rdl {
         /** Absolute base class type, used for virtual dispatch */
         using RootT = prop_any_base<T, ExT...>;
 
-        prop_any_base(const sys::StringT& brief_name) : brief_(brief_name), logger_(nullptr) {}
+        /** Server push of a changed value: publisher("=brief", value, ex...) */
+        using publish_delegate = delegate<int, const char*, const T, ExT...>;
+
+        prop_any_base(const sys::StringT& brief_name)
+            : brief_(brief_name), logger_(nullptr), publisher_(), push_method_(), subscribed_(false) {}
         // prop_any_base(const prop_any_base& other) = default;
 
         bool operator==(const prop_any_base& other) const { return brief_ == other.brief_; }
@@ -45,11 +56,14 @@ namespace rdl {
          * @tparam DelegateT    either delegate or json_delegate
          */
         struct json_delegates {
-            using get    = json_delegate<T, ExT...>;
-            using set    = json_delegate<void, const T, ExT...>;
-            using array  = json_delegate<long, ExT...>;
-            using action = json_delegate<void, ExT...>;
-            using flag   = json_delegate<bool, ExT...>;
+            using get       = json_delegate<T, ExT...>;
+            using set       = json_delegate<void, const T, ExT...>;
+            using array     = json_delegate<long, ExT...>;
+            using action    = json_delegate<void, ExT...>;
+            using flag      = json_delegate<bool, ExT...>;
+            using subscribe = json_delegate<bool, bool>;
+            using packed    = json_delegate<long, const char*, ExT...>;
+            using schedule  = json_delegate<bool, const T, uint32_t, ExT...>;
         };
 
         ////// DISPATCH INTERFACE //////
@@ -64,8 +78,66 @@ namespace rdl {
         virtual bool sequencable(ExT... ex) const  = 0;
         virtual bool read_only(ExT... ex) const    = 0;
 
+        /**
+         * Set the value when the server's sys::micros() reaches at_us
+         * (">brief"), from timer_queue::instance().
+         * @return false if the property cannot schedule sets
+         */
+        virtual bool set_at(const T, uint32_t, ExT...) {
+            return false;
+        }
+
+        /**
+         * Number of sequence values that add() can take right now. Streaming
+         * clients never send more than this before asking again ("%brief").
+         */
+        virtual long credit(ExT... ex) const {
+            return max_size(ex...) - size(ex...);
+        }
+
+        /**
+         * Add a delta packed string of sequence values ("&brief"), one
+         * add() per value. Only integer properties accept packed values.
+         * Values past credit() are dropped.
+         *
+         * @return number of values added, or -1 if the string is corrupt
+         */
+        virtual long add_packed(const char* packed, ExT... ex) {
+            return add_packed_impl(packed, std::integral_constant<bool, std::is_integral<T>::value>(), ex...);
+        }
+
         sys::StringT message(const char opcode) { return opcode + brief_; }
 
+        /** Add the value to a "$" device snapshot, keyed by brief */
+        virtual bool snapshot(JsonObject values) {
+            // properties with extra parameters have no single value to add
+            return snapshot_impl(values, std::integral_constant<bool, sizeof...(ExT) == 0>());
+        }
+
+        ////// SERVER PUSH //////
+        /**
+         * Client subscription to changes ("@brief").
+         * @return true if changes will be pushed, i.e. the property was
+         *         published with json_server::publish()
+         */
+        virtual bool subscribe(bool enable) {
+            subscribed_ = enable && publisher_ != publish_delegate();
+            return subscribed_;
+        }
+
+        bool subscribed() const { return subscribed_; }
+
+        /**
+         * Send changes through server->notify(). Use json_server::publish(prop).
+         * Once published, set() the property only from the thread running
+         * the server's check_messages(): pushes are not thread-safe.
+         */
+        template <class ServerT>
+        void publish_to(ServerT* server) {
+            publisher_   = publish_delegate::template create<ServerT, &ServerT::template notify<T, ExT...>>(server);
+            push_method_ = message('=');
+        }
+
         virtual void logger(sys::PrintT* logger) {
             logger_ = logger;
     #if SERVERPROP_LOGGING
@@ -76,10 +148,55 @@ namespace rdl {
         }
 
      protected:
+        long add_packed_impl(const char* packed, std::true_type, ExT... ex) {
+            return delta_unpack(packed, credit(ex...), [&](long value) { add(static_cast<T>(value), ex...); });
+        }
+
+        long add_packed_impl(const char*, std::false_type, ExT...) {
+            return -1;
+        }
+
+        bool snapshot_impl(JsonObject values, std::true_type) {
+            return values[brief_.c_str()].set(get());
+        }
+
+        bool snapshot_impl(JsonObject, std::false_type) {
+            return true;
+        }
+
+        /**
+         * Push a changed value ("=brief") if a client has subscribed.
+         * Writes through json_server::notify(), so a published property
+         * must only be set from the server loop's thread.
+         */
+        void push(const T value, ExT... ex) {
+            if (subscribed_)
+                publisher_(push_method_.c_str(), value, ex...);
+        }
+
         sys::StringT brief_;
         sys::PrintT* logger_;
+        publish_delegate publisher_;
+        sys::StringT push_method_;
+        bool subscribed_;
     };
 
+    namespace svc {
+        /**
+         * json_stub adding a property to the json_server::snapshot() object in ret.
+         * snapshot() only fails when the document is full: ERROR_JSON_SNAPSHOT_FULL
+         * means raise JSONRPC_SNAPSHOT_MAX_VALUES or JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES.
+         */
+        template <class RootT>
+        int snapshot_stub(void* this_ptr, JsonArray&, JsonVariant& ret) {
+            JsonObject values = ret.as<JsonObject>();
+            if (values.isNull())
+                return ERROR_JSON_INVALID_REQUEST;
+            RootT* p = static_cast<RootT*>(this_ptr);
+            return p->snapshot(values) ? ERROR_OK : ERROR_JSON_SNAPSHOT_FULL;
+        }
+    }
+
     /**
      * Add a suite of property methods to a dispatch map.
      *
@@ -106,21 +223,36 @@ namespace rdl {
         map.insert(PairT(
             prop.message('^'), // max_size for sequences, doubles as number of channels
             delsig::array::template create<RootT, &RootT::max_size>(&prop).stub()));
+        map.insert(PairT(
+            prop.message('$'), // value for the "$" device snapshot
+            json_stub(&prop, &svc::snapshot_stub<RootT>, false)));
+        map.insert(PairT(
+            prop.message('@'), // subscribe to "=brief" change pushes
+            delsig::subscribe::template create<RootT, &RootT::subscribe>(&prop).stub()));
         if (!read_only) {
             map.insert(PairT(
                 prop.message('!'), // set
                 delsig::set::template create<RootT, &RootT::set>(&prop).stub()));
+            map.insert(PairT(
+                prop.message('>'), // set at a server time
+                delsig::schedule::template create<RootT, &RootT::set_at>(&prop).stub()));
         }
         if (sequencable) {
             map.insert(PairT(
                 prop.message('#'), // current sequence size
                 delsig::array::template create<RootT, &RootT::size>(&prop).stub()));
+            map.insert(PairT(
+                prop.message('%'), // sequence credit: free space for add
+                delsig::array::template create<RootT, &RootT::credit>(&prop).stub()));
             map.insert(PairT(
                 prop.message('0'), // clear sequence array
                 delsig::array::template create<RootT, &RootT::clear>(&prop).stub()));
             map.insert(PairT(
                 prop.message('+'), // add to sequence array
                 delsig::set::template create<RootT, &RootT::add>(&prop).stub()));
+            map.insert(PairT(
+                prop.message('&'), // add delta packed values to sequence array
+                delsig::packed::template create<RootT, &RootT::add_packed>(&prop).stub()));
             map.insert(PairT(
                 prop.message('*'), // start sequence
                 delsig::action::template create<RootT, &RootT::start>(&prop).stub()));
@@ -145,10 +277,16 @@ namespace rdl {
      * ...
      * @endcode
      *
+     * Sequences are uploaded with clear() and add(), then played with
+     * start() and one step() per trigger. A double-buffered property
+     * (see static_simple_prop and dynamic_simple_prop) uploads into a
+     * back buffer so the next sequence can be sent while the current
+     * one plays. A stream_prop plays sequences longer than its buffer.
+     *
      * @tparam T        property value type
      ************************************************************************/
     template <typename T>
-    class simple_prop : public prop_any_base<T> {
+    class simple_prop : public prop_any_base<T>, protected timer_entry {
         // TODO: use ATOMIC_BLOCK found in avr-libc <util/atomic.h> or mutex
      public:
         using BaseT = prop_any_base<T>;
@@ -158,10 +296,13 @@ namespace rdl {
         using BaseT::logger_;
         using BaseT::logger;
 
-        simple_prop(simple_prop<T>& lvalue)  = default;
-        simple_prop(simple_prop<T>&& rvalue) = default;
+        // a copy would carry a scheduled set_at() it is not queued for
+        simple_prop(const simple_prop<T>& lvalue) = delete;
+        simple_prop(simple_prop<T>&& rvalue)      = delete;
 
-        virtual ~simple_prop() {}
+        virtual ~simple_prop() {
+            timer_queue::instance().cancel(*this);
+        }
 
         ////// IMPLEMENT INTERFACE //////
         virtual T get() const override {
@@ -178,24 +319,59 @@ namespace rdl {
                 logger_->println(brief_ + " simple prop set = " + sys::to_string(value));
             }
     #endif
-            value_ = value;
+            bool changed = !(value_ == value);
+            value_       = value;
+            if (changed)
+                BaseT::push(value);
+        }
+        /** A later scheduled set replaces one still pending */
+        virtual bool set_at(const T value, uint32_t at_us) override {
+            scheduled_value_ = value;
+            timer_queue::instance().schedule(*this, at_us);
+            return true;
         }
         virtual long max_size() const override {
-            return sequence_.max_size();
+            return sequence_[upload()].max_size();
         }
+        /** Number of values uploaded since the last clear() */
         virtual long size() const override {
-            return size_;
+            return size_[upload()];
         }
         virtual long clear() override {
-            size_       = 0;
-            next_index_ = 0;
+            if (double_buffered()) {
+                // rewriting the back buffer cancels a publish at wrap
+                swap_pending_ = false;
+                back_loaded_  = true;
+            } else {
+                next_index_ = 0;
+            }
+            size_[upload()] = 0;
             return 0;
         }
         virtual void add(const T value) override {
-            if (size_ < sequence_.max_size())
-                sequence_[size_++] = value;
+            int up = upload();
+            if (size_[up] < sequence_[up].max_size())
+                sequence_[up][size_[up]++] = value;
+            back_loaded_ = double_buffered();
         }
+        /**
+         * Start playing the sequence from the beginning. When double
+         * buffered, a newly uploaded sequence is published now if stopped,
+         * or at the next wrap of the playing sequence if already started.
+         */
         virtual void start() override {
+            if (started_) {
+                if (back_loaded_) {
+                    back_loaded_  = false;
+                    swap_pending_ = true;
+                    return;
+                }
+            } else if (back_loaded_ || swap_pending_) {
+                // also a publish that stop() cut short before its wrap
+                back_loaded_  = false;
+                swap_pending_ = false;
+                front_        = front_ ^ 1;
+            }
             next_index_ = 0;
             started_    = true;
         }
@@ -203,45 +379,196 @@ namespace rdl {
             started_ = false;
         }
         virtual bool sequencable() const override {
-            return sequence_.max_size() > 0;
+            return sequence_[0].max_size() > 0;
         }
         virtual bool read_only() const override {
             return read_only_;
         }
 
+        /**
+         * Play the next sequence value into the property value, e.g. from
+         * a trigger interrupt. Wraps at the end of the sequence, where a
+         * pending double-buffered upload becomes the playing sequence.
+         * Played values are not pushed to subscribed clients.
+         *
+         * @return false if stopped or the playing sequence is empty
+         */
+        virtual bool step() {
+            if (!started_)
+                return false;
+            int fr = front_;
+            if (size_[fr] == 0)
+                return false;
+            // explicit loads and stores: the members are volatile
+            long next = next_index_;
+            value_    = sequence_[fr][next];
+            if (++next >= size_[fr]) {
+                next = 0;
+                if (swap_pending_) {
+                    // only place the playing buffer changes while started
+                    front_        = fr ^ 1;
+                    swap_pending_ = false;
+                }
+            }
+            next_index_ = next;
+            return true;
+        }
+
+        /** Uploads fill a back buffer while the front buffer plays */
+        bool double_buffered() const {
+            return sequence_[1].max_size() > 0;
+        }
+
      protected:
         simple_prop(const sys::StringT& brief_name, const T initial, bool read_only = false)
             : BaseT(brief_name), value_(initial), read_only_(read_only), next_index_(0),
-              size_(0), started_(false), sequence_() {
+              started_(false), front_(0), back_loaded_(false), swap_pending_(false), scheduled_value_(initial) {
+            size_[0] = size_[1] = 0;
+        }
+
+        /** Scheduled set is due */
+        virtual void fire() override {
+            set(scheduled_value_);
+        }
+
+        /** Buffer that clear() and add() write to */
+        int upload() const {
+            return double_buffered() ? front_ ^ 1 : front_;
         }
 
         T value_;
         bool read_only_;
         volatile long next_index_;
-        long size_;
         volatile bool started_;
-        arraybuf<T,long> sequence_;
+        arraybuf<T, long> sequence_[2]; ///< [front_] plays, the other is the back buffer if double buffered
+        long size_[2];
+        volatile uint8_t front_;
+        volatile bool back_loaded_;  ///< back buffer changed since the last start()
+        volatile bool swap_pending_; ///< publish the back buffer at the next wrap
+        T scheduled_value_;          ///< value for a pending set_at()
     };
 
-    template <typename T, long MAX_SEQUENCE_SIZE>
+    /**
+     * simple_prop with static sequence storage.
+     * @tparam DOUBLE_BUFFERED  upload a new sequence while the current one plays
+     */
+    template <typename T, long MAX_SEQUENCE_SIZE, bool DOUBLE_BUFFERED = false>
     class static_simple_prop : public simple_prop<T> {
      public:
         static_simple_prop(const sys::StringT& brief_name, const T initial, bool read_only = false)
             : simple_prop<T>(brief_name, initial, read_only) {
             // Initialized after base class
-            simple_prop<T>::sequence_ = std::move(static_sequence_);
+            for (int i = 0; i < (DOUBLE_BUFFERED ? 2 : 1); i++)
+                simple_prop<T>::sequence_[i] = std::move(static_sequence_[i]);
         }
 
      protected:
-        static_arraybuf<T, MAX_SEQUENCE_SIZE,long> static_sequence_;
+        static_arraybuf<T, MAX_SEQUENCE_SIZE, long> static_sequence_[DOUBLE_BUFFERED ? 2 : 1];
     };
 
     template <typename T>
     class dynamic_simple_prop : public simple_prop<T> {
      public:
-        dynamic_simple_prop(const sys::StringT& brief_name, const T initial, long max_sequence_size, bool read_only = false)
+        dynamic_simple_prop(const sys::StringT& brief_name, const T initial, long max_sequence_size, bool read_only = false,
+                            bool double_buffered = false)
             : simple_prop<T>(brief_name, initial, read_only) {
-            simple_prop<T>::sequence_ = std::move(dynamic_arraybuf<T,long>(max_sequence_size));
+            simple_prop<T>::sequence_[0] = std::move(dynamic_arraybuf<T, long>(max_sequence_size));
+            if (double_buffered)
+                simple_prop<T>::sequence_[1] = std::move(dynamic_arraybuf<T, long>(max_sequence_size));
+        }
+    };
+
+    /************************************************************************
+     * Sequencable property that streams its sequence through a ring buffer.
+     *
+     * Each step() consumes the oldest value while the client keeps adding
+     * new ones, so a sequence can be much longer than the buffer. The
+     * client asks for credit() ("%brief") and never adds more values than
+     * granted. max_size() reports SERVERPROP_STREAM_MAX_SIZE so the client
+     * accepts long sequences; size() is the number of values waiting.
+     *
+     * add() (main loop) only moves the tail and step() (interrupt) only
+     * moves the head, so one producer and one consumer need no lock.
+     *
+     * @tparam T        property value type
+     ************************************************************************/
+    template <typename T>
+    class stream_prop : public simple_prop<T> {
+     public:
+        using BaseT = simple_prop<T>;
+        using typename BaseT::RootT;
+
+        virtual long max_size() const override {
+            return BaseT::sequencable() ? SERVERPROP_STREAM_MAX_SIZE : 0;
+        }
+        /** Values added but not yet played */
+        virtual long size() const override {
+            return static_cast<long>(tail_ - head_);
+        }
+        virtual long credit() const override {
+            return ring().max_size() - size();
+        }
+        /** Discard waiting values. Only while stopped, as it moves the head. */
+        virtual long clear() override {
+            head_ = tail_;
+            return 0;
+        }
+        /** Drops the value if the client overran its credit */
+        virtual void add(const T value) override {
+            unsigned long tail = tail_;
+            if (static_cast<long>(tail - head_) >= ring().max_size())
+                return;
+            ring()[static_cast<long>(tail % ring().max_size())] = value;
+            tail_ = tail + 1;
+        }
+        virtual void start() override {
+            BaseT::started_ = true;
+        }
+
+        /**
+         * Play the oldest waiting value into the property value.
+         * @return false if stopped or the buffer ran dry (underrun). The
+         *         property keeps its last value on underrun.
+         */
+        virtual bool step() override {
+            unsigned long head = head_;
+            if (!BaseT::started_ || head == tail_)
+                return false;
+            BaseT::value_ = ring()[static_cast<long>(head % ring().max_size())];
+            head_         = head + 1;
+            return true;
+        }
+
+     protected:
+        stream_prop(const sys::StringT& brief_name, const T initial, bool read_only = false)
+            : BaseT(brief_name, initial, read_only), head_(0), tail_(0) {}
+
+        arraybuf<T, long>& ring() { return BaseT::sequence_[0]; }
+        const arraybuf<T, long>& ring() const { return BaseT::sequence_[0]; }
+
+        volatile unsigned long head_; ///< values played, only step() changes it
+        volatile unsigned long tail_; ///< values added, only add() changes it
+    };
+
+    /** stream_prop with a static ring buffer of RING_SIZE values */
+    template <typename T, long RING_SIZE>
+    class static_stream_prop : public stream_prop<T> {
+     public:
+        static_stream_prop(const sys::StringT& brief_name, const T initial, bool read_only = false)
+            : stream_prop<T>(brief_name, initial, read_only) {
+            stream_prop<T>::sequence_[0] = std::move(static_ring_);
+        }
+
+     protected:
+        static_arraybuf<T, RING_SIZE, long> static_ring_;
+    };
+
+    template <typename T>
+    class dynamic_stream_prop : public stream_prop<T> {
+     public:
+        dynamic_stream_prop(const sys::StringT& brief_name, const T initial, long ring_size, bool read_only = false)
+            : stream_prop<T>(brief_name, initial, read_only) {
+            stream_prop<T>::sequence_[0] = std::move(dynamic_arraybuf<T, long>(ring_size));
         }
     };
 
@@ -318,9 +645,36 @@ namespace rdl {
             }
     #endif
             if (chan >= 0 && chan < num_channels_) {
+                if (!BaseT::subscribed()) {
+                    channels_[chan]->set(value);
+                    return;
+                }
+                // push the value the channel actually took
+                T oldv = channels_[chan]->get();
                 channels_[chan]->set(value);
+                T newv = channels_[chan]->get();
+                if (!(newv == oldv))
+                    BaseT::push(newv, chan);
+            }
+        }
+        /** Scheduled sets are pushed by the channel, not as "=brief" with a channel */
+        virtual bool set_at(const T value, uint32_t at_us, int chan) override {
+            if (chan < 0 || chan >= num_channels_)
+                return false;
+            return channels_[chan]->set_at(value, at_us);
+        }
+        /** Add an array of channel values to a "$" device snapshot */
+        virtual bool snapshot(JsonObject values) override {
+            JsonArray chans = values.createNestedArray(brief_.c_str());
+            if (chans.isNull())
+                return false;
+            for (int i = 0; i < num_channels_; i++) {
+                if (!chans.add(channels_[i]->get()))
+                    return false;
             }
+            return true;
         }
+
         /**
          * Gets the maximum sequence size of a single chan or
          * the total number of channels if chan<0
@@ -358,6 +712,11 @@ namespace rdl {
                 return 0;
             }
         }
+        virtual long credit(int chan) const override {
+            if (chan >= 0 && chan < num_channels_)
+                return channels_[chan]->credit();
+            return 0;
+        }
         virtual long clear(int chan) override {
             if (chan >= 0 && chan < num_channels_) {
     #if SERVERPROP_LOGGING
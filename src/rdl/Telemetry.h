@@ -0,0 +1,285 @@
+/*!
+ *  @file Telemetry.h
+ *
+ *  Streaming of sampled read-only properties.
+ *
+ *  Polling a sensor with one "?brief" call per sample costs a round trip
+ *  each. A telemetry_stream instead samples its source property on the
+ *  server from the timer queue (TimerQueue.h) and pushes blocks of
+ *  samples. The client turns streaming on and off with a call:
+ *
+ *  | method  | signature                                            | meaning                     |
+ *  |:--------|:-----------------------------------------------------|:----------------------------|
+ *  | `/brief` | `call<bool,u32>("/brief",period_us)->bool`          | sample every period_us, 0 stops |
+ *  | `\|brief` | `notify("\|brief",index,t0_us,period_us,packed)`  | block pushed by the server  |
+ *
+ *  `index` counts samples since streaming started, so the client can spot
+ *  lost blocks. Sample i of a block was taken at server time
+ *  t0_us + i * period_us. The values are delta packed (DeltaPack.h), so
+ *  only integer properties (ADC counts, encoder positions) can stream. A
+ *  slowly changing 12-bit ADC costs one or two bytes per sample.
+ *
+ *  On the client, a telemetry_receiver decodes the blocks from the push
+ *  map and calls a delegate per sample.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __TELEMETRY_H__
+    #define __TELEMETRY_H__
+
+    #include "Arraybuf.h"
+    #include "Delegate.h"
+    #include "DeltaPack.h"
+    #include "JsonDelegate.h"
+    #include "ServerProperty.h"
+    #include "TimerQueue.h"
+    #include "std_type_traits.h"
+    #include "sys_StringT.h"
+
+    /** Longest packed block of samples in one push, in characters */
+    #ifndef TELEMETRY_MAX_TEXT
+        #define TELEMETRY_MAX_TEXT 192
+    #endif
+
+    /** Most samples a telemetry_receiver takes from one block */
+    #ifndef TELEMETRY_MAX_BLOCK
+        #define TELEMETRY_MAX_BLOCK 1024
+    #endif
+
+    /** Shortest sampling period a client may ask for */
+    #ifndef TELEMETRY_MIN_PERIOD_US
+        #define TELEMETRY_MIN_PERIOD_US 100
+    #endif
+
+namespace rdl {
+
+    /************************************************************************
+     * Server side sampler of a read-only property.
+     *
+     * Each sample calls source.get() from timer_queue::instance().poll(),
+     * so poll from loop() (json_server::check_messages() does) rather than
+     * an interrupt: full blocks are pushed from the same call. If polling
+     * falls behind by whole periods, the missed samples are skipped and
+     * the index jumps.
+     *
+     * @tparam T        integer property value type
+     ************************************************************************/
+    template <typename T>
+    class telemetry_stream : protected timer_entry {
+        static_assert(std::is_integral<T>::value, "telemetry values are delta packed integers");
+
+     public:
+        using SourceT = prop_any_base<T>;
+        /** publisher("|brief", index, t0_us, period_us, packed) */
+        using publish_delegate = delegate<int, const char*, unsigned long, uint32_t, uint32_t, const char*>;
+
+        virtual ~telemetry_stream() {
+            timer_queue::instance().cancel(*this);
+        }
+
+        /**
+         * Sample every period_us ("/brief"), or stop with 0. Samples
+         * waiting in an unfinished block are dropped.
+         * @return false if not published or period_us is too short
+         */
+        bool start(uint32_t period_us) {
+            timer_queue::instance().cancel(*this);
+            count_  = 0;
+            period_ = period_us;
+            if (period_us == 0)
+                return true;
+            if (period_us < TELEMETRY_MIN_PERIOD_US || publisher_ == publish_delegate())
+                return false;
+            next_index_ = 0;
+            timer_queue::instance().schedule(*this, sys::micros());
+            return true;
+        }
+
+        bool streaming() const { return queued(); }
+
+        /** Push the samples taken so far, even if the block is not full */
+        int flush() {
+            int err = ERROR_OK;
+            while (count_ > 0 && err == ERROR_OK)
+                err = push_block();
+            return err;
+        }
+
+        /** Blocks that could not be sent */
+        unsigned long dropped_blocks() const { return dropped_; }
+
+        /** Push blocks through server->notify(). Use json_server::publish(telemetry) */
+        template <class ServerT>
+        void publish_to(ServerT* server) {
+            publisher_   = publish_delegate::template create<ServerT, &ServerT::template notify<unsigned long, uint32_t, uint32_t, const char*>>(server);
+            push_method_ = source_.message('|');
+        }
+
+        SourceT& source() { return source_; }
+
+     protected:
+        telemetry_stream(SourceT& source)
+            : source_(source), publisher_(), push_method_(), period_(0), count_(0),
+              first_index_(0), next_index_(0), first_time_(0), dropped_(0) {}
+
+        /** Take one sample, push a full block, then schedule the next sample */
+        virtual void fire() override {
+            uint32_t now = timer_queue::instance().now();
+            uint32_t due = timer_entry::due();
+            uint32_t missed = static_cast<uint32_t>(now - due) / period_;
+            if (missed > 0) {
+                // polled too late: the block timing must stay regular
+                flush();
+                next_index_ += missed;
+                due += missed * period_;
+            }
+            if (count_ == 0) {
+                first_index_ = next_index_;
+                first_time_  = due;
+            }
+            samples_[count_++] = source_.get();
+            next_index_++;
+            if (count_ >= samples_.max_size())
+                flush();
+            timer_queue::instance().schedule(*this, due + period_);
+        }
+
+        /** Push as many waiting samples as fit in one packed string */
+        int push_block() {
+            char text[TELEMETRY_MAX_TEXT + 1];
+            size_t packed;
+            delta_pack(text, sizeof(text), samples_.data(), static_cast<size_t>(count_), packed);
+            int err = ERROR_OK;
+            if (packed == 0) {
+                packed = count_; // TELEMETRY_MAX_TEXT too small for one value
+                dropped_++;
+            } else {
+                err = publisher_(push_method_.c_str(), first_index_, first_time_, period_, text);
+                if (err != ERROR_OK)
+                    dropped_++;
+            }
+            // keep the samples that did not fit for the next block
+            for (long i = static_cast<long>(packed); i < count_; i++)
+                samples_[i - static_cast<long>(packed)] = samples_[i];
+            count_ -= static_cast<long>(packed);
+            first_index_ += packed;
+            first_time_ += static_cast<uint32_t>(packed) * period_;
+            return err;
+        }
+
+        SourceT& source_;
+        publish_delegate publisher_;
+        sys::StringT push_method_;
+        arraybuf<T, long> samples_; ///< current block
+        uint32_t period_;
+        long count_;                ///< samples in the current block
+        unsigned long first_index_; ///< index of samples_[0]
+        unsigned long next_index_;  ///< index of the next sample
+        uint32_t first_time_;       ///< server time of samples_[0]
+        unsigned long dropped_;
+    };
+
+    /** telemetry_stream with static block storage */
+    template <typename T, long BLOCK_SIZE>
+    class static_telemetry_stream : public telemetry_stream<T> {
+     public:
+        static_telemetry_stream(prop_any_base<T>& source) : telemetry_stream<T>(source) {
+            // Initialized after base class
+            telemetry_stream<T>::samples_ = std::move(static_samples_);
+        }
+
+     protected:
+        static_arraybuf<T, BLOCK_SIZE, long> static_samples_;
+    };
+
+    template <typename T>
+    class dynamic_telemetry_stream : public telemetry_stream<T> {
+     public:
+        dynamic_telemetry_stream(prop_any_base<T>& source, long block_size) : telemetry_stream<T>(source) {
+            telemetry_stream<T>::samples_ = std::move(dynamic_arraybuf<T, long>(block_size));
+        }
+    };
+
+    /**
+     * Add the "/brief" start/stop method of a telemetry stream to a
+     * dispatch map. Publish the stream with json_server::publish().
+     * @return size_t       number of methods added to the dispatch table
+     */
+    template <class MapT, typename T>
+    size_t add_to(MapT& map, telemetry_stream<T>& telemetry) {
+        using PairT      = typename MapT::value_type;
+        using StartT     = json_delegate<bool, uint32_t>;
+        size_t startsize = map.size();
+        map.insert(PairT(
+            telemetry.source().message('/'), // start/stop sampling
+            StartT::template create<telemetry_stream<T>, &telemetry_stream<T>::start>(&telemetry).stub()));
+        return map.size() - startsize;
+    }
+
+    /************************************************************************
+     * Client side decoder of telemetry blocks.
+     *
+     * Add it to the client's push map, then start streaming:
+     * @code{.cpp}
+     * using ReceiverT = telemetry_receiver<int>;
+     * ReceiverT adc(ReceiverT::sample_delegate::create<Logger, &Logger::sample>(&logger));
+     * adc.add_to(push_map, "adc");
+     * client.push_map(push_map);
+     * client.call_get("/adc", ok, 1000UL); // 1 kHz
+     * ... client.check_messages() delivers the samples
+     * @endcode
+     *
+     * @tparam T        integer property value type
+     ************************************************************************/
+    template <typename T>
+    class telemetry_receiver {
+     public:
+        /** on_sample(index, server_us, value) */
+        using sample_delegate = delegate<void, unsigned long, uint32_t, T>;
+
+        explicit telemetry_receiver(sample_delegate on_sample)
+            : on_sample_(on_sample), next_index_(0), received_(0), lost_(0) {}
+
+        /** Push handler for "|brief" */
+        void on_block(unsigned long index, uint32_t t0_us, uint32_t period_us, const char* packed) {
+            if (received_ > 0 && index > next_index_)
+                lost_ += index - next_index_;
+            unsigned long i = index;
+            long count      = delta_unpack(packed, TELEMETRY_MAX_BLOCK, [&](long v) {
+                on_sample_(i, t0_us + static_cast<uint32_t>(i - index) * period_us, static_cast<T>(v));
+                i++;
+            });
+            if (count < 0)
+                return; // corrupt block, the next one shows the gap
+            received_ += static_cast<unsigned long>(count);
+            next_index_ = i;
+        }
+
+        /** Route "|brief" pushes to this receiver */
+        template <class MapT>
+        void add_to(MapT& push_map, const sys::StringT& brief) {
+            using PairT  = typename MapT::value_type;
+            using BlockT = json_delegate<void, unsigned long, uint32_t, uint32_t, const char*>;
+            push_map.insert(PairT(sys::StringT("|") + brief,
+                                  BlockT::template create<telemetry_receiver<T>, &telemetry_receiver<T>::on_block>(this).stub()));
+        }
+
+        unsigned long received() const { return received_; }
+        /** Samples missing between received blocks */
+        unsigned long lost() const { return lost_; }
+
+     protected:
+        sample_delegate on_sample_;
+        unsigned long next_index_;
+        unsigned long received_;
+        unsigned long lost_;
+    };
+
+} // namespace rdl
+
+#endif // __TELEMETRY_H__
@@ -0,0 +1,149 @@
+/*!
+ *  @file TimerQueue.h
+ *
+ *  Timed actions on the server, such as scheduled property sets.
+ *
+ *  A timer_queue is a list of timer_entry objects sorted by due time in
+ *  sys::micros(). Entries are members of the objects that own them (e.g.
+ *  each simple_prop has one for its scheduled set), so the queue never
+ *  allocates. poll() fires every entry that is due. json_server polls the
+ *  default queue on every check_messages(); for tighter timing also call
+ *  poll() from loop() or arm a hardware timer with next_due().
+ *
+ *  Times are 32-bit microseconds and wrap every ~71.6 minutes, so due
+ *  times must lie within ~35 minutes of now.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __TIMERQUEUE_H__
+    #define __TIMERQUEUE_H__
+
+    #include "sys_timing.h"
+    #include <stddef.h> // for size_t
+    #include <stdint.h> // for uint32_t, int32_t
+
+namespace rdl {
+
+    namespace svc {
+        /** Wrap-safe "a comes before b" for 32-bit microsecond times */
+        inline bool time_before(uint32_t a, uint32_t b) {
+            return static_cast<int32_t>(a - b) < 0;
+        }
+    }; // namespace svc
+
+    class timer_queue;
+
+    /************************************************************************
+     * An action to run at a given time. Owners derive from timer_entry and
+     * implement fire(). An entry is in at most one queue at a time.
+     ************************************************************************/
+    class timer_entry {
+     public:
+        timer_entry() : next_(nullptr), due_(0), queued_(false) {}
+        virtual ~timer_entry() {}
+
+        // the queue links entries by address, so a copy would share the link
+        timer_entry(const timer_entry&)            = delete;
+        timer_entry& operator=(const timer_entry&) = delete;
+
+        /** Called by timer_queue::poll() once the due time is reached */
+        virtual void fire() = 0;
+
+        uint32_t due() const { return due_; }
+        bool queued() const { return queued_; }
+
+     protected:
+        friend class timer_queue;
+        timer_entry* next_;
+        uint32_t due_;
+        bool queued_;
+    };
+
+    /************************************************************************
+     * Time-ordered intrusive list of timer entries.
+     *
+     * Not interrupt safe: schedule() and poll() must not run at the same
+     * time, so poll from loop() or disable interrupts around schedule().
+     ************************************************************************/
+    class timer_queue {
+     public:
+        timer_queue() : head_(nullptr), now_(0) {}
+
+        /** Default queue for scheduled property sets */
+        static timer_queue& instance() {
+            static timer_queue queue;
+            return queue;
+        }
+
+        /** Queue entry at due, moving it if it was already queued */
+        void schedule(timer_entry& entry, uint32_t due) {
+            cancel(entry);
+            entry.due_        = due;
+            timer_entry** pos = &head_;
+            // entries due at the same time fire in scheduling order
+            while (*pos && !svc::time_before(due, (*pos)->due_))
+                pos = &(*pos)->next_;
+            entry.next_   = *pos;
+            *pos          = &entry;
+            entry.queued_ = true;
+        }
+
+        void cancel(timer_entry& entry) {
+            if (!entry.queued_)
+                return;
+            for (timer_entry** pos = &head_; *pos; pos = &(*pos)->next_) {
+                if (*pos == &entry) {
+                    *pos = entry.next_;
+                    break;
+                }
+            }
+            entry.next_   = nullptr;
+            entry.queued_ = false;
+        }
+
+        /**
+         * Fire every entry due at or before now.
+         * @return number of entries fired
+         */
+        size_t poll(uint32_t now) {
+            size_t fired = 0;
+            now_         = now;
+            while (head_ && !svc::time_before(now, head_->due_)) {
+                timer_entry* entry = head_;
+                head_              = entry->next_;
+                entry->next_       = nullptr;
+                entry->queued_     = false;
+                entry->fire(); // may schedule again
+                fired++;
+            }
+            return fired;
+        }
+
+        size_t poll() { return head_ ? poll(sys::micros()) : 0; }
+
+        /** @return false if the queue is empty, otherwise sets due to the earliest due time */
+        bool next_due(uint32_t& due) const {
+            if (!head_)
+                return false;
+            due = head_->due_;
+            return true;
+        }
+
+        bool empty() const { return head_ == nullptr; }
+
+        /** Time given to the last poll(), for fire() to measure lateness against */
+        uint32_t now() const { return now_; }
+
+     protected:
+        timer_entry* head_;
+        uint32_t now_;
+    };
+
+} // namespace rdl
+
+#endif // __TIMERQUEUE_H__
@@ -0,0 +1,165 @@
+/*!
+ *  @file TxPriority.h
+ *
+ *  Prioritized access to a shared client link.
+ *
+ *  Several threads may share one json_client, e.g. a Micro-Manager hub
+ *  whose devices are driven from the UI and acquisition threads. Each
+ *  call or notify is one transaction on the link. A transaction from a
+ *  control thread (stop, shutter close) must not wait behind a whole
+ *  sequence upload, so bulk transfers mark themselves with a bulk_scope
+ *  and the gate hands the link to waiting control transactions first.
+ *  Bulk uploads release the link after every frame, so control traffic
+ *  waits for at most one bulk transaction: a notify write or a credit
+ *  call round trip.
+ *
+ *  Bytes already written cannot be recalled, so the server still handles
+ *  bulk frames sitting in its input buffer first. Credit flow control
+ *  (see RemoteProp.h) keeps that backlog short.
+ *
+ *  Single threaded (Arduino) builds compile the gate to nothing.
+ *
+ *  @section license License
+ *
+ *  MIT license, all text above must be included in any redistribution
+ */
+
+#pragma once
+
+#ifndef __TXPRIORITY_H__
+    #define __TXPRIORITY_H__
+
+    #include <stdint.h> // for uint8_t
+
+    /** Serialize client transactions by priority. Needs threads (host builds). */
+    #ifndef JSONRPC_TX_PRIORITY
+        #ifdef ARDUINO
+            #define JSONRPC_TX_PRIORITY 0
+        #else
+            #define JSONRPC_TX_PRIORITY 1
+        #endif
+    #endif
+
+    #if JSONRPC_TX_PRIORITY
+        #include <condition_variable>
+        #include <mutex>
+        #include <thread>
+    #endif
+
+namespace rdl {
+
+    /** Transmit class of a client transaction */
+    enum class tx_priority : uint8_t {
+        control = 0, ///< goes out at the next frame boundary
+        bulk    = 1, ///< sequence uploads and other long transfers
+    };
+
+    #if JSONRPC_TX_PRIORITY
+
+    namespace svc {
+        /** Priority of the calling thread's transactions */
+        inline tx_priority& tx_thread_priority() {
+            static thread_local tx_priority priority = tx_priority::control;
+            return priority;
+        }
+
+        /**
+         * Priority lock over a client link. Waiting control transactions
+         * always go before waiting bulk ones. Reentrant, so a push handler
+         * may use the client again. Clients hold pushes back until no
+         * reply is outstanding (see json_client::dispatch_queued()).
+         */
+        class tx_gate {
+         public:
+            tx_gate() : owner_(), depth_(0) {
+                waiting_[0] = waiting_[1] = 0;
+            }
+
+            void lock(tx_priority priority) {
+                std::unique_lock<std::mutex> lk(mutex_);
+                if (depth_ > 0 && owner_ == std::this_thread::get_id()) {
+                    depth_++;
+                    return;
+                }
+                int p = static_cast<int>(priority);
+                waiting_[p]++;
+                cond_.wait(lk, [&]() {
+                    return depth_ == 0 && (priority == tx_priority::control || waiting_[0] == 0);
+                });
+                waiting_[p]--;
+                owner_ = std::this_thread::get_id();
+                depth_ = 1;
+            }
+
+            void unlock() {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (--depth_ == 0)
+                    cond_.notify_all();
+            }
+
+            /** Holds the gate for one transaction at the thread's priority */
+            class guard {
+             public:
+                explicit guard(tx_gate& gate) : gate_(gate) { gate_.lock(tx_thread_priority()); }
+                ~guard() { gate_.unlock(); }
+                guard(const guard&)            = delete;
+                guard& operator=(const guard&) = delete;
+
+             protected:
+                tx_gate& gate_;
+            };
+
+         protected:
+            std::mutex mutex_;
+            std::condition_variable cond_;
+            std::thread::id owner_;
+            int depth_;
+            int waiting_[2];
+        };
+    } // namespace svc
+
+    /**
+     * Mark the calling thread's client transactions as bulk traffic
+     * until the scope ends.
+     * @code{.cpp}
+     * {
+     *     rdl::bulk_scope bulk;
+     *     for (...)
+     *         client.notify("+brief", value); // yields to control calls
+     * }
+     * @endcode
+     */
+    class bulk_scope {
+     public:
+        bulk_scope() : previous_(svc::tx_thread_priority()) { svc::tx_thread_priority() = tx_priority::bulk; }
+        ~bulk_scope() { svc::tx_thread_priority() = previous_; }
+        bulk_scope(const bulk_scope&)            = delete;
+        bulk_scope& operator=(const bulk_scope&) = delete;
+
+     protected:
+        tx_priority previous_;
+    };
+
+    #else // !JSONRPC_TX_PRIORITY
+
+    namespace svc {
+        /** Single threaded: transactions never overlap */
+        class tx_gate {
+         public:
+            void lock(tx_priority) {}
+            void unlock() {}
+
+            class guard {
+             public:
+                explicit guard(tx_gate&) {}
+            };
+        };
+    } // namespace svc
+
+    class bulk_scope {};
+
+    #endif // JSONRPC_TX_PRIORITY
+
+} // namespace rdl
+
+#endif // __TXPRIORITY_H__
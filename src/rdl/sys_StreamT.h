@@ -20,6 +20,11 @@ namespace sys {
     #else // NOT ARDUINO
         #include "Polyfills/Stream_Mock.h"
         #include "Polyfills/Stream_MockIOS.h"
+        #include "Polyfills/Stream_Loopback.h"
+        #if defined(__unix__) || defined(__APPLE__)
+            #include "Polyfills/Stream_PosixSerial.h"
+            #include "Polyfills/Stream_Socket.h"
+        #endif
 namespace sys {
     using StreamT = sys::Stream;
     // don't define Stream_xxxxT type aliases for other print mocks
@@ -3,7 +3,7 @@
 #ifndef __SYS_TIMING_H__
     #define __SYS_TIMING_H__
 
-    #include <ctype.h> // for uint32_t;
+    #include <stdint.h> // for uint32_t, uint64_t
 
     #ifdef __has_include
         #if __has_include(<Arduino.h>)
@@ -16,24 +16,67 @@ namespace sys {
     constexpr auto delayMicroseconds = ::delayMicroseconds;
     constexpr auto millis = ::millis;
     constexpr auto micros = ::micros;
+    /** Arduino has no nanosecond clock. Resolution is micros() and wraps with it. */
+    inline uint64_t nanos(void) { return static_cast<uint64_t>(::micros()) * 1000ULL; }
 } // namespace
         #else
             #include <chrono>
             #include <thread>
+
+            /**
+             * Host delayMicroseconds sleeps for all but the last SYS_TIMING_SPIN_USEC
+             * microseconds of the delay, then spins on the clock for the remainder.
+             * OS sleep granularity is typically 50-100 us or worse, so short delays
+             * are spun entirely.
+             */
+            #ifndef SYS_TIMING_SPIN_USEC
+                #define SYS_TIMING_SPIN_USEC 200
+            #endif
+
 namespace sys {
+    namespace svc {
+        /** Monotonic clock used for all host timing. Never jumps with wall-clock changes. */
+        using clock_t = std::chrono::steady_clock;
+
+        /**
+         * Host time base. Like an Arduino, millis() and micros() count from
+         * (roughly) program start, so the 32-bit counters wrap at predictable
+         * intervals (~49.7 days and ~71.6 minutes) instead of arbitrarily.
+         */
+        inline clock_t::time_point epoch() {
+            static const clock_t::time_point start = clock_t::now();
+            return start;
+        }
+
+        template <class DurationT>
+        inline typename DurationT::rep since_epoch() {
+            return std::chrono::duration_cast<DurationT>(clock_t::now() - epoch()).count();
+        }
+    } // namespace svc
+
     inline void yield(void) { std::this_thread::yield(); }
     inline void delay(uint32_t msec) { std::this_thread::sleep_for(std::chrono::milliseconds(msec)); }
-    inline void delayMicroseconds(uint32_t usec) { std::this_thread::sleep_for(std::chrono::milliseconds(usec / 1000)); }
+    inline void delayMicroseconds(uint32_t usec) {
+        const svc::clock_t::time_point deadline = svc::clock_t::now() + std::chrono::microseconds(usec);
+        if (usec > SYS_TIMING_SPIN_USEC) {
+            std::this_thread::sleep_for(std::chrono::microseconds(usec - SYS_TIMING_SPIN_USEC));
+        }
+        while (svc::clock_t::now() < deadline) {
+            // spin out the remainder
+        }
+    }
     inline uint32_t millis(void) {
-        auto now = std::chrono::system_clock::now().time_since_epoch();
-        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+        return static_cast<uint32_t>(svc::since_epoch<std::chrono::milliseconds>());
     }
     inline uint32_t micros(void) {
-        auto now = std::chrono::system_clock::now().time_since_epoch();
-        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+        return static_cast<uint32_t>(svc::since_epoch<std::chrono::microseconds>());
+    }
+    /** 64-bit nanosecond counter for profiling. Does not wrap in practice. */
+    inline uint64_t nanos(void) {
+        return static_cast<uint64_t>(svc::since_epoch<std::chrono::nanoseconds>());
     }
 } // namespace
         #endif
     #endif
 
-#endif // __SYS_TIMING_H__
\ No newline at end of file
+#endif // __SYS_TIMING_H__
@@ -125,7 +125,7 @@ namespace rdlmm {
          */
         virtual int notifyChange(const PropT& value) {
             if (notifyChangeFunc_) {
-                return (device_->*notifyChangeFunc_)(name_.c_str(), ToString(value).c_str());
+                return (device_->*notifyChangeFunc_)(name_.c_str(), ToChars(value).c_str());
             }
             return DEVICE_OK;
         }
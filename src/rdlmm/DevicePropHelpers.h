@@ -5,51 +5,17 @@
     #define __DEVICEPROPHELPERS_H__
 
     #include "../rdl/sys_StringT.h"
+    #include "PropCharconv.h"
     
     #define NOMINMAX
     //#include "DeviceBase.h"
     //#include <MMDevice.h>
     //#include <limits>
-    #include <map>
     #include <string>
     #include <type_traits>
 
 namespace rdlmm {
 
-    /*******************************************************************
-    * enable_if switches for MM::PropertyTypes
-    *******************************************************************/
-    /** type test for signed or unsigned integer that can be safely cast as long */
-    template <typename T>
-    struct is_mm_integral { static constexpr bool value = std::is_integral<T>::value && sizeof(T) <= sizeof(long); };
-
-    /** type test for float or double */
-    template <typename T>
-    struct is_mm_floating_point { static constexpr bool value = std::is_floating_point<T>::value; };
-
-    /** type test for reading or writing sys::StringT */
-    template <typename T>
-    struct is_mm_string { static constexpr bool value = std::is_base_of<sys::StringT, T>::value; };
-
-    /** type test for reading null terminated strings (const char*).
-	* @note we cannot use these for writing as we do not know the size of char* buffer.	*/
-    template <typename T>
-    struct is_mm_c_str { static constexpr bool value =
-                             std::is_same<typename std::decay<T>::type, char*>::value ||
-                             std::is_same<typename std::decay<T>::type, const char*>::value; };
-
-    /** type test for combined mm assignable */
-    template <typename T>
-    struct is_mm_lvalue {
-        static constexpr bool value = is_mm_integral<T>::value || is_mm_floating_point<T>::value || is_mm_string<T>::value;
-    };
-
-    /** type test for combined mm readable */
-    template <typename T>
-    struct is_mm_rvalue {
-        static constexpr bool value = is_mm_integral<T>::value || is_mm_floating_point<T>::value || is_mm_string<T>::value || is_mm_c_str<T>::value;
-    };
-
     /*******************************************************************
     * MM::PropertyType marshalling
     * 
@@ -78,47 +44,40 @@ namespace rdlmm {
 
     /*******************************************************************
     * mm values from strings
+    *
+    * Returns 0 for unparsable numbers. Use TryParse or ParseSequence
+    * (PropCharconv.h) to detect bad input.
     *******************************************************************/
-    template <class T, typename std::enable_if<is_mm_integral<T>::value, bool>::type = true>
-    inline typename T Parse(const sys::StringT& str) {
-        std::stringstream parser(str);
-        long temp = 0;
-        parser >> temp;
-        return static_cast<T>(temp);
-    }
-
-    /** Parse a floating point value from a sys::StringT */
-    template <class T, typename std::enable_if<is_mm_floating_point<T>::value, bool>::type = true>
-    inline typename T Parse(const sys::StringT& str) {
-        std::stringstream parser(str);
-        double temp = 0;
-        parser >> temp;
-        return static_cast<T>(temp);
+    template <class T, typename std::enable_if<is_mm_integral<T>::value || is_mm_floating_point<T>::value, bool>::type = true>
+    inline T Parse(const sys::StringT& str) {
+        T value = 0;
+        TryParse(str, value);
+        return value;
     }
 
     /** Parse a string from a sys::StringT */
     template <class T, typename std::enable_if<is_mm_string<T>::value, bool>::type = true>
-    inline typename T Parse(const sys::StringT& str) {
+    inline T Parse(const sys::StringT& str) {
         return str;
     }
 
     /*******************************************************************
     * strings from mm values
     * 
-    * rdl::to_string normally calls std::to_string for output
-    * but these do some type checking and coversion first
+    * Numbers are formatted with ToChars (PropCharconv.h). Prefer
+    * ToChars(value).c_str() directly when a temporary c-string will do.
     *******************************************************************/
 
     /** convert mm integral to string */
     template <class T, typename std::enable_if<is_mm_integral<T>::value, bool>::type = true>
     inline sys::StringT ToString(const T& value) {
-        return std::to_string(static_cast<long>(value));
+        return ToChars(value).c_str();
     }
 
-    /** convert mm floating point to string */
+    /** convert mm floating point to string (shortest round-trip text) */
     template <typename T, typename std::enable_if<is_mm_floating_point<T>::value, bool>::type = true>
     inline sys::StringT ToString(const T& value) {
-        return std::to_string(static_cast<double>(value));
+        return ToChars(value).c_str();
     }
 
     /** convert mm string to string (included for auto-marshalling). */
@@ -133,15 +92,21 @@ namespace rdlmm {
         return sys::StringT(value);
     }
 
+    namespace svc {
+        /** MM::PropertyType names, indexed by enum value */
+        constexpr const char* mm_property_type_names[] = {"MM::Undef", "MM::String", "MM::Float", "MM::Integer"};
+        static_assert(MM::Undef == 0 && MM::String == 1 && MM::Float == 2 && MM::Integer == 3,
+                      "mm_property_type_names out of order with MM::PropertyType");
+    }
+
+    /** name of an MM::PropertyType. No allocation or lookup. */
+    constexpr const char* PropertyTypeName(const MM::PropertyType value) {
+        return (value >= MM::Undef && value <= MM::Integer) ? svc::mm_property_type_names[value] : svc::mm_property_type_names[MM::Undef];
+    }
+
     /**  convert MM::PropertyType to sys::StringT */
-    //template <typename T, typename std::enable_if<std::is_same<T, MM::PropertyType>::value, bool>::type = true>
     inline sys::StringT ToString(const MM::PropertyType& value) {
-    #define __MAP_ENTRY(type) \
-        { type, #type } // stringize macro
-        static std::map<MM::PropertyType, const char*> types = {
-            __MAP_ENTRY(MM::Undef), __MAP_ENTRY(MM::String), __MAP_ENTRY(MM::Float), __MAP_ENTRY(MM::Integer)};
-    #undef __MAP_ENTRY
-        return types[value];
+        return PropertyTypeName(value);
     }
 
     /** convert MM::Property value to sys::StringT */
@@ -233,7 +198,7 @@ namespace rdlmm {
 	*/
     template <typename T, class DeviceT, typename std::enable_if<is_mm_rvalue<T>::value, bool>::type = true>
     inline int Assign(DeviceT* device, const char* propName, const T& value) {
-        return device->SetProperty(propName, ToString<T>(value).c_str()) ? DEVICE_OK : DEVICE_INVALID_PROPERTY_VALUE;
+        return device->SetProperty(propName, ToChars(value).c_str()) ? DEVICE_OK : DEVICE_INVALID_PROPERTY_VALUE;
     }
 
     /*******************************************************************
@@ -278,19 +243,18 @@ namespace rdlmm {
     *
     * Getting string device properties is a little unsafe in Micromanager. You can
 	* only get one by passing a char* buffer to the GetProperty method. This means
-	* the buffer must be big enough. We will use the constant MM::MaxStrLength
-	* to define the size of an intermediate buffer, temporarily create a buffer in 
-	* free memory (instead of the stack), get the property, then copy the buffer to 
-	* a string and free the buffer.
+	* the buffer must be big enough. We use a MM::MaxStrLength scratch buffer on
+	* the stack (no heap allocation), get the property, then copy the buffer to
+	* the string.
 	*/
     template <typename T, class DeviceT, typename std::enable_if<is_mm_string<T>::value, bool>::type = true>
     inline int Assign(T& value, DeviceT* device, const char* propName) {
-        char* resBuf = new char[MM::MaxStrLength];
-        int ret      = device->GetProperty(propName, resBuf);
+        char resBuf[MM::MaxStrLength];
+        resBuf[0] = 0;
+        int ret   = device->GetProperty(propName, resBuf);
         if (ret == DEVICE_OK) {
             value.assign(resBuf);
         }
-        delete resBuf;
         return ret;
     }
 
@@ -0,0 +1,289 @@
+#pragma once
+
+#ifndef __PROPCHARCONV_H__
+    #define __PROPCHARCONV_H__
+
+    #include "../rdl/sys_StringT.h"
+    #include <cerrno>
+    #include <cmath> // for HUGE_VAL
+    #include <cstdio>
+    #include <cstdlib>
+    #include <cstring>
+    #include <limits>
+    #include <type_traits>
+    #include <vector>
+
+    #if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+        #include <charconv>
+    #endif
+
+    // std::from_chars with floating point support (C++17 library, MSVC 2019, GCC 11+)
+    #if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        #define PROPCHARCONV_USE_FROM_CHARS 1
+    #else
+        #define PROPCHARCONV_USE_FROM_CHARS 0
+    #endif
+
+    /** Holds any long or shortest round-trip double ("-2.2250738585072014e-308") */
+    #ifndef PROPCHARCONV_BUFFER_SIZE
+        #define PROPCHARCONV_BUFFER_SIZE 32
+    #endif
+
+namespace rdlmm {
+
+    /*******************************************************************
+    * enable_if switches for MM::PropertyTypes
+    *******************************************************************/
+    /** type test for signed or unsigned integer that can be safely cast as long */
+    template <typename T>
+    struct is_mm_integral { static constexpr bool value = std::is_integral<T>::value && sizeof(T) <= sizeof(long); };
+
+    /** type test for float or double */
+    template <typename T>
+    struct is_mm_floating_point { static constexpr bool value = std::is_floating_point<T>::value; };
+
+    /** type test for reading or writing sys::StringT */
+    template <typename T>
+    struct is_mm_string { static constexpr bool value = std::is_base_of<sys::StringT, T>::value; };
+
+    /** type test for reading null terminated strings (const char*).
+	* @note we cannot use these for writing as we do not know the size of char* buffer.	*/
+    template <typename T>
+    struct is_mm_c_str { static constexpr bool value =
+                             std::is_same<typename std::decay<T>::type, char*>::value ||
+                             std::is_same<typename std::decay<T>::type, const char*>::value; };
+
+    /** type test for combined mm assignable */
+    template <typename T>
+    struct is_mm_lvalue {
+        static constexpr bool value = is_mm_integral<T>::value || is_mm_floating_point<T>::value || is_mm_string<T>::value;
+    };
+
+    /** type test for combined mm readable */
+    template <typename T>
+    struct is_mm_rvalue {
+        static constexpr bool value = is_mm_integral<T>::value || is_mm_floating_point<T>::value || is_mm_string<T>::value || is_mm_c_str<T>::value;
+    };
+
+    /*******************************************************************
+    * Allocation-free number parsing
+    *
+    * Accepts the same leading whitespace and optional sign that
+    * `std::stringstream >> value` does, then parses with std::from_chars
+    * when available or strtol/strtod otherwise. Neither path constructs
+    * a stream, allocates, or copies the string.
+    *******************************************************************/
+    namespace svc {
+        inline const char* skip_leading(const char* first, const char* last) {
+            while (first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r')))
+                ++first;
+            // from_chars rejects an explicit '+'
+            if (first != last && *first == '+' && (last - first) > 1 && first[1] != '-')
+                ++first;
+            return first;
+        }
+
+        /** Parse a long from a null-terminated [first,last). Returns false if no digits. */
+        inline bool parse_chars(const char* first, const char* last, long& value) {
+            first = skip_leading(first, last);
+    #if PROPCHARCONV_USE_FROM_CHARS
+            std::from_chars_result res = std::from_chars(first, last, value);
+            return res.ec == std::errc();
+    #else
+            char* end;
+            errno     = 0;
+            long temp = std::strtol(first, &end, 10);
+            if (end == first || errno == ERANGE)
+                return false;
+            value = temp;
+            return true;
+    #endif
+        }
+
+        /** Parse a double from a null-terminated [first,last). Returns false if no digits. */
+        inline bool parse_chars(const char* first, const char* last, double& value) {
+            first = skip_leading(first, last);
+    #if PROPCHARCONV_USE_FROM_CHARS
+            std::from_chars_result res = std::from_chars(first, last, value);
+            return res.ec == std::errc();
+    #else
+            char* end;
+            errno       = 0;
+            double temp = std::strtod(first, &end);
+            // from_chars also reports overflow, but returns denormals
+            if (end == first || (errno == ERANGE && (temp == HUGE_VAL || temp == -HUGE_VAL)))
+                return false;
+            value = temp;
+            return true;
+    #endif
+        }
+    } // namespace svc
+
+    /**
+     * Parse an mm integral value from a sys::StringT. Like stringstream,
+     * text after the number is ignored and values out of T's range fail.
+     * @return true on success. value is unchanged on failure.
+     */
+    template <class T, typename std::enable_if<is_mm_integral<T>::value, bool>::type = true>
+    inline bool TryParse(const sys::StringT& str, T& value) {
+        long temp;
+        if (!svc::parse_chars(str.c_str(), str.c_str() + str.length(), temp))
+            return false;
+        if (std::is_unsigned<T>::value ? temp < 0 || static_cast<unsigned long>(temp) > static_cast<unsigned long>(std::numeric_limits<T>::max())
+                                       : temp < static_cast<long>(std::numeric_limits<T>::min()) || temp > static_cast<long>(std::numeric_limits<T>::max()))
+            return false;
+        value = static_cast<T>(temp);
+        return true;
+    }
+
+    /**
+     * Parse an mm floating point value from a sys::StringT. Text after the
+     * number is ignored; values too large for T fail.
+     * @return true on success. value is unchanged on failure.
+     */
+    template <class T, typename std::enable_if<is_mm_floating_point<T>::value, bool>::type = true>
+    inline bool TryParse(const sys::StringT& str, T& value) {
+        double temp;
+        if (!svc::parse_chars(str.c_str(), str.c_str() + str.length(), temp))
+            return false;
+        if (temp > static_cast<double>(std::numeric_limits<T>::max()) || temp < -static_cast<double>(std::numeric_limits<T>::max()))
+            return false;
+        value = static_cast<T>(temp);
+        return true;
+    }
+
+    /** Parse (copy) an mm string from a sys::StringT. Always succeeds. */
+    template <class T, typename std::enable_if<is_mm_string<T>::value, bool>::type = true>
+    inline bool TryParse(const sys::StringT& str, T& value) {
+        value = str;
+        return true;
+    }
+
+    /**
+     * Parse a whole sequence of strings into a typed buffer.
+     *
+     * The buffer is cleared first but keeps its capacity, so a buffer
+     * reused across calls only allocates when a longer sequence arrives.
+     *
+     * @param strings   string values, e.g. from MM::Property::GetSequence()
+     * @param values    destination buffer, resized to the number of values parsed
+     * @return true if every element parsed. On failure values holds the
+     *         elements before the bad one.
+     */
+    template <class T, typename std::enable_if<is_mm_lvalue<T>::value, bool>::type = true>
+    inline bool ParseSequence(const std::vector<sys::StringT>& strings, std::vector<T>& values) {
+        values.clear();
+        values.reserve(strings.size());
+        T value;
+        for (const sys::StringT& str : strings) {
+            if (!TryParse(str, value))
+                return false;
+            values.push_back(value);
+        }
+        return true;
+    }
+
+    /*******************************************************************
+    * Allocation-free number formatting
+    *
+    * ToChars returns the text of a value in a small fixed buffer held
+    * by value (i.e. on the caller's stack). Floating point values use the
+    * shortest text that parses back to the same double: std::to_chars
+    * when available, otherwise %.15g with a %.17g fallback.
+    *******************************************************************/
+    namespace svc {
+        /** Formatted text of one value. Use like a string: ToChars(v).c_str() */
+        class value_chars {
+         public:
+            value_chars() : size_(0) { data_[0] = 0; }
+            const char* c_str() const { return data_; }
+            size_t length() const { return size_; }
+
+            char* data() { return data_; }
+            static constexpr size_t max_size() { return PROPCHARCONV_BUFFER_SIZE - 1; }
+            void terminate(size_t size) {
+                size_        = size;
+                data_[size_] = 0;
+            }
+
+         protected:
+            char data_[PROPCHARCONV_BUFFER_SIZE];
+            size_t size_;
+        };
+
+        /** Borrowed c-string with the same c_str() interface as value_chars */
+        class c_str_chars {
+         public:
+            explicit c_str_chars(const char* str) : str_(str) {}
+            const char* c_str() const { return str_; }
+
+         protected:
+            const char* str_;
+        };
+
+        inline void format_chars(value_chars& out, long value) {
+    #if PROPCHARCONV_USE_FROM_CHARS
+            std::to_chars_result res = std::to_chars(out.data(), out.data() + out.max_size(), value);
+            out.terminate(static_cast<size_t>(res.ptr - out.data()));
+    #else
+            // digits are generated backwards into the end of a scratch buffer
+            char scratch[PROPCHARCONV_BUFFER_SIZE];
+            char* last        = scratch + sizeof(scratch);
+            char* first       = last;
+            unsigned long mag = value < 0 ? 0UL - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+            do {
+                *--first = static_cast<char>('0' + mag % 10);
+                mag /= 10;
+            } while (mag != 0);
+            if (value < 0)
+                *--first = '-';
+            size_t size = static_cast<size_t>(last - first);
+            memcpy(out.data(), first, size);
+            out.terminate(size);
+    #endif
+        }
+
+        inline void format_chars(value_chars& out, double value) {
+    #if PROPCHARCONV_USE_FROM_CHARS
+            std::to_chars_result res = std::to_chars(out.data(), out.data() + out.max_size(), value);
+            out.terminate(static_cast<size_t>(res.ptr - out.data()));
+    #else
+            int size = snprintf(out.data(), out.max_size() + 1, "%.15g", value);
+            if (size > 0 && std::strtod(out.data(), nullptr) != value)
+                size = snprintf(out.data(), out.max_size() + 1, "%.17g", value);
+            out.terminate(size > 0 ? static_cast<size_t>(size) : 0);
+    #endif
+        }
+    } // namespace svc
+
+    /** Format an mm integral value without allocating */
+    template <class T, typename std::enable_if<is_mm_integral<T>::value, bool>::type = true>
+    inline svc::value_chars ToChars(const T& value) {
+        svc::value_chars out;
+        svc::format_chars(out, static_cast<long>(value));
+        return out;
+    }
+
+    /** Format an mm floating point value without allocating (shortest round-trip text) */
+    template <class T, typename std::enable_if<is_mm_floating_point<T>::value, bool>::type = true>
+    inline svc::value_chars ToChars(const T& value) {
+        svc::value_chars out;
+        svc::format_chars(out, static_cast<double>(value));
+        return out;
+    }
+
+    /** mm strings are already text. Returns the string itself (no copy). */
+    template <class T, typename std::enable_if<is_mm_string<T>::value, bool>::type = true>
+    inline const T& ToChars(const T& value) {
+        return value;
+    }
+
+    /** c-strings are already text. */
+    template <class T, typename std::enable_if<is_mm_c_str<T>::value, bool>::type = true>
+    inline svc::c_str_chars ToChars(const T value) {
+        return svc::c_str_chars(value);
+    }
+
+}; // namespace rdlmm
+
+#endif // __PROPCHARCONV_H__
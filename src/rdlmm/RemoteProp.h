@@ -4,6 +4,7 @@
     #define __REMOTEPROP_H__
 
     #include "../rdl/Delegate.h"
+    #include "../rdl/DeltaPack.h"
     #include "../rdl/JsonClient.h"
     #include "../rdl/JsonProtocol.h"
     #include "../rdl/sys_StringT.h"
@@ -41,17 +42,26 @@
      * |  ?   | GET value                          | get   | call<T,EX...>("?brief",ex...)->T           |
      * |  !   | SET value                          | set   | call<void,T,EX...>("!brief",t,ex...)       |
      * |  !   | NSET value - no reply              | set   | notify<void,T,EX...>("!brief",t,ex...)     |
+     * |  >   | SET value at a server time         | set   | call<bool,T,u32,EX...>(">brief",t,us,ex...)->bool |
      * |  *   | ACT task                           | act   | call<void,EX...>("*brief",ex...)           |
      * |  *   | NOTIFY task (DO without response)  | act   | notify<void,EX...>("*brief",ex...)         |
      * |  --  | ==== SEQUENCE/ARRAY COMMANDS ====  | --    | --                                         |
      * |  ^   | GET maximum size of seq array      | array | call<long,EX...>("^brief",ex...)->long |
      * |  #   | GET number of values in seq array  | array | call<long,EX...>("#brief",ex...)->long |
+     * |  %   | GET credit: values add can take    | array | call<long,EX...>("%brief",ex...)->long |
      * |  0   | CLEAR seq array                    | array | notify<long,EX...>("0brief",ex...)->dummy|
      * |  +   | ADD value to sequence array        | set   | notify<void,T,EX...>("+brief",ex...)       |
+     * |  &   | ADD delta packed values            | pack  | call<long,str,EX...>("&brief",s,ex...)->long |
      * |  *   | ACT task doubles as start seq.     | act   | call<void,EX...>("*brief",ex...)           |
      * |  *   | NOTIFY task to start seq.          | act   | notify<void,EX...>("*brief",ex...)         |
      * |  ~   | STOP sequence                      | act   | call<void,EX...>("~brief",ex...)           |
      * |  ~   | STOP sequence                      | act   | notify<void,EX...>("~brief",ex...)         |
+     * |  --  | ==== SERVER PUSH ====              | --    | --                                         |
+     * |  @   | SUBSCRIBE to value changes         | sub   | call<bool,bool>("@brief",on)->bool         |
+     * |  =   | CHANGED value pushed by the server | push  | notify<void,T,EX...>("=brief",t,ex...)     |
+     * |  --  | ==== DEVICE ====                   | --    | --                                         |
+     * |  $   | SNAPSHOT of every property value   | --    | call<object>("$")->{brief:t,...}           |
+     * |  :   | CLOCK of the server in micros      | --    | call<u32>(":")->us                         |
      * 
      * [^1]: meth is the client meth_str whose parameters match the call/notify signature
      * [^2]: Signature of the server meth_str. T is the property type on the device, EX... are an 
@@ -86,6 +96,37 @@
      * - Always Use NSET-GET pairs when setting
      * - Always use GET and never use cached values.
      * 
+     * ### Subscriptions (server push)
+     * 
+     * Polling a volatile property costs a GET round trip every time MM
+     * asks for its value. If the server published the property with
+     * `json_server::publish(prop)`, the client can `subscribe()` with an
+     * `@brief` call. The server then sends an `=brief` notification
+     * whenever the value changes. The client routes it through its push
+     * map to the property, which updates the cached value and notifies
+     * MM. A subscribed volatile property reads from the cache after
+     * handling any waiting pushes. If the firmware does not answer
+     * `@brief` with true, the property keeps polling.
+     * 
+     * ### Device snapshot
+     * 
+     * Refreshing every property one GET at a time costs one round trip
+     * per property. A `$` call returns all server property values in one
+     * reply, keyed by brief, with channel properties as arrays of channel
+     * values. Get it with `GetSnapshot()` and pass the values to each
+     * property's `fromSnapshot()`.
+     * 
+     * ### Scheduled sets
+     * 
+     * A SET takes effect when the server parses it, so the time of the
+     * change includes serial latency and server polling. Instead,
+     * `json_client::sync_clock()` estimates the server clock (`:` calls,
+     * see ClockSync.h) and `SetAt()` sends a `>prop` call with a target
+     * server time. The server applies the value from its timer queue
+     * (TimerQueue.h), so several properties can change together without
+     * hardware triggers. The cached value is not touched: subscribe or
+     * GET to see the change.
+     * 
      * ### Sequences and array value streaming (notify)
      * 
      * For sequence arrays, the client can send a stream of array notifications
@@ -102,6 +143,40 @@
      * Clients should first send a `^prop` GET call to query the maximum array
      * size on the remote device.
      * 
+     * ### Streaming sequences (credit flow control)
+     * 
+     * The client uploads in windows granted by the server: a `%prop` GET
+     * returns the credit, i.e. how many `+prop` values fit right now, and
+     * the client never sends more before asking again. For a fixed buffer
+     * the credit is the free space, so the whole sequence fits. A server
+     * `stream_prop` plays from a small ring buffer and reports an
+     * unbounded `^prop` size. When the sequence does not fit, the client
+     * keeps the rest and `FeedSequence()` sends it (wrapping around to
+     * repeat the sequence) as playback frees space. Call `FeedSequence()`
+     * regularly while the sequence runs, e.g. from the device's Busy().
+     * A stopped stream is refilled from the beginning at the next start.
+     * Only a `^prop` of SERVERPROP_STREAM_MAX_SIZE means streaming: a
+     * fixed buffer too small for the sequence fails with ERR_WRITE_FAILED.
+     * 
+     * ### Packed sequence uploads
+     * 
+     * One `+prop` notification per value costs a dozen or more bytes, even
+     * for a smooth ramp. Integer sequences instead go up as `&prop` calls
+     * whose string parameter holds the first value followed by zig-zag
+     * varint deltas and run lengths (see DeltaPack.h). The server adds
+     * each value and returns how many it added. A 1000 point DAC ramp fits
+     * in one short call. Packed strings are at most
+     * REMOTE_PROP_PACKED_CHUNK_SIZE characters and never hold more values
+     * than the `%prop` credit. If the server does not know `&prop`, the
+     * property falls back to `+prop` notifications.
+     * 
+     * ### Control traffic during uploads
+     * 
+     * Sequence uploads run as bulk traffic on the shared client (see
+     * TxPriority.h). A `~prop` stop or a shutter SET from another thread
+     * waits for at most the frame or credit call in progress, not for
+     * the rest of the upload.
+     * 
      * ### Server decoding
      * 
      * Lambda methods in the server's dispatch map can make the process
@@ -156,6 +231,16 @@ namespace rdlmm {
         #define REMOTE_PROP_ARRAY_CHUNK_SIZE 10
     #endif
 
+    /** "^brief" size of a server stream_prop, must match ServerProperty.h */
+    #ifndef SERVERPROP_STREAM_MAX_SIZE
+        #define SERVERPROP_STREAM_MAX_SIZE 0x7FFFFFFFL
+    #endif
+
+    /** Longest "&brief" packed sequence string, in characters */
+    #ifndef REMOTE_PROP_PACKED_CHUNK_SIZE
+        #define REMOTE_PROP_PACKED_CHUNK_SIZE 128
+    #endif
+
     template <class DeviceT, typename LocalT, typename RemoteT, typename... ExT>
     class RemoteProp_Base : public DeviceProp_Base<DeviceT, LocalT> {
      public:
@@ -235,6 +320,82 @@ namespace rdlmm {
             to_local_delegate_ = to_local;
         }
 
+        /**
+         * Subscribe to server pushes of this property's value.
+         *
+         * Adds an "=brief" handler to the push map, hands the map to the
+         * client and asks the server to push changes with "@brief".
+         * Channel properties share a brief, so use a multimap for them.
+         *
+         * @tparam MapT     json_stub dispatch map type (std::map interface)
+         * @param push_map  map the client routes server pushes through
+         * @return DEVICE_OK even if the server declines; the property
+         *         then keeps polling.
+         */
+        template <class MapT>
+        int subscribe(MapT& push_map) {
+            using PairT = typename MapT::value_type;
+            using PushT = rdl::json_delegate<void, const RemoteT, ExT...>;
+            push_map.insert(PairT(meth_str('='), PushT::template create<ThisT, &ThisT::on_push>(this).stub()));
+            client_->push_map(push_map);
+            bool accepted = false;
+            int ret       = client_->call_get<bool>(meth_str('@').c_str(), accepted, true);
+            subscribed_   = (ret == DEVICE_OK) && accepted;
+            if (!subscribed_)
+                return DEVICE_OK;
+            // the value may have changed before the subscription
+            LocalT v;
+            return get_impl(v);
+        }
+
+        bool subscribed() const { return subscribed_; }
+
+        /**
+         * Send more of a streaming sequence as the server grants credit.
+         * Does nothing unless the last SetSequence did not fit on the server.
+         */
+        int FeedSequence() {
+            if (!streaming_ || rewind_)
+                return DEVICE_OK;
+            return feedSequence();
+        }
+
+        /** The sequence is longer than the server buffer and needs FeedSequence() */
+        bool streaming() const { return streaming_; }
+
+        /**
+         * Update the cached value from a "$" device snapshot (see GetSnapshot).
+         * @return DEVICE_INVALID_PROPERTY if the property is not in the
+         *         snapshot. Finish the snapshot before falling back to a
+         *         GET, which would overwrite the snapshot's strings.
+         */
+        int fromSnapshot(JsonObject values) {
+            JsonVariant jv = values[brief_.c_str()];
+            if (!snapshotValue(jv, extra_))
+                return DEVICE_INVALID_PROPERTY;
+            LocalT localv = to_local(jv.as<RemoteT>());
+            if (localv == cachedValue_)
+                return DEVICE_OK;
+            cachedValue_ = localv;
+            return notifyChange(localv);
+        }
+
+        /**
+         * Set the remote value when the server clock reaches server_us.
+         * Convert from client time with clock_sync::to_server().
+         */
+        int SetAt(const LocalT localv, uint32_t server_us) {
+            if (isReadOnly_)
+                return DEVICE_INVALID_PROPERTY;
+            bool scheduled  = false;
+            RemoteT remotev = to_remote(localv);
+            int ret         = client_->call_get_tuple<bool>(meth_str('>').c_str(), scheduled,
+                                                            std::tuple_cat(std::make_tuple(remotev, server_us), extra_));
+            if (ret != DEVICE_OK)
+                return ret;
+            return scheduled ? DEVICE_OK : ERR_WRITE_FAILED;
+        }
+
      protected:
         virtual PropInfo<LocalT> checkPropInfo(const PropInfo<LocalT>& propInfo) override {
             return propInfo;
@@ -252,7 +413,7 @@ namespace rdlmm {
 
         template <typename T>
         std::tuple<T, ExT...> withextras(T t) const {
-            return std::tuple_cat(std::tie(t), extra_);
+            return std::tuple_cat(std::make_tuple(t), extra_);
         }
 
         ExtrasT extras() const {
@@ -294,12 +455,39 @@ namespace rdlmm {
 
         ///** Get the value before updating the property. Derived classes may override. */
         virtual int getCached_impl(LocalT& localv) const override {
-            if (isVolatile_)
+            if (subscribed_) {
+                // pushes update cachedValue_
+                if (client_->check_messages() != DEVICE_OK)
+                    return get_impl(localv);
+            } else if (isVolatile_) {
                 return get_impl(localv);
+            }
             localv = cachedValue_;
             return DEVICE_OK;
         }
 
+        /** Select this property's value in a snapshot entry. */
+        static bool snapshotValue(JsonVariant& jv, const std::tuple<>&) {
+            return !jv.isNull();
+        }
+
+        /** Channel properties are snapshot as an array of channel values */
+        static bool snapshotValue(JsonVariant& jv, const std::tuple<int>& chan) {
+            jv = jv[std::get<0>(chan)];
+            return !jv.isNull();
+        }
+
+        /** Server pushed a changed value ("=brief") */
+        void on_push(const RemoteT remotev, ExT... ex) {
+            if (!(std::tie(ex...) == extra_))
+                return; // another channel
+            LocalT localv = to_local(remotev);
+            if (localv != cachedValue_) {
+                cachedValue_ = localv;
+                notifyChange(localv);
+            }
+        }
+
         virtual int getMaxSequenceSize_impl(long& max_size) const override {
             if (cached_max_seq_size_ < 0) {
                 int ret;
@@ -323,42 +511,163 @@ namespace rdlmm {
             long seqsize    = static_cast<long>(sequence.size());
             long remotesize = 0;
             int ret;
+            // parse everything up front so a bad value leaves the remote sequence untouched
+            if (!ParseSequence(sequence, sequenceBuffer_)) {
+                return DEVICE_INVALID_PROPERTY_VALUE;
+            }
+            // convert once, not for every chunk sent
+            remoteBuffer_.resize(sequenceBuffer_.size());
+            for (size_t i = 0; i < sequenceBuffer_.size(); i++)
+                remoteBuffer_[i] = to_remote(sequenceBuffer_[i]);
+            if ((ret = restartSequence()) != DEVICE_OK)
+                return ret;
+            if (streaming_)
+                return DEVICE_OK; // remaining values are fed during playback
+            // verify the whole sequence arrived
+            if ((ret = client_->call_get_tuple<long>(meth_str('#').c_str(), remotesize, extras())) != DEVICE_OK) {
+                return ret;
+            }
+            if (seqsize != remotesize) {
+                return ERR_WRITE_FAILED;
+            }
+            return DEVICE_OK;
+        }
+
+        virtual int startSequence_impl() override {
+            int ret;
+            // the ring still holds values from where the last run stopped
+            if (rewind_ && (ret = restartSequence()) != DEVICE_OK)
+                return ret;
+            if ((ret = client_->call_tuple(meth_str('*').c_str(), extras())) != DEVICE_OK)
+                return ret;
+            return FeedSequence();
+        }
+
+        virtual int stopSequence_impl() override {
+            int ret;
+            if ((ret = client_->call_tuple(meth_str('~').c_str(), extras())) != DEVICE_OK)
+                return ret;
+            // refill at the next start, not here
+            rewind_ = streaming_;
+            return DEVICE_OK;
+        }
+
+        /** Clear the remote sequence and send sequenceBuffer_ from the beginning */
+        int restartSequence() {
+            int ret;
+            streamPos_ = 0;
+            streaming_ = false;
+            rewind_    = false;
             // start/clear remote sequence
             if ((ret = client_->notify_tuple(meth_str('0').c_str(), extras())) != DEVICE_OK) {
                 return ret;
             }
-            for (int i = 0; i < seqsize; i++) {
-                // add the value
-                LocalT localv   = Parse<LocalT>(sequence[i]);
-                RemoteT remotev = to_remote(localv);
-                if ((ret = client_->notify_tuple(meth_str('+').c_str(), withextras(remotev))) != DEVICE_OK) {
+            if ((ret = feedSequence()) != DEVICE_OK)
+                return ret;
+            if (streamPos_ >= static_cast<long>(sequenceBuffer_.size()))
+                return DEVICE_OK;
+            // out of credit: only a streaming server takes the rest later,
+            // a full fixed buffer fails the "#brief" check instead
+            long max_size = 0;
+            if ((ret = getMaxSequenceSize_impl(max_size)) != DEVICE_OK)
+                return ret;
+            streaming_ = (max_size == SERVERPROP_STREAM_MAX_SIZE);
+            return DEVICE_OK;
+        }
+
+        /**
+         * Send sequence values while the server grants credit ("%brief").
+         * Values go out as one packed "&brief" call or as
+         * REMOTE_PROP_ARRAY_CHUNK_SIZE notifications per credit request,
+         * so the server's input buffer is never overrun either. Firmware
+         * without "%brief" takes every value at once, as before credit
+         * existed, and "#brief" checks the result. A streaming sequence
+         * wraps around to repeat, sending at most one pass per call.
+         * Uploads are bulk traffic, so control calls from other threads go
+         * first at the next frame.
+         */
+        int feedSequence() {
+            rdl::bulk_scope bulk;
+            long seqsize = static_cast<long>(sequenceBuffer_.size());
+            long budget  = streaming_ ? seqsize : seqsize - streamPos_;
+            int ret;
+            while (budget > 0) {
+                long credit = budget;
+                if (creditCalls_) {
+                    ret = client_->call_get_tuple<long>(meth_str('%').c_str(), credit, extras());
+                    if (ret == rdl::ERROR_JSON_METHOD_NOT_FOUND) {
+                        creditCalls_ = false; // older firmware
+                        credit       = budget;
+                    } else if (ret != DEVICE_OK) {
+                        return ret;
+                    }
+                }
+                if (credit <= 0)
+                    return DEVICE_OK; // full, feed again later
+                long count = credit < budget ? credit : budget;
+                long sent  = 0;
+                if ((ret = sendPacked(count, sent)) != DEVICE_OK)
                     return ret;
+                if (sent > 0) {
+                    streamPos_ = streamPos_ % seqsize + sent;
+                    if (streamPos_ > seqsize)
+                        streamPos_ -= seqsize;
+                    budget -= sent;
+                    continue;
                 }
-                int size = i + 1;
-                if (size % REMOTE_PROP_ARRAY_CHUNK_SIZE == 0 || size == seqsize) {
-                    // verify the current size
-                    if ((ret = client_->call_get_tuple<long>(meth_str('#').c_str(), remotesize, extras())) != DEVICE_OK) {
+                if (count > REMOTE_PROP_ARRAY_CHUNK_SIZE)
+                    count = REMOTE_PROP_ARRAY_CHUNK_SIZE;
+                for (long i = 0; i < count; i++) {
+                    if (streamPos_ >= seqsize)
+                        streamPos_ = 0;
+                    RemoteT remotev = remoteBuffer_[streamPos_++];
+                    if ((ret = client_->notify_tuple(meth_str('+').c_str(), withextras(remotev))) != DEVICE_OK) {
                         return ret;
                     }
-                    if (size != remotesize) {
-                        return ERR_WRITE_FAILED;
-                    }
                 }
+                budget -= count;
             }
             return DEVICE_OK;
         }
 
-        virtual int startSequence_impl() override {
-            int ret;
-            if ((ret = client_->call_tuple(meth_str('*').c_str(), extras())) != DEVICE_OK)
-                return ret;
+        /**
+         * Send up to count values from streamPos_ in one packed "&brief"
+         * call, stopping at the end of the sequence. Sets sent to the number
+         * of values sent, or to 0 if the values must go as "+brief"
+         * notifications instead.
+         */
+        int sendPacked(long count, long& sent) {
+            sent = 0;
+            if (!packedUploads_)
+                return DEVICE_OK;
+            return sendPacked_impl(count, sent, std::integral_constant<bool, std::is_integral<RemoteT>::value>());
+        }
+
+        int sendPacked_impl(long, long&, std::false_type) {
             return DEVICE_OK;
         }
 
-        virtual int stopSequence_impl() override {
-            int ret;
-            if ((ret = client_->call_tuple(meth_str('~').c_str(), extras())) != DEVICE_OK)
+        int sendPacked_impl(long count, long& sent, std::true_type) {
+            long seqsize = static_cast<long>(remoteBuffer_.size());
+            long start   = streamPos_ % seqsize;
+            if (count > seqsize - start)
+                count = seqsize - start; // the wrap goes in the next call
+            char text[REMOTE_PROP_PACKED_CHUNK_SIZE + 1];
+            size_t packed;
+            rdl::delta_pack(text, sizeof(text), remoteBuffer_.data() + start, static_cast<size_t>(count), packed);
+            long added = 0;
+            int ret    = client_->call_get_tuple<long>(meth_str('&').c_str(), added,
+                                                       std::tuple_cat(std::make_tuple(static_cast<const char*>(text)), extra_));
+            if (ret == rdl::ERROR_JSON_METHOD_NOT_FOUND || (ret == DEVICE_OK && added < 0)) {
+                // older firmware or a property that only takes "+brief"
+                packedUploads_ = false;
+                return DEVICE_OK;
+            }
+            if (ret != DEVICE_OK)
                 return ret;
+            if (added != static_cast<long>(packed))
+                return ERR_WRITE_FAILED;
+            sent = added;
             return DEVICE_OK;
         }
 
@@ -400,12 +709,22 @@ namespace rdlmm {
         }
 
      protected:
-        RemoteProp_Base() : client_(nullptr) {}
+        RemoteProp_Base()
+            : client_(nullptr), subscribed_(false), streamPos_(0), streaming_(false), rewind_(false),
+              creditCalls_(true), packedUploads_(true) {}
         rdl::json_client<rdl::jsonrpc_default_keys>* client_;
         ExtrasT extra_;
         rdl::delegate<rdl::RetT<RemoteT>, LocalT> to_remote_delegate_;
         rdl::delegate<rdl::RetT<LocalT>, RemoteT> to_local_delegate_;
         mutable long cached_max_seq_size_;
+        std::vector<LocalT> sequenceBuffer_; ///< parsed sequence, reused between uploads
+        std::vector<RemoteT> remoteBuffer_;  ///< sequenceBuffer_ converted for sending
+        bool subscribed_;                    ///< server pushes value changes
+        long streamPos_;                     ///< next sequenceBuffer_ value to send
+        bool streaming_;                     ///< sequence did not fit, FeedSequence() sends the rest
+        bool rewind_;                        ///< streaming sequence stopped, restart it at the next start
+        bool creditCalls_;                   ///< server answers "%brief" credit calls
+        bool packedUploads_;                 ///< server takes "&brief" packed values
     };
 
     /////////////////////////////////////////////////////////////////////////////
@@ -478,6 +797,31 @@ namespace rdlmm {
 
     }
 
+    /**
+     * Get every server property value in one "$" round trip.
+     * 
+     * @code
+     *  StaticJsonDocument<rdl::svc::SNAPSHOT_DOC_SIZE> snapdoc;
+     *  JsonObject values;
+     *  if (GetSnapshot(client, snapdoc, values) == DEVICE_OK) {
+     *      fooProp.fromSnapshot(values);
+     *      barProp.fromSnapshot(values);
+     *  }
+     * @endcode
+     * 
+     * @param client    client connected to the server
+     * @param snapdoc   holds the reply. Use the values before the next client call.
+     * @param values    set to the brief/value object
+     */
+    inline int GetSnapshot(rdl::json_client<rdl::jsonrpc_default_keys>* client, JsonDocument& snapdoc, JsonObject& values) {
+        JsonVariant result;
+        int ret = client->call_get_doc(rdl::svc::SNAPSHOT_METHOD, snapdoc, result);
+        if (ret != DEVICE_OK)
+            return ret;
+        values = result.as<JsonObject>();
+        return values.isNull() ? ERR_COMMUNICATION : DEVICE_OK;
+    }
+
     /**
      * Detect a hub device on a given stream.
      * 
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#pragma once
+
+#ifndef __BENCH_H__
+    #define __BENCH_H__
+
+    #include <rdl/sys_timing.h>
+    #include <atomic>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <cstring>
+    #include <string>
+    #include <vector>
+
+    /** Minimum measured time per benchmark case. Override with `-t <ms>`. */
+    #ifndef BENCH_DEFAULT_MIN_MS
+        #define BENCH_DEFAULT_MIN_MS 200
+    #endif
+
+    /**************************************************************************************
+     * Minimal micro-benchmark harness
+     *
+     * Each source file registers one or more groups with BENCH_GROUP. A group calls
+     * bench::measure() once per case. Results are written as CSV rows
+     *
+     *     group,case,variant,bytes,iterations,ns_per_op,bytes_per_sec,allocs_per_op
+     *
+     * where `bytes` is the payload processed per operation (0 if not meaningful)
+     * and `allocs_per_op` counts global operator new calls (from any thread)
+     * during the measured run. bench_main.cpp replaces operator new to count.
+     * @code{.cpp}
+     * BENCH_GROUP(slip) {
+     *     bench::measure("slip", "encode/64", "slip", 64, [&](size_t iters) {
+     *         for (size_t i = 0; i < iters; i++)
+     *             bench::keep(slip_encoder::encode(dest, destsize, src, 64));
+     *     });
+     * }
+     * @endcode
+     **************************************************************************************/
+namespace bench {
+
+    using group_fn = void (*)();
+
+    struct group_entry {
+        const char* name;
+        group_fn fn;
+    };
+
+    inline std::vector<group_entry>& registry() {
+        static std::vector<group_entry> groups;
+        return groups;
+    }
+
+    struct registrar {
+        registrar(const char* name, group_fn fn) { registry().push_back({name, fn}); }
+    };
+
+    struct options {
+        FILE* out       = stdout;
+        uint64_t min_ns = BENCH_DEFAULT_MIN_MS * 1000000ULL;
+    };
+
+    inline options& opts() {
+        static options o;
+        return o;
+    }
+
+    /** Number of global operator new calls so far */
+    inline std::atomic<uint64_t>& alloc_count() {
+        static std::atomic<uint64_t> count(0);
+        return count;
+    }
+
+    template <typename T>
+    struct sink {
+        static volatile T value;
+    };
+
+    template <typename T>
+    volatile T sink<T>::value;
+
+    /** Keep the optimizer from discarding a computed value. */
+    template <typename T>
+    inline void keep(const T& value) {
+        sink<T>::value = value;
+    }
+
+    inline void header() {
+        fprintf(opts().out, "group,case,variant,bytes,iterations,ns_per_op,bytes_per_sec,allocs_per_op\n");
+    }
+
+    inline void report(const char* group, const char* name, const char* variant,
+                       size_t bytes, uint64_t iters, uint64_t elapsed_ns, uint64_t allocs) {
+        double ns_per_op     = double(elapsed_ns) / double(iters);
+        double bytes_per_sec = bytes ? double(bytes) * 1e9 / ns_per_op : 0.0;
+        double allocs_per_op = double(allocs) / double(iters);
+        fprintf(opts().out, "%s,%s,%s,%zu,%llu,%.2f,%.0f,%.3f\n", group, name, variant, bytes,
+                static_cast<unsigned long long>(iters), ns_per_op, bytes_per_sec, allocs_per_op);
+        fflush(opts().out);
+    }
+
+    /**
+     * Time fn(iters), doubling the iteration count until a run takes at least
+     * the minimum measure time, then report the last run.
+     *
+     * @param fn    callable taking the number of iterations to run
+     */
+    template <class FnT>
+    void measure(const char* group, const char* name, const char* variant, size_t bytes, FnT&& fn) {
+        fn(1); // warm up caches and lazy initialization
+        uint64_t iters = 1, elapsed = 0, allocs = 0;
+        for (;;) {
+            uint64_t start_allocs = alloc_count().load();
+            uint64_t start        = sys::nanos();
+            fn(static_cast<size_t>(iters));
+            elapsed = sys::nanos() - start;
+            allocs  = alloc_count().load() - start_allocs;
+            if (elapsed >= opts().min_ns || iters >= (1ULL << 40))
+                break;
+            // jump close to the target once the timing is meaningful
+            if (elapsed > 1000000ULL)
+                iters = iters * opts().min_ns / elapsed + 1;
+            else
+                iters *= 2;
+        }
+        report(group, name, variant, bytes, iters, elapsed, allocs);
+    }
+
+    /**
+     * Run the selected groups.
+     *
+     * Usage: bench [-t min_ms] [-o file | -a file] [--no-header] [group...]
+     *
+     * `-a` appends rows to an existing file without repeating the header.
+     */
+    inline int main(int argc, char** argv) {
+        std::vector<std::string> selected;
+        bool with_header = true;
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+                opts().min_ns = strtoull(argv[++i], nullptr, 10) * 1000000ULL;
+            } else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "-a")) && i + 1 < argc) {
+                bool append = argv[i][1] == 'a';
+                opts().out  = fopen(argv[++i], append ? "a" : "w");
+                with_header = with_header && !append;
+                if (!opts().out) {
+                    perror(argv[i]);
+                    return 1;
+                }
+            } else if (!strcmp(argv[i], "--no-header")) {
+                with_header = false;
+            } else if (argv[i][0] == '-') {
+                fprintf(stderr, "usage: %s [-t min_ms] [-o file | -a file] [--no-header] [group...]\n", argv[0]);
+                return 1;
+            } else {
+                selected.push_back(argv[i]);
+            }
+        }
+        if (with_header)
+            header();
+        for (const group_entry& g : registry()) {
+            bool run = selected.empty();
+            for (const std::string& s : selected)
+                run = run || s == g.name;
+            if (run)
+                g.fn();
+        }
+        if (opts().out != stdout)
+            fclose(opts().out);
+        return 0;
+    }
+
+} // namespace bench
+
+    #define BENCH_GROUP(name)                                                \
+        static void bench_group_##name();                                    \
+        static bench::registrar bench_registrar_##name(#name, &bench_group_##name); \
+        static void bench_group_##name()
+
+#endif // __BENCH_H__
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Dispatch benchmark
+ *
+ * Method lookup and json_stub::call through std::map and std::unordered_map
+ * dispatch tables filled by add_to() with sequencable simple_prop properties.
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdl/JsonProtocol.h>
+#include <rdl/ServerProperty.h>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+using namespace rdl;
+
+namespace {
+
+    using PropT = static_simple_prop<int, 32>;
+
+    template <class MapT>
+    void bench_map(const char* variant, size_t nprops) {
+        char casename[48];
+        MapT map;
+        std::vector<std::unique_ptr<PropT>> props;
+        std::vector<sys::StringT> methods;
+        for (size_t i = 0; i < nprops; i++) {
+            props.emplace_back(new PropT("p" + sys::to_string(static_cast<int>(i)), static_cast<int>(i)));
+            add_to<MapT, PropT::RootT>(map, *props.back(), true, false);
+            methods.push_back(props.back()->message('?'));
+        }
+        StaticJsonDocument<svc::JDOC_SIZE> argdoc;
+        JsonArray args = argdoc.to<JsonArray>();
+        StaticJsonDocument<svc::JRESULT_SIZE> resultdoc;
+        JsonVariant result = resultdoc.to<JsonVariant>();
+
+        snprintf(casename, sizeof(casename), "find/%zu", map.size());
+        bench::measure("dispatch", casename, variant, 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(map.find(methods[i % nprops]) != map.end());
+        });
+        snprintf(casename, sizeof(casename), "find+call/%zu", map.size());
+        bench::measure("dispatch", casename, variant, 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                auto it = map.find(methods[i % nprops]);
+                bench::keep(it->second.call(args, result));
+            }
+        });
+    }
+}
+
+BENCH_GROUP(dispatch) {
+    using OrderedMapT   = std::map<sys::StringT, json_stub>;
+    using UnorderedMapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    for (size_t nprops : {2, 16, 128}) {
+        bench_map<OrderedMapT>("map", nprops);
+        bench_map<UnorderedMapT>("unordered_map", nprops);
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Frame compression benchmark
+ *
+ * lzss_encoder/lzss_decoder speed on message-like payloads, plus the effective
+ * throughput of sending each payload over a 115200 baud UART (10 bits per byte):
+ * compress + wire time of the compressed frame + decompress, against wire time
+ * of the raw frame. The uart rows report one modelled transfer; bytes_per_sec is
+ * payload bytes delivered per second.
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdl/LzssInPlace.h>
+#include <string>
+#include <vector>
+
+using namespace rdl;
+
+namespace {
+
+    constexpr double UART_BYTES_PER_SEC = 115200.0 / 10.0;
+
+    std::vector<uint8_t> make_snapshot(int nprops) {
+        std::string str = "{\"r\":{";
+        char buf[48];
+        for (int i = 0; i < nprops; i++) {
+            snprintf(buf, sizeof(buf), "%s\"ch%d\":[%.4f,%.4f,0,0]", i ? "," : "", i, 0.25 * i, 1.5);
+            str += buf;
+        }
+        str += "},\"i\":42}";
+        return std::vector<uint8_t>(str.begin(), str.end());
+    }
+
+    std::vector<uint8_t> make_sequence(int nvalues, int repeat) {
+        std::string str = "{\"m\":\"+seq\",\"p\":[";
+        char buf[16];
+        for (int i = 0; i < nvalues; i++) {
+            snprintf(buf, sizeof(buf), "%s%d", i ? "," : "", 100 * ((i / repeat) % 16));
+            str += buf;
+        }
+        str += "]}";
+        return std::vector<uint8_t>(str.begin(), str.end());
+    }
+
+    void bench_payload(const char* name, const std::vector<uint8_t>& src) {
+        char casename[48];
+        std::vector<uint8_t> zbuf(src.size()), dbuf(src.size());
+        size_t zsize = lzss_encoder::encode(zbuf.data(), zbuf.size(), src.data(), src.size());
+        if (zsize == 0)
+            zsize = src.size(); // sent raw
+
+        uint64_t encode_ns = 0, decode_ns = 0;
+        snprintf(casename, sizeof(casename), "encode/%s", name);
+        bench::measure("lzss", casename, "lzss", src.size(), [&](size_t iters) {
+            uint64_t start = sys::nanos();
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(lzss_encoder::encode(zbuf.data(), zbuf.size(), src.data(), src.size()));
+            encode_ns = (sys::nanos() - start) / iters;
+        });
+        snprintf(casename, sizeof(casename), "decode/%s", name);
+        bench::measure("lzss", casename, "lzss", src.size(), [&](size_t iters) {
+            uint64_t start = sys::nanos();
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(lzss_decoder::decode(dbuf.data(), dbuf.size(), zbuf.data(), zsize));
+            decode_ns = (sys::nanos() - start) / iters;
+        });
+
+        snprintf(casename, sizeof(casename), "uart115200/%s", name);
+        uint64_t raw_ns = static_cast<uint64_t>(1e9 * src.size() / UART_BYTES_PER_SEC);
+        uint64_t lz_ns  = encode_ns + decode_ns + static_cast<uint64_t>(1e9 * (zsize + 1) / UART_BYTES_PER_SEC);
+        bench::report("lzss", casename, "raw", src.size(), 1, raw_ns, 0);
+        bench::report("lzss", casename, "lzss", src.size(), 1, lz_ns, 0);
+    }
+}
+
+BENCH_GROUP(lzss) {
+    bench_payload("snapshot16", make_snapshot(16));
+    bench_payload("seq_steps", make_sequence(200, 10));
+    bench_payload("seq_ramp", make_sequence(200, 1));
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include "bench.h"
+#include <cstdlib>
+#include <new>
+
+/**************************************************************************************
+ * Counting global allocator for the allocs_per_op column
+ **************************************************************************************/
+
+void* operator new(size_t size) {
+    bench::alloc_count().fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+int main(int argc, char** argv) {
+    return bench::main(argc, argv);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Property value marshalling benchmark
+ *
+ * One property update formats the value twice (device SetProperty and the change
+ * notification) and MM parses it back. Compares:
+ *  - std::to_string + stringstream: the original ToString/Parse
+ *  - ToChars + TryParse: stack buffers, no allocation (see allocs_per_op)
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdlmm/PropCharconv.h>
+#include <sstream>
+#include <string>
+
+namespace {
+
+    template <typename T>
+    void bench_value(const char* type, T value) {
+        char casename[48];
+        snprintf(casename, sizeof(casename), "update/%s", type);
+        bench::measure("marshal", casename, "to_string", 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                std::string set    = std::to_string(value);
+                std::string notify = std::to_string(value);
+                std::stringstream parser(set);
+                T back = 0;
+                parser >> back;
+                bench::keep(back + notify.length());
+            }
+        });
+        bench::measure("marshal", casename, "ToChars", 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                auto set    = rdlmm::ToChars(value);
+                auto notify = rdlmm::ToChars(value);
+                T back      = 0;
+                rdlmm::svc::parse_chars(set.c_str(), set.c_str() + set.length(), back);
+                bench::keep(back + notify.length());
+            }
+        });
+    }
+}
+
+BENCH_GROUP(marshal) {
+    bench_value<long>("long", -1234567L);
+    bench_value<double>("double", 0.1234567);
+    bench_value<double>("double_large", 6.02214076e23);
+}
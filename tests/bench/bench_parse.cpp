@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Sequence parsing benchmark
+ *
+ * Converting an MM property sequence (vector of strings) to typed values:
+ *  - stringstream: one std::stringstream per element (the original Parse<T>)
+ *  - ParseSequence: allocation-free parsing into a reused buffer
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdlmm/PropCharconv.h>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+    template <typename T>
+    T stringstream_parse(const sys::StringT& str) {
+        std::stringstream parser(str);
+        T temp = 0;
+        parser >> temp;
+        return temp;
+    }
+
+    template <typename T>
+    void bench_sequence(const char* type, const std::vector<sys::StringT>& sequence) {
+        char casename[48];
+        size_t bytes = 0;
+        for (const sys::StringT& s : sequence)
+            bytes += s.length();
+
+        std::vector<T> values;
+        snprintf(casename, sizeof(casename), "%s/%zu", type, sequence.size());
+        bench::measure("parse", casename, "stringstream", bytes, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                values.clear();
+                for (const sys::StringT& s : sequence)
+                    values.push_back(stringstream_parse<T>(s));
+                bench::keep(values.back());
+            }
+        });
+        values = std::vector<T>();
+        bench::measure("parse", casename, "ParseSequence", bytes, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                bench::keep(rdlmm::ParseSequence(sequence, values));
+                bench::keep(values.back());
+            }
+        });
+    }
+}
+
+BENCH_GROUP(parse) {
+    char buf[32];
+    for (size_t n : {100, 10000}) {
+        std::vector<sys::StringT> doubles, longs;
+        for (size_t i = 0; i < n; i++) {
+            // MM formats Float properties with 4 decimals
+            snprintf(buf, sizeof(buf), "%.4f", 5.0 * i / n - 2.5);
+            doubles.push_back(buf);
+            snprintf(buf, sizeof(buf), "%ld", static_cast<long>(i * 37) - 1000);
+            longs.push_back(buf);
+        }
+        bench_sequence<double>("double", doubles);
+        bench_sequence<long>("long", longs);
+    }
+}
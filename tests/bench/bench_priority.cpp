@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Control latency during bulk uploads
+ *
+ * One json_client shared by two threads over a Stream_LoopbackPair. A bulk thread
+ * uploads a sequence the way RemoteProp::feedSequence does: a "%seq" credit call,
+ * then up to REMOTE_PROP_ARRAY_CHUNK_SIZE "+seq" notifications, over and over.
+ * The main thread times "!foo" control calls from request to reply.
+ *
+ * - idle:      no upload running
+ * - fifo:      upload at control priority, control calls queue with it
+ * - priority:  upload inside a bulk_scope, control calls go at the next frame
+ *
+ * Each row reports one latency (iterations = 1): the median and the worst of
+ * CONTROL_CALLS calls.
+ **************************************************************************************/
+
+#include "bench_rpc.h"
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+using namespace rdl;
+
+namespace {
+
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    constexpr int CONTROL_CALLS = 2000;
+    constexpr long BULK_CHUNK   = 10; // REMOTE_PROP_ARRAY_CHUNK_SIZE
+
+    enum class upload { none, fifo, priority };
+
+    /** Sequence upload loop, restarting the sequence when the server is full */
+    void bulk_upload(json_client<jsonrpc_default_keys>& client, std::atomic<bool>& running) {
+        int value = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            long credit = 0;
+            if (client.call_get("%seq", credit) != ERROR_OK)
+                continue;
+            if (credit <= 0) {
+                client.notify("0seq");
+                continue;
+            }
+            for (long i = 0; i < credit && i < BULK_CHUNK; i++)
+                client.notify("+seq", value++);
+        }
+    }
+
+    void bench_control(json_client<jsonrpc_default_keys>& client, upload mode, const char* variant) {
+        std::atomic<bool> running(true);
+        std::thread bulk_thread([&]() {
+            if (mode == upload::none)
+                return;
+            if (mode == upload::priority) {
+                bulk_scope bulk;
+                bulk_upload(client, running);
+            } else {
+                bulk_upload(client, running);
+            }
+        });
+        std::vector<uint64_t> latency;
+        latency.reserve(CONTROL_CALLS);
+        for (int i = 0; i < CONTROL_CALLS; i++) {
+            uint64_t start = sys::nanos();
+            if (client.call("!foo", i) != ERROR_OK)
+                fprintf(stderr, "priority %s: control call failed\n", variant);
+            latency.push_back(sys::nanos() - start);
+            sys::delayMicroseconds(50); // control calls are occasional
+        }
+        running = false;
+        bulk_thread.join();
+
+        std::sort(latency.begin(), latency.end());
+        bench::report("priority", "control_latency/p50", variant, 0, 1, latency[latency.size() / 2], 0);
+        bench::report("priority", "control_latency/p99", variant, 0, 1, latency[latency.size() * 99 / 100], 0);
+        bench::report("priority", "control_latency/max", variant, 0, 1, latency.back(), 0);
+    }
+}
+
+BENCH_GROUP(priority) {
+    MapT dispatch_map;
+    static_simple_prop<int, 32> foo("foo", 1);
+    static_simple_prop<int, 1000> seq("seq", 0);
+    add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+    add_to<MapT, decltype(seq)::RootT>(dispatch_map, seq, seq.sequencable(), seq.read_only());
+
+    sys::Stream_LoopbackPair loopback;
+    static_json_server<MapT, jsonrpc_default_keys, 512> server(loopback.server(), loopback.server(), dispatch_map);
+    static_json_client<jsonrpc_default_keys, 512> client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+
+    std::atomic<bool> running(true);
+    std::thread server_thread([&]() {
+        while (running.load(std::memory_order_relaxed)) {
+            if (server.check_messages() != ERROR_OK)
+                fprintf(stderr, "priority: server error\n");
+            sys::yield();
+        }
+    });
+
+    bench_control(client, upload::none, "idle");
+    bench_control(client, upload::fifo, "fifo");
+    bench_control(client, upload::priority, "priority");
+
+    running = false;
+    server_thread.join();
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Protocol serialization benchmark
+ *
+ * serialize_call and deserialize_call (message document + SLIP framing) for a few
+ * representative parameter lists. The wire format is a compile-time switch, so this
+ * file is built twice: once for JSON and once with JSONRPC_USE_MSGPACK=1.
+ **************************************************************************************/
+
+#include "bench_rpc.h"
+#include <rdl/sys_StreamT.h>
+#include <string>
+#include <vector>
+
+using namespace rdl;
+
+namespace {
+
+    sys::Stream_StringT unused_stream;
+
+    template <typename... PARAMS>
+    void bench_call(const char* name, PARAMS... args) {
+        char casename[48];
+        bench::static_protocol<512> proto(unused_stream, unused_stream);
+        size_t msgsize = 0;
+        {
+            StaticJsonDocument<svc::JDOC_SIZE> msg;
+            int err = proto.serialize_call(msg, msgsize, "!foo", 1, args...);
+            if (err != ERROR_OK) {
+                fprintf(stderr, "protocol %s: serialize_call error %d\n", name, err);
+                return;
+            }
+        }
+        // servers see the frame without its trailing SLIP_END
+        std::vector<uint8_t> frame(proto.data(), proto.data() + msgsize - 1);
+
+        snprintf(casename, sizeof(casename), "serialize_call/%s", name);
+        bench::measure("protocol", casename, BENCH_FORMAT, msgsize, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                size_t size;
+                bench::keep(proto.serialize_call(msg, size, "!foo", 1, args...));
+            }
+        });
+        snprintf(casename, sizeof(casename), "deserialize_call/%s", name);
+        bench::measure("protocol", casename, BENCH_FORMAT, msgsize, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                // decoding is in place, so restore the frame each time
+                memcpy(proto.data(), frame.data(), frame.size());
+                StaticJsonDocument<svc::JDOC_SIZE> msg;
+                JsonArray jargs = msg.as<JsonArray>();
+                sys::StringT method;
+                int id = -1;
+                bench::keep(proto.deserialize_call(msg, frame.size(), method, id, jargs));
+            }
+        });
+    }
+}
+
+BENCH_GROUP(protocol) {
+    std::string str16(16, 'x'), str64(64, 'x'), str256(256, 'x');
+    bench_call("void");
+    bench_call("int", 42);
+    bench_call("int_channel", 42, 3);
+    bench_call("double6", 1.5, -2.25, 3.125, 1e-3, 6.02e23, 0.1);
+    bench_call("str16", str16.c_str());
+    bench_call("str64", str64.c_str());
+    bench_call("str256", str256.c_str());
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Client/server round trip benchmark
+ *
+ * Full json_client -> json_server -> json_client calls over a Stream_LoopbackPair,
+ * with the server polling check_messages() on its own thread. The client retry
+ * delay is zero so the measurement is protocol cost rather than sleep granularity.
+ * The refresh cases compare reading every property value with a GET each against
+ * one "$" snapshot call.
+ **************************************************************************************/
+
+#include "bench_rpc.h"
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+using namespace rdl;
+
+namespace {
+
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    template <typename RTYPE, typename... PARAMS>
+    void bench_get(json_client<jsonrpc_default_keys>& client, const char* method, PARAMS... args) {
+        char casename[48];
+        RTYPE check;
+        if (client.call_get(method, check, args...) != ERROR_OK) {
+            fprintf(stderr, "roundtrip %s: call_get failed\n", method);
+            return;
+        }
+        snprintf(casename, sizeof(casename), "call_get/%s", method);
+        bench::measure("roundtrip", casename, BENCH_FORMAT, 0, [&](size_t iters) {
+            RTYPE ret;
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(client.call_get(method, ret, args...));
+        });
+    }
+
+    template <typename... PARAMS>
+    void bench_set(json_client<jsonrpc_default_keys>& client, const char* method, PARAMS... args) {
+        char casename[48];
+        if (client.call(method, args...) != ERROR_OK) {
+            fprintf(stderr, "roundtrip %s: call failed\n", method);
+            return;
+        }
+        snprintf(casename, sizeof(casename), "call/%s", method);
+        bench::measure("roundtrip", casename, BENCH_FORMAT, 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(client.call(method, args...));
+        });
+    }
+
+    /** Whole-device refresh: a GET per property value vs one "$" snapshot */
+    void bench_refresh(json_client<jsonrpc_default_keys>& client) {
+        StaticJsonDocument<svc::SNAPSHOT_DOC_SIZE> snapdoc;
+        JsonVariant values;
+        if (client.call_get_doc(svc::SNAPSHOT_METHOD, snapdoc, values) != ERROR_OK) {
+            fprintf(stderr, "roundtrip $: call_get_doc failed\n");
+            return;
+        }
+        bench::measure("roundtrip", "refresh/get_each", BENCH_FORMAT, 0, [&](size_t iters) {
+            int foo;
+            double bar;
+            for (size_t i = 0; i < iters; i++) {
+                bench::keep(client.call_get("?foo", foo));
+                bench::keep(client.call_get("?bar", bar, 0));
+                bench::keep(client.call_get("?bar", bar, 1));
+            }
+        });
+        bench::measure("roundtrip", "refresh/snapshot", BENCH_FORMAT, 0, [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(client.call_get_doc(svc::SNAPSHOT_METHOD, snapdoc, values));
+        });
+    }
+}
+
+BENCH_GROUP(roundtrip) {
+    MapT dispatch_map;
+    static_simple_prop<int, 32> foo("foo", 1);
+    static_simple_prop<double, 32> bar0("bar0", 1.1), bar1("bar1", 2.2);
+    decltype(bar0)::RootT* all_bars[] = {&bar0, &bar1};
+    channel_prop<double> bars("bar", all_bars, 2);
+    add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+    add_to<MapT, decltype(bars)::RootT>(dispatch_map, bars, bars.sequencable(-1), bars.read_only(-1));
+
+    sys::Stream_LoopbackPair loopback;
+    static_json_server<MapT, jsonrpc_default_keys, 512> server(loopback.server(), loopback.server(), dispatch_map);
+    static_json_client<jsonrpc_default_keys, 512> client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+
+    std::atomic<bool> running(true);
+    std::thread server_thread([&]() {
+        while (running.load(std::memory_order_relaxed)) {
+            if (server.check_messages() != ERROR_OK)
+                fprintf(stderr, "roundtrip: server error\n");
+            sys::yield();
+        }
+    });
+
+    bench_get<int>(client, "?foo");
+    bench_set(client, "!foo", 42);
+    bench_get<double>(client, "?bar", 1);
+    bench_set(client, "!bar", 3.14, 1);
+    bench_get<long>(client, "^bar", -1);
+    bench_refresh(client);
+
+    running = false;
+    server_thread.join();
+}
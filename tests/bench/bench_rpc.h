@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#pragma once
+
+#ifndef __BENCH_RPC_H__
+    #define __BENCH_RPC_H__
+
+    #include "bench.h"
+    #include <rdl/JsonProtocol.h>
+
+    #if JSONRPC_USE_MSGPACK
+        #define BENCH_FORMAT "msgpack"
+    #else
+        #define BENCH_FORMAT "json"
+    #endif
+
+namespace bench {
+
+    /************************************************************************
+     * protocol_base with a static buffer and public buffer access, so the
+     * serialize/deserialize methods can be timed without a client or server.
+     ***********************************************************************/
+    template <size_t BUFFER_SIZE>
+    class static_protocol : public rdl::protocol_base<rdl::jsonrpc_default_keys> {
+     public:
+        using BaseT = rdl::protocol_base<rdl::jsonrpc_default_keys>;
+
+        static_protocol(sys::StreamT& istream, sys::StreamT& ostream) : BaseT(istream, ostream) {
+            // MUST wait to initialize buffer until after static_buffer creation
+            BaseT::buffer(std::move(static_buffer_));
+        }
+
+        uint8_t* data() { return BaseT::rxbuf_.data(); }
+        size_t max_size() const { return BaseT::rxbuf_.max_size(); }
+
+     protected:
+        rdl::static_arraybuf<uint8_t, BUFFER_SIZE> static_buffer_;
+    };
+
+} // namespace bench
+
+#endif // __BENCH_RPC_H__
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Many simulated devices on one server_loop thread
+ *
+ * 1 to 500 json_servers, each on a socketpair, served by one server_loop. The host
+ * side writes a pre-encoded "?foo" call to every device at once and then collects
+ * the replies, with plain read()/write() so the client costs little:
+ *
+ * - call_get/?foo burst:  time per call, N calls in flight on N devices
+ * - idle/cpu_ns_per_sec:  loop-thread CPU time per second with every device idle
+ **************************************************************************************/
+
+#include "bench_rpc.h"
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerLoop.h>
+#include <rdl/ServerProperty.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <memory>
+    #include <string>
+    #include <sys/resource.h>
+    #include <sys/socket.h>
+    #include <thread>
+    #include <time.h>
+    #include <unordered_map>
+    #include <vector>
+
+using namespace rdl;
+
+namespace {
+
+    using MapT   = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    using ProtoT = protocol_base<jsonrpc_default_keys>;
+
+    struct device {
+        device() : foo("foo", 1), server(link, link, dispatch_map) {
+            add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        }
+        ~device() {
+            if (host >= 0)
+                ::close(host);
+        }
+        bool open() {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+                return false;
+            host = fds[1];
+            return link.attach(fds[0]);
+        }
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo;
+        sys::Stream_PosixFd link;
+        int host = -1; ///< blocking client end
+        static_json_server<MapT, jsonrpc_default_keys, 256> server;
+    };
+
+    /** Capture the bytes a json_client sends for "?foo" */
+    std::string encoded_call() {
+        device dev;
+        if (!dev.open())
+            return std::string();
+        sys::Stream_PosixFd host(dev.host, false);
+        static_json_client<jsonrpc_default_keys, 256> client(host, host, 1, 0);
+        int value;
+        client.call_get("?foo", value); // nobody answers
+        std::string frame;
+        while (dev.link.available() > 0)
+            frame.push_back(static_cast<char>(dev.link.read()));
+        return frame;
+    }
+
+    /** Read one reply frame from a blocking descriptor */
+    bool read_reply(int fd) {
+        char buf[256];
+        for (;;) {
+            ssize_t r = ::read(fd, buf, sizeof(buf));
+            if (r <= 0)
+                return false;
+            if (memchr(buf, ProtoT::frame_end(), static_cast<size_t>(r)))
+                return true;
+        }
+    }
+
+    /** Make room for two descriptors per device */
+    void raise_fd_limit(size_t needed) {
+        struct rlimit lim;
+        if (::getrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur >= needed)
+            return;
+        lim.rlim_cur = lim.rlim_max == RLIM_INFINITY || lim.rlim_max >= needed ? needed : lim.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    uint64_t thread_cpu_ns() {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    void bench_devices(size_t count, const std::string& frame) {
+        std::string variant = std::to_string(count) + " devices";
+        raise_fd_limit(2 * count + 64);
+        std::vector<std::unique_ptr<device>> devices;
+        server_loop loop;
+        for (size_t d = 0; d < count; d++) {
+            devices.emplace_back(new device());
+            if (!devices.back()->open() || !loop.add(devices.back()->link, devices.back()->server)) {
+                fprintf(stderr, "serverloop %s: cannot open device %zu\n", variant.c_str(), d);
+                return;
+            }
+        }
+        uint64_t cpu_ns = 0;
+        std::thread runner([&]() {
+            uint64_t start = thread_cpu_ns();
+            loop.run();
+            cpu_ns = thread_cpu_ns() - start;
+        });
+
+        bool ok = true;
+        bench::measure("serverloop", "call_get/?foo burst", variant.c_str(), 0, [&](size_t iters) {
+            while (iters > 0 && ok) {
+                size_t burst = iters < count ? iters : count;
+                for (size_t d = 0; d < burst; d++)
+                    ok &= ::write(devices[d]->host, frame.data(), frame.size()) == static_cast<ssize_t>(frame.size());
+                for (size_t d = 0; d < burst; d++)
+                    ok &= read_reply(devices[d]->host);
+                iters -= burst;
+            }
+        });
+        loop.stop();
+        runner.join();
+        if (!ok)
+            fprintf(stderr, "serverloop %s: lost a reply\n", variant.c_str());
+
+        // every device idle: the loop thread should sleep
+        runner = std::thread([&]() {
+            uint64_t start = thread_cpu_ns();
+            loop.run();
+            cpu_ns = thread_cpu_ns() - start;
+        });
+        uint64_t wall = sys::nanos();
+        sys::delay(500);
+        loop.stop();
+        runner.join();
+        wall = sys::nanos() - wall;
+        bench::report("serverloop", "idle/cpu_ns_per_sec", variant.c_str(), 0, 1, cpu_ns * 1000000000ULL / wall, 0);
+    }
+}
+
+BENCH_GROUP(serverloop) {
+    std::string frame = encoded_call();
+    if (frame.empty()) {
+        fprintf(stderr, "serverloop: could not encode a call\n");
+        return;
+    }
+    for (size_t count : {1, 10, 100, 500})
+        bench_devices(count, frame);
+}
+
+#endif // __unix__ || __APPLE__
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * SLIP codec benchmark
+ *
+ * Encode and decode throughput of slip_encoder and slip_null_encoder over a matrix
+ * of payload sizes and special-character densities (percent of payload bytes that
+ * must be escaped). The cobs variant frames the SLIP+NULL payloads with COBS, whose
+ * cost does not depend on the density.
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdl/CobsInPlace.h>
+#include <rdl/SlipInPlace.h>
+#include <vector>
+
+using namespace rdl;
+
+namespace {
+
+    /** Deterministic payload with roughly `density` percent special characters. */
+    template <class CodesT>
+    std::vector<uint8_t> make_payload(size_t size, unsigned density) {
+        static const uint8_t specials[] = {CodesT::SLIP_END, CodesT::SLIP_ESC, CodesT::SLIPX_NULL};
+        const size_t nspecials          = CodesT::SLIPX_ESCNULL ? 3 : 2;
+        std::vector<uint8_t> payload(size);
+        uint32_t lcg = 12345;
+        for (size_t i = 0; i < size; i++) {
+            lcg = lcg * 1103515245u + 12345u;
+            if ((lcg >> 16) % 100 < density)
+                payload[i] = specials[i % nspecials];
+            else
+                payload[i] = static_cast<uint8_t>('a' + (lcg >> 24) % 26);
+        }
+        return payload;
+    }
+
+    template <class EncoderT, class DecoderT, class CodesT>
+    void bench_codec(const char* variant) {
+        char name[32];
+        for (size_t size : {16, 64, 256, 1024, 4096}) {
+            for (unsigned density : {0, 1, 10, 50}) {
+                std::vector<uint8_t> src = make_payload<CodesT>(size, density);
+                std::vector<uint8_t> encoded(2 * size + 2), decoded(size);
+                size_t esize = EncoderT::encode(encoded.data(), encoded.size(), src.data(), src.size());
+
+                snprintf(name, sizeof(name), "encode/d%u", density);
+                bench::measure("slip", name, variant, size, [&](size_t iters) {
+                    for (size_t i = 0; i < iters; i++)
+                        bench::keep(EncoderT::encode(encoded.data(), encoded.size(), src.data(), src.size()));
+                });
+                snprintf(name, sizeof(name), "decode/d%u", density);
+                bench::measure("slip", name, variant, size, [&](size_t iters) {
+                    for (size_t i = 0; i < iters; i++)
+                        bench::keep(DecoderT::decode(decoded.data(), decoded.size(), encoded.data(), esize));
+                });
+            }
+        }
+    }
+}
+
+BENCH_GROUP(slip) {
+    bench_codec<slip_encoder, slip_decoder, slip_std_codes>("slip");
+    bench_codec<slip_null_encoder, slip_null_decoder, slip_null_codes>("slip_null");
+    bench_codec<cobs_encoder, cobs_decoder, slip_null_codes>("cobs");
+}
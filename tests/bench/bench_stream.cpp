@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Stream framing benchmark
+ *
+ * Compares write + readBytesUntil of one frame on host streams:
+ *  - Stream_StringT through the base sys::Stream per-character timedRead loop
+ *  - Stream_StringT through the bulk Stream_iostream override
+ *  - Stream_Loopback bulk override
+ **************************************************************************************/
+
+#include "bench.h"
+#include <rdl/sys_StreamT.h>
+#include <vector>
+
+namespace {
+
+    constexpr char FRAME_END = '\xC0';
+
+    std::vector<uint8_t> make_frame(size_t size) {
+        std::vector<uint8_t> frame(size);
+        for (size_t i = 0; i < size - 1; i++)
+            frame[i] = static_cast<uint8_t>('a' + i % 26);
+        frame[size - 1] = static_cast<uint8_t>(FRAME_END);
+        return frame;
+    }
+
+    template <class ReadFn>
+    void bench_frames(const char* name, sys::Stream& in, sys::Stream& out, const std::vector<uint8_t>& frame, ReadFn readfn) {
+        std::vector<char> buf(frame.size() + 16);
+        bench::measure("stream", name, "readBytesUntil", frame.size(), [&](size_t iters) {
+            for (size_t i = 0; i < iters; i++) {
+                out.write(frame.data(), frame.size());
+                bench::keep(readfn(in, buf.data(), buf.size()));
+            }
+        });
+    }
+}
+
+BENCH_GROUP(stream) {
+    for (size_t frame_size : {16, 64, 256, 1024}) {
+        std::vector<uint8_t> frame = make_frame(frame_size);
+        {
+            sys::Stream_StringT ss;
+            bench_frames("Stream_StringT/per-char", ss, ss, frame, [](sys::Stream& s, char* buf, size_t len) {
+                return s.sys::Stream::readBytesUntil(FRAME_END, buf, len);
+            });
+        }
+        {
+            sys::Stream_StringT ss;
+            bench_frames("Stream_StringT/bulk", ss, ss, frame, [](sys::Stream& s, char* buf, size_t len) {
+                return s.readBytesUntil(FRAME_END, buf, len);
+            });
+        }
+        {
+            sys::Stream_LoopbackPair loopback;
+            bench_frames("Stream_Loopback/bulk", loopback.server(), loopback.client(), frame, [](sys::Stream& s, char* buf, size_t len) {
+                return s.readBytesUntil(FRAME_END, buf, len);
+            });
+        }
+    }
+}
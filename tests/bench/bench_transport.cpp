@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * Round trips over kernel transports
+ *
+ * The same "?foo" call as the roundtrip group, but with the json_server in a forked
+ * device-simulator process and the bytes going through the kernel:
+ *
+ * - loopback:  in-process Stream_LoopbackPair, server on a thread (reference)
+ * - pty:       Stream_PosixSerial on a pty slave, server on the master
+ * - unix:      Unix-domain Stream_Socket
+ * - tcp:       TCP Stream_Socket on 127.0.0.1 with TCP_NODELAY
+ *
+ * The server waits for input with waitAvailable(), as a real device loop would.
+ **************************************************************************************/
+
+#include "bench_rpc.h"
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <rdl/sys_StreamT.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <atomic>
+    #include <stdlib.h>
+    #include <string>
+    #include <sys/wait.h>
+    #include <thread>
+    #include <unordered_map>
+
+using namespace rdl;
+
+namespace {
+
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    /** Device simulator: serve foo until the client hangs up */
+    void serve_foo(sys::Stream_PosixFd& link) {
+        MapT dispatch_map;
+        static_simple_prop<int, 32> foo("foo", 1);
+        add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        static_json_server<MapT, jsonrpc_default_keys, 512> server(link, link, dispatch_map);
+        while (!link.hungUp()) {
+            link.waitAvailable(100);
+            server.check_messages();
+        }
+    }
+
+    void bench_call(sys::StreamT& link, const char* variant) {
+        static_json_client<jsonrpc_default_keys, 512> client(link, link, JSONRPC_DEFAULT_TIMEOUT, 0);
+        int check;
+        if (client.call_get("?foo", check) != ERROR_OK) {
+            fprintf(stderr, "transport %s: call_get failed\n", variant);
+            return;
+        }
+        bench::measure("transport", "call_get/?foo", variant, 0, [&](size_t iters) {
+            int ret;
+            for (size_t i = 0; i < iters; i++)
+                bench::keep(client.call_get("?foo", ret));
+        });
+    }
+
+    /** Run serve_foo in a child process on server, and bench_call on client */
+    void bench_forked(sys::Stream_PosixFd& client, sys::Stream_PosixFd& server, const char* variant) {
+        fflush(nullptr);
+        pid_t child = ::fork();
+        if (child < 0) {
+            fprintf(stderr, "transport %s: fork failed\n", variant);
+            return;
+        }
+        if (child == 0) {
+            client.close();
+            serve_foo(server);
+            ::_exit(0);
+        }
+        server.close();
+        bench_call(client, variant);
+        client.close();
+        ::waitpid(child, nullptr, 0);
+    }
+
+    void bench_loopback() {
+        MapT dispatch_map;
+        static_simple_prop<int, 32> foo("foo", 1);
+        add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        sys::Stream_LoopbackPair loopback;
+        static_json_server<MapT, jsonrpc_default_keys, 512> server(loopback.server(), loopback.server(), dispatch_map);
+        std::atomic<bool> running(true);
+        std::thread server_thread([&]() {
+            while (running.load(std::memory_order_relaxed)) {
+                server.check_messages();
+                sys::yield();
+            }
+        });
+        bench_call(loopback.client(), "loopback");
+        running = false;
+        server_thread.join();
+    }
+
+    void bench_pty() {
+        sys::Stream_PosixFd device;
+        sys::Stream_PosixSerial port;
+        int fd = ::posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || ::grantpt(fd) != 0 || ::unlockpt(fd) != 0 || !device.attach(fd) || !port.begin(::ptsname(fd), 115200)) {
+            fprintf(stderr, "transport pty: no pty\n");
+            return;
+        }
+        bench_forked(port, device, "pty");
+    }
+
+    void bench_socket(bool tcp) {
+        const char* variant = tcp ? "tcp" : "unix";
+        sys::Socket_Listener listener;
+        sys::Stream_Socket client, server;
+        const char* tmp  = getenv("TMPDIR");
+        std::string path = std::string(tmp ? tmp : "/tmp") + "/rdl_bench_" + std::to_string(::getpid());
+        bool connected   = tcp ? listener.listenTcp("127.0.0.1", 0) && client.connectTcp("127.0.0.1", listener.port())
+                               : listener.listenUnix(path.c_str()) && client.connectUnix(path.c_str());
+        if (!connected || !listener.accept(server, 1000)) {
+            fprintf(stderr, "transport %s: no connection\n", variant);
+            return;
+        }
+        listener.close();
+        bench_forked(client, server, variant);
+    }
+}
+
+BENCH_GROUP(transport) {
+    bench_loopback();
+    bench_pty();
+    bench_socket(false);
+    bench_socket(true);
+}
+
+#endif // __unix__ || __APPLE__
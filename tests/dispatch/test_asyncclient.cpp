@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/JsonAsyncClient.h>
+#include <rdl/ServerLoop.h>
+
+#if RDL_HAS_COROUTINES && (defined(__unix__) || defined(__APPLE__))
+
+    #include <rdl/JsonServer.h>
+    #include <rdl/ServerProperty.h>
+    #include <memory>
+    #include <sys/socket.h>
+    #include <unordered_map>
+    #include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+    #include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT    = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    using ClientT = static_async_json_client<jsonrpc_default_keys, 256>;
+
+    /** Simulated device and an async client on the two ends of a socketpair */
+    struct device {
+        device(unsigned long timeout_ms = JSONRPC_DEFAULT_TIMEOUT)
+            : foo("foo", 1), server(link, link, dispatch_map), client(host, host, timeout_ms) {
+            int fds[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            REQUIRE(link.attach(fds[0]));
+            REQUIRE(host.attach(fds[1]));
+            add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        }
+        /** Serve both ends from loop */
+        void add_to_loop(server_loop& loop) {
+            REQUIRE(loop.add(link, server));
+            REQUIRE(loop.add(host, client));
+        }
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo;
+        sys::Stream_PosixFd link, host;
+        static_json_server<MapT, jsonrpc_default_keys, 256> server;
+        ClientT client;
+    };
+
+    /** Set foo and read it back, noting every error */
+    rpc_task set_and_get(ClientT& client, int first, int count, std::vector<int>& errors, int& done) {
+        for (int i = first; i < first + count; i++) {
+            int err = co_await client.async_call("!foo", i);
+            auto got = co_await client.async_call_get<int>("?foo");
+            if (err != ERROR_OK || !got.ok() || got.value != i)
+                errors.push_back(err != ERROR_OK ? err : got.err);
+        }
+        done++;
+    }
+
+    rpc_task pipelined(ClientT& client, std::vector<int>& values, int& done) {
+        // all three requests go out before the first reply is awaited
+        auto a = client.async_call_get<int>("?foo");
+        auto set = client.async_call("!foo", 9);
+        auto b = client.async_call_get<int>("?foo");
+        values.push_back(client.pending() == 3 ? 0 : -1);
+        auto ra = co_await a;
+        values.push_back(ra.ok() ? ra.value : ra.err);
+        values.push_back(co_await set);
+        auto rb = co_await b;
+        values.push_back(rb.ok() ? rb.value : rb.err);
+        done++;
+    }
+
+    rpc_task get_once(ClientT& client, int& result, int& done) {
+        auto got = co_await client.async_call_get<int>("?foo");
+        result   = got.err;
+        done++;
+    }
+
+    void run_until(server_loop& loop, const int& done, int target) {
+        uint32_t start = sys::millis();
+        while (done < target && sys::millis() - start < 5000)
+            loop.run_once(100);
+    }
+}
+
+TEST_CASE("async_json_client awaits replies", "[async]") {
+    server_loop loop;
+    device dev;
+    dev.add_to_loop(loop);
+    std::vector<int> errors;
+    int done = 0;
+    set_and_get(dev.client, 0, 20, errors, done);
+    REQUIRE(done == 0); // suspended until the loop runs
+    run_until(loop, done, 1);
+    REQUIRE(done == 1);
+    REQUIRE(errors.empty());
+    REQUIRE(dev.client.pending() == 0);
+}
+
+TEST_CASE("async_json_client pipelines calls", "[async]") {
+    server_loop loop;
+    device dev;
+    dev.add_to_loop(loop);
+    std::vector<int> values;
+    int done = 0;
+    pipelined(dev.client, values, done);
+    run_until(loop, done, 1);
+    REQUIRE(done == 1);
+    REQUIRE(values == std::vector<int>{0, 1, ERROR_OK, 9});
+}
+
+TEST_CASE("many devices on one thread", "[async]") {
+    const int count = 40;
+    server_loop loop;
+    std::vector<std::unique_ptr<device>> devices;
+    std::vector<int> errors;
+    int done = 0;
+    for (int d = 0; d < count; d++) {
+        devices.emplace_back(new device());
+        devices.back()->add_to_loop(loop);
+    }
+    // every device has a call outstanding while the loop runs
+    for (int d = 0; d < count; d++)
+        set_and_get(devices[d]->client, 100 * d, 10, errors, done);
+    run_until(loop, done, count);
+    REQUIRE(done == count);
+    REQUIRE(errors.empty());
+    for (int d = 0; d < count; d++)
+        REQUIRE(devices[d]->foo.get() == 100 * d + 9);
+}
+
+TEST_CASE("async_json_client timeouts", "[async]") {
+    server_loop loop;
+    device dev(30);
+    REQUIRE(loop.add(dev.host, dev.client)); // nobody serves the device
+    int result = 0, done = 0;
+    uint32_t start = sys::millis();
+    get_once(dev.client, result, done);
+    run_until(loop, done, 1);
+    REQUIRE(done == 1);
+    REQUIRE(result == ERROR_JSON_TIMEOUT);
+    REQUIRE(sys::millis() - start >= 25);
+    REQUIRE(sys::millis() - start < 1000);
+
+    SECTION("destroying the client fails waiting calls") {
+        std::unique_ptr<ClientT> client(new ClientT(dev.host, dev.host, 10000));
+        get_once(*client, result, done);
+        REQUIRE(client->pending() == 1);
+        client.reset();
+        REQUIRE(done == 2);
+        REQUIRE(result == ERROR_JSON_NO_REPLY);
+    }
+}
+
+#endif // RDL_HAS_COROUTINES
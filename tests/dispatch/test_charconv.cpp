@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdlmm/PropCharconv.h>
+#include <climits>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdlmm;
+
+TEST_CASE("TryParse integers", "[charconv]") {
+    long value = 7;
+    REQUIRE(TryParse(sys::StringT("42"), value));
+    REQUIRE(value == 42);
+    REQUIRE(TryParse(sys::StringT("  -17"), value));
+    REQUIRE(value == -17);
+    REQUIRE(TryParse(sys::StringT("+5"), value));
+    REQUIRE(value == 5);
+    // like stringstream, the number ends at the first other character
+    REQUIRE(TryParse(sys::StringT("12abc"), value));
+    REQUIRE(value == 12);
+
+    SECTION("bad input leaves the value unchanged") {
+        REQUIRE_FALSE(TryParse(sys::StringT(""), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("   "), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("abc"), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("-"), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("+-3"), value));
+        REQUIRE(value == 12);
+    }
+
+    SECTION("overflow") {
+        REQUIRE_FALSE(TryParse(sys::StringT("99999999999999999999999"), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("-99999999999999999999999"), value));
+        REQUIRE(value == 12);
+        int small = 1;
+        REQUIRE_FALSE(TryParse(sys::StringT("4294967296"), small));
+        REQUIRE_FALSE(TryParse(sys::StringT("-2147483649"), small));
+        REQUIRE(TryParse(sys::StringT("-2147483648"), small));
+        REQUIRE(small == INT_MIN);
+        uint8_t byte = 1;
+        REQUIRE_FALSE(TryParse(sys::StringT("256"), byte));
+        REQUIRE_FALSE(TryParse(sys::StringT("-1"), byte));
+        REQUIRE(TryParse(sys::StringT("255"), byte));
+        REQUIRE(byte == 255);
+    }
+}
+
+TEST_CASE("TryParse floating point", "[charconv]") {
+    double value = 7;
+    REQUIRE(TryParse(sys::StringT("2.5"), value));
+    REQUIRE(value == 2.5);
+    REQUIRE(TryParse(sys::StringT(" -1e-3"), value));
+    REQUIRE(value == -1e-3);
+    REQUIRE(TryParse(sys::StringT("3.25V"), value));
+    REQUIRE(value == 3.25);
+    REQUIRE(TryParse(sys::StringT("0.1"), value));
+    REQUIRE(value == 0.1);
+
+    SECTION("bad input leaves the value unchanged") {
+        REQUIRE_FALSE(TryParse(sys::StringT(""), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("x1"), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("."), value));
+        REQUIRE(value == 0.1);
+    }
+
+    SECTION("overflow") {
+        REQUIRE_FALSE(TryParse(sys::StringT("1e999"), value));
+        REQUIRE_FALSE(TryParse(sys::StringT("-1e999"), value));
+        REQUIRE(value == 0.1);
+        float single = 1;
+        REQUIRE_FALSE(TryParse(sys::StringT("1e39"), single));
+        REQUIRE(TryParse(sys::StringT("1e38"), single));
+        REQUIRE(single == 1e38f);
+    }
+}
+
+TEST_CASE("TryParse strings", "[charconv]") {
+    sys::StringT value;
+    REQUIRE(TryParse(sys::StringT(""), value));
+    REQUIRE(value.empty());
+    REQUIRE(TryParse(sys::StringT(" a b "), value));
+    REQUIRE(value == " a b ");
+}
+
+TEST_CASE("ParseSequence", "[charconv]") {
+    std::vector<int> values;
+    REQUIRE(ParseSequence(std::vector<sys::StringT> {"1", "-2", "3"}, values));
+    REQUIRE(values == std::vector<int> {1, -2, 3});
+    REQUIRE(ParseSequence(std::vector<sys::StringT> {}, values));
+    REQUIRE(values.empty());
+
+    SECTION("stops at a bad element") {
+        REQUIRE_FALSE(ParseSequence(std::vector<sys::StringT> {"1", "2", "x", "4"}, values));
+        REQUIRE(values == std::vector<int> {1, 2});
+        REQUIRE_FALSE(ParseSequence(std::vector<sys::StringT> {"1", "3000000000"}, values));
+        REQUIRE(values == std::vector<int> {1});
+    }
+
+    SECTION("reuses the buffer") {
+        std::vector<double> doubles;
+        REQUIRE(ParseSequence(std::vector<sys::StringT> {"0.5", "1.5", "2.5", "3.5"}, doubles));
+        size_t capacity = doubles.capacity();
+        REQUIRE(ParseSequence(std::vector<sys::StringT> {"4.5"}, doubles));
+        REQUIRE(doubles == std::vector<double> {4.5});
+        REQUIRE(doubles.capacity() == capacity);
+    }
+}
+
+TEST_CASE("ToChars", "[charconv]") {
+    REQUIRE(sys::StringT(ToChars(0).c_str()) == "0");
+    REQUIRE(sys::StringT(ToChars(-42).c_str()) == "-42");
+    REQUIRE(sys::StringT(ToChars(LONG_MAX).c_str()) == std::to_string(LONG_MAX));
+    REQUIRE(sys::StringT(ToChars(LONG_MIN).c_str()) == std::to_string(LONG_MIN));
+    REQUIRE(ToChars(-42).length() == 3);
+    REQUIRE(sys::StringT(ToChars(0.1).c_str()) == "0.1");
+    REQUIRE(sys::StringT(ToChars(2.5).c_str()) == "2.5");
+    REQUIRE(sys::StringT(ToChars(-1e-3).c_str()) == "-0.001");
+
+    SECTION("strings pass through") {
+        sys::StringT str("abc");
+        REQUIRE(&ToChars(str) == &str);
+        const char* cstr = "xyz";
+        REQUIRE(ToChars(cstr).c_str() == cstr);
+    }
+
+    SECTION("doubles round-trip") {
+        const double values[] = {1.0 / 3, 2.0 / 3, 0.1 + 0.2, 1e-300, -2.2250738585072014e-308,
+                                 1.7976931348623157e308, 123456789.123456789, 5e-324};
+        for (double v : values) {
+            double back = 0;
+            REQUIRE(TryParse(sys::StringT(ToChars(v).c_str()), back));
+            REQUIRE(back == v);
+        }
+        REQUIRE(sys::StringT(ToChars(1.0 / 3).c_str()).length() <= 19);
+    }
+
+    SECTION("floats round-trip through double") {
+        float f = 0.1f, back = 0;
+        REQUIRE(TryParse(sys::StringT(ToChars(f).c_str()), back));
+        REQUIRE(back == f);
+    }
+
+    SECTION("integers round-trip") {
+        const long values[] = {0, 1, -1, 65535, -32768, LONG_MAX, LONG_MIN};
+        for (long v : values) {
+            long back = 0;
+            REQUIRE(TryParse(sys::StringT(ToChars(v).c_str()), back));
+            REQUIRE(back == v);
+        }
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/ClockSync.h>
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <rdl/TimerQueue.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    /** Server clock running at 1 + drift of the client clock */
+    uint32_t server_clock(uint32_t client_us, uint32_t client0, uint32_t offset, double drift) {
+        int64_t dt = static_cast<int32_t>(client_us - client0);
+        return client_us + offset + static_cast<uint32_t>(static_cast<int64_t>(drift * dt));
+    }
+
+    struct counting_entry : public timer_entry {
+        counting_entry(std::vector<int>& log, int id) : log_(log), id_(id) {}
+        virtual void fire() override { log_.push_back(id_); }
+        std::vector<int>& log_;
+        int id_;
+    };
+}
+
+TEST_CASE("clock_sync offset and drift", "[clock]") {
+    const double drift = 50e-6; // server 50 ppm fast
+    clock_sync clock;
+    REQUIRE_FALSE(clock.synced());
+
+    SECTION("offset only") {
+        clock.add_sample(1000, 1000 + 123456, 40);
+        REQUIRE(clock.synced());
+        REQUIRE(clock.to_server(5000) == 5000 + 123456);
+        REQUIRE(clock.to_client(5000 + 123456) == 5000);
+        REQUIRE(clock.uncertainty_us() == 20);
+    }
+
+    SECTION("drift from two syncs") {
+        uint32_t c0 = 0xFFF00000u; // wraps during the test
+        for (uint32_t c : {c0, c0 + 2000000u}) {
+            clock.add_sample(c, server_clock(c, c0, 777, drift), 40);
+        }
+        REQUIRE(clock.drift() == Approx(drift).margin(1e-6));
+        // ten seconds after the last sync
+        uint32_t later = c0 + 12000000u;
+        int32_t error  = static_cast<int32_t>(clock.to_server(later) - server_clock(later, c0, 777, drift));
+        REQUIRE(std::abs(error) <= 2);
+        REQUIRE(clock.to_client(clock.to_server(later)) == later);
+    }
+
+    SECTION("syncs too close together keep the previous drift") {
+        clock.add_sample(0, 100, 10);
+        clock.add_sample(1000, 1100 + 5, 10);
+        REQUIRE(clock.drift() == 0.0);
+        REQUIRE(clock.to_server(2000) == 2105);
+    }
+}
+
+TEST_CASE("timer_queue fires in due order", "[clock]") {
+    timer_queue queue;
+    std::vector<int> log;
+    counting_entry a(log, 1), b(log, 2), c(log, 3), d(log, 4);
+
+    uint32_t now = 0xFFFFFF00u; // due times wrap past zero
+    queue.schedule(a, now + 300);
+    queue.schedule(b, now + 100);
+    queue.schedule(c, now + 300); // same time as a, fires after it
+    queue.schedule(d, now + 200);
+    queue.schedule(d, now + 400); // moved
+    uint32_t due;
+    REQUIRE(queue.next_due(due));
+    REQUIRE(due == now + 100);
+
+    REQUIRE(queue.poll(now + 99) == 0);
+    REQUIRE(queue.poll(now + 100) == 1);
+    REQUIRE(queue.poll(now + 350) == 2);
+    queue.cancel(d);
+    REQUIRE_FALSE(d.queued());
+    REQUIRE(queue.poll(now + 1000) == 0);
+    REQUIRE(queue.empty());
+    REQUIRE(log == std::vector<int>{2, 1, 3});
+}
+
+TEST_CASE("simple_prop scheduled set", "[clock]") {
+    timer_queue& queue = timer_queue::instance();
+    static_simple_prop<int, 4> foo("foo", 1);
+    static_simple_prop<int, 4> bar("bar", 1);
+    uint32_t now = sys::micros();
+
+    REQUIRE(foo.set_at(2, now + 1000));
+    REQUIRE(bar.set_at(3, now + 1000));
+    REQUIRE(foo.set_at(4, now + 1000)); // replaces the pending set
+    queue.poll(now + 999);
+    REQUIRE(foo.get() == 1);
+    REQUIRE(queue.poll(now + 1000) == 2);
+    REQUIRE(foo.get() == 4);
+    REQUIRE(bar.get() == 3);
+
+    SECTION("destroyed properties leave the queue") {
+        {
+            static_simple_prop<int, 4> gone("gone", 0);
+            gone.set_at(1, now + 2000);
+        }
+        REQUIRE(queue.empty());
+    }
+}
+
+TEST_CASE("clock sync and scheduled set over loopback", "[clock]") {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    MapT dispatch_map;
+    static_simple_prop<int, 4> foo("foo", 1);
+    add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+
+    sys::Stream_LoopbackPair loopback;
+    static_json_server<MapT, jsonrpc_default_keys, 256> server(loopback.server(), loopback.server(), dispatch_map);
+    static_json_client<jsonrpc_default_keys, 256> client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+    std::atomic<bool> running(true);
+    std::thread server_thread([&]() {
+        while (running.load(std::memory_order_relaxed)) {
+            server.check_messages();
+            sys::yield();
+        }
+    });
+
+    clock_sync clock;
+    REQUIRE(client.sync_clock(clock) == ERROR_OK);
+    // both ends share one clock here
+    REQUIRE(std::abs(clock.offset_at(sys::micros())) <= static_cast<int32_t>(clock.uncertainty_us()) + 1);
+
+    uint32_t at = clock.to_server(sys::micros() + 20000);
+    bool scheduled = false;
+    REQUIRE(client.call_get(">foo", scheduled, 5, at) == ERROR_OK);
+    REQUIRE(scheduled);
+    int value = 0;
+    REQUIRE(client.call_get("?foo", value) == ERROR_OK);
+    REQUIRE(value == 1);
+    while (svc::time_before(sys::micros(), at + 2000))
+        sys::yield();
+    REQUIRE(client.call_get("?foo", value) == ERROR_OK);
+    REQUIRE(value == 5);
+
+    running = false;
+    server_thread.join();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/JsonClient.h>
+#include <rdl/JsonHub.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    /** Device server on a thread behind a hub polled on another thread */
+    struct hub_stand {
+        hub_stand() : foo("foo", 1), bar("bar", 2), server(device.server(), device.server(), dispatch_map), hub(device.client()) {
+            add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+            add_to<MapT, decltype(bar)::RootT>(dispatch_map, bar, bar.sequencable(), bar.read_only());
+            server.publish(foo);
+            for (auto& link : links)
+                REQUIRE(hub.attach(link.server()) >= 0);
+        }
+
+        void start() {
+            threads.emplace_back([this]() {
+                while (running.load(std::memory_order_relaxed)) {
+                    server.check_messages();
+                    sys::yield();
+                }
+            });
+            threads.emplace_back([this]() {
+                while (running.load(std::memory_order_relaxed)) {
+                    hub.poll();
+                    sys::yield();
+                }
+            });
+        }
+
+        ~hub_stand() {
+            running = false;
+            for (auto& t : threads)
+                t.join();
+        }
+
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo, bar;
+        sys::Stream_LoopbackPair device;
+        sys::Stream_LoopbackPair links[3]; ///< client() ends go to the clients
+        static_json_server<MapT, jsonrpc_default_keys, 256> server;
+        static_json_hub<jsonrpc_default_keys, 256> hub;
+        std::atomic<bool> running{true};
+        std::vector<std::thread> threads;
+    };
+
+    using ClientT = static_json_client<jsonrpc_default_keys, 256>;
+
+    std::atomic<int> foo_pushes(0);
+    void foo_changed(const int) { foo_pushes++; }
+}
+
+TEST_CASE("json_hub relays calls from several clients", "[hub]") {
+    hub_stand stand;
+    stand.start();
+
+    // every client starts its ids at the same number, so the hub must rewrite them
+    std::atomic<int> failures(0);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < 3; c++) {
+        clients.emplace_back([&, c]() {
+            ClientT client(stand.links[c].client(), stand.links[c].client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+            const char* set = c == 0 ? "!foo" : "!bar";
+            const char* get = c == 0 ? "?foo" : "?bar";
+            for (int i = 0; i < 300; i++) {
+                int value = -1;
+                if (c < 2 && client.call(set, 1000 * c + i) != ERROR_OK)
+                    failures++;
+                if (client.call_get(get, value) != ERROR_OK)
+                    failures++;
+                // client 2 reads bar while client 1 writes it
+                if (c < 2 && value != 1000 * c + i)
+                    failures++;
+            }
+        });
+    }
+    for (auto& t : clients)
+        t.join();
+    REQUIRE(failures == 0);
+    REQUIRE(stand.hub.in_flight() == 0);
+    REQUIRE(stand.hub.dropped() == 0);
+}
+
+TEST_CASE("json_hub sends pushes to every client", "[hub]") {
+    hub_stand stand;
+    stand.start();
+    ClientT first(stand.links[0].client(), stand.links[0].client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+    ClientT second(stand.links[1].client(), stand.links[1].client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+
+    foo_pushes = 0;
+    MapT push_map;
+    push_map.insert(MapT::value_type("=foo", json_delegate<void, const int>::create<foo_changed>().stub()));
+    second.push_map(push_map);
+
+    bool subscribed = false;
+    REQUIRE(first.call_get("@foo", subscribed, true) == ERROR_OK);
+    REQUIRE(subscribed);
+    REQUIRE(first.call("!foo", 7) == ERROR_OK);
+    uint32_t start = sys::millis();
+    while (foo_pushes == 0 && sys::millis() - start < 1000) {
+        second.check_messages();
+        sys::yield();
+    }
+    REQUIRE(foo_pushes == 1);
+}
+
+TEST_CASE("json_hub forgets unanswered calls", "[hub]") {
+    sys::Stream_LoopbackPair device, link;
+    static_json_hub<jsonrpc_default_keys, 256> hub(device.client(), 20);
+    int slot = hub.attach(link.server());
+    REQUIRE(slot == 0);
+    ClientT client(link.client(), link.client(), 50, 0);
+    int value;
+    // nobody serves the device, so the call times out on both sides
+    std::thread poller([&]() {
+        for (int i = 0; i < 100; i++) {
+            hub.poll();
+            sys::delay(1);
+        }
+    });
+    REQUIRE(client.call_get("?foo", value) != ERROR_OK);
+    poller.join();
+    REQUIRE(hub.in_flight() == 0);
+    REQUIRE(hub.dropped() == 1);
+    hub.detach(slot);
+    REQUIRE(hub.attach(link.server()) == slot);
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/sys_StreamT.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <rdl/JsonClient.h>
+    #include <rdl/JsonServer.h>
+    #include <rdl/ServerProperty.h>
+    #include <atomic>
+    #include <stdlib.h>
+    #include <thread>
+    #include <unordered_map>
+    #include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+    #include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    /** A pty stands in for a device: the master end plays the device */
+    struct pty_pair {
+        pty_pair() {
+            int fd = ::posix_openpt(O_RDWR | O_NOCTTY);
+            REQUIRE(fd >= 0);
+            REQUIRE(::grantpt(fd) == 0);
+            REQUIRE(::unlockpt(fd) == 0);
+            REQUIRE(device.attach(fd));
+            REQUIRE(port.begin(::ptsname(fd), 115200));
+        }
+        sys::Stream_PosixFd device;
+        sys::Stream_PosixSerial port;
+    };
+}
+
+TEST_CASE("Stream_PosixSerial opens ports", "[posixserial]") {
+    sys::Stream_PosixSerial port;
+    REQUIRE_FALSE(port.isOpen());
+    REQUIRE_FALSE(port.begin("/dev/no-such-tty", 115200));
+    REQUIRE(errno == ENOENT);
+    speed_t speed;
+    REQUIRE(sys::Stream_PosixSerial::baud_to_speed(115200, speed));
+    REQUIRE_FALSE(sys::Stream_PosixSerial::baud_to_speed(12345, speed));
+    REQUIRE(port.available() == 0);
+    REQUIRE(port.read() == -1);
+}
+
+TEST_CASE("Stream_PosixSerial opens ports exclusively", "[posixserial]") {
+    pty_pair pty;
+    sys::Stream_PosixSerial other;
+    REQUIRE_FALSE(other.begin(::ptsname(pty.device.fd()), 115200));
+    REQUIRE(errno == EBUSY);
+    pty.port.end();
+    REQUIRE(other.begin(::ptsname(pty.device.fd()), 115200));
+}
+
+TEST_CASE("Stream_PosixSerial over a pty", "[posixserial]") {
+    pty_pair pty;
+    REQUIRE(pty.port.isOpen());
+    pty.port.setTimeout(200);
+    pty.device.setTimeout(200);
+
+    SECTION("bytes pass unchanged in raw mode") {
+        const uint8_t msg[] = {'a', '\n', '\r', 0, 0x11, 0x13, 0x7f, 0xff, 'z'};
+        REQUIRE(pty.port.write(msg, sizeof(msg)) == sizeof(msg));
+        REQUIRE(pty.device.waitAvailable(200));
+        char got[sizeof(msg)];
+        REQUIRE(pty.device.readBytes(got, sizeof(got)) == sizeof(msg));
+        REQUIRE(memcmp(got, msg, sizeof(msg)) == 0);
+    }
+
+    SECTION("peek, read and terminators") {
+        pty.device.print("hello\nworld");
+        REQUIRE(pty.port.waitAvailable(200));
+        REQUIRE(pty.port.peek() == 'h');
+        REQUIRE(pty.port.read() == 'h');
+        char line[16];
+        REQUIRE(pty.port.readBytesUntil('\n', line, sizeof(line)) == 4);
+        REQUIRE(memcmp(line, "ello", 4) == 0);
+        uint32_t start = sys::millis();
+        REQUIRE(pty.port.readBytesUntil('\n', line, sizeof(line)) == 5); // times out
+        REQUIRE(sys::millis() - start >= 150);
+        REQUIRE(memcmp(line, "world", 5) == 0);
+    }
+
+    SECTION("a full buffer leaves the terminator unread") {
+        pty.device.print("abcd\nef\n");
+        REQUIRE(pty.port.waitAvailable(200));
+        char line[4];
+        REQUIRE(pty.port.readBytesUntil('\n', line, sizeof(line)) == 4);
+        REQUIRE(pty.port.peek() == '\n');
+        REQUIRE(pty.port.readBytesUntil('\n', line, sizeof(line)) == 0);
+        REQUIRE(pty.port.readBytesUntil('\n', line, sizeof(line)) == 2);
+        REQUIRE(memcmp(line, "ef", 2) == 0);
+    }
+
+    SECTION("bulk transfer larger than the tty buffers") {
+        std::vector<uint8_t> sent(256 * 1024);
+        for (size_t i = 0; i < sent.size(); i++)
+            sent[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+        std::vector<uint8_t> got(sent.size());
+        pty.device.setTimeout(2000);
+        std::thread reader([&]() {
+            size_t n = pty.device.readBytes(reinterpret_cast<char*>(got.data()), got.size());
+            got.resize(n);
+        });
+        pty.port.setTimeout(2000);
+        REQUIRE(pty.port.write(sent.data(), sent.size()) == sent.size());
+        reader.join();
+        REQUIRE(got == sent);
+    }
+
+    SECTION("hang up") {
+        pty.port.end();
+        char c;
+        REQUIRE(pty.device.readBytes(&c, 1) == 0);
+        REQUIRE(pty.device.hungUp());
+    }
+}
+
+TEST_CASE("json calls over a pty", "[posixserial]") {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    MapT dispatch_map;
+    static_simple_prop<int, 4> foo("foo", 1);
+    add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+
+    pty_pair pty;
+    static_json_server<MapT, jsonrpc_default_keys, 256> server(pty.device, pty.device, dispatch_map);
+    static_json_client<jsonrpc_default_keys, 256> client(pty.port, pty.port, JSONRPC_DEFAULT_TIMEOUT, 0);
+    std::atomic<bool> running(true);
+    std::thread server_thread([&]() {
+        while (running.load(std::memory_order_relaxed)) {
+            pty.device.waitAvailable(10);
+            server.check_messages();
+        }
+    });
+
+    for (int i = 0; i < 200; i++) {
+        REQUIRE(client.call("!foo", i) == ERROR_OK);
+        int value = -1;
+        REQUIRE(client.call_get("?foo", value) == ERROR_OK);
+        REQUIRE(value == i);
+    }
+
+    running = false;
+    server_thread.join();
+}
+
+#endif // __unix__ || __APPLE__
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/sys_StreamT.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <rdl/JsonClient.h>
+    #include <rdl/JsonServer.h>
+    #include <rdl/ServerProperty.h>
+    #include <sys/socket.h>
+    #include <unordered_map>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+    #include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    /** Counts the write(2) calls that reach the descriptor */
+    class counting_fd : public sys::Stream_PosixFd {
+     public:
+        size_t writes = 0;
+
+     protected:
+        virtual ssize_t write_some(const uint8_t* str, size_t n) override {
+            writes++;
+            return sys::Stream_PosixFd::write_some(str, n);
+        }
+    };
+
+    /** Queues encoded calls without waiting for replies */
+    class frame_writer : public protocol_base<jsonrpc_default_keys> {
+     public:
+        frame_writer(sys::StreamT& stream, bool split = false) : protocol_base<jsonrpc_default_keys>(stream, stream) {
+            if (split)
+                buffers(std::move(static_buffer_), std::move(static_txbuf_));
+            else
+                buffer(std::move(static_buffer_));
+        }
+        template <typename T>
+        void send(const char* method, int id, T arg) {
+            StaticJsonDocument<svc::JDOC_SIZE> msg;
+            size_t msgsize;
+            REQUIRE(serialize_call(msg, msgsize, method, id, arg) == ERROR_OK);
+            REQUIRE(send_frame(msgsize) == ERROR_OK);
+        }
+        /** Pack a call behind the queued ones without writing it */
+        void queue(const char* method, int id, int arg) {
+            StaticJsonDocument<svc::JDOC_SIZE> msg;
+            size_t msgsize;
+            REQUIRE(serialize_call(msg, msgsize, method, id, arg) == ERROR_OK);
+            REQUIRE(send_frame(msgsize, true) == ERROR_OK);
+        }
+        /** Read and decode one frame */
+        bool read(JsonDocument& msg) {
+            size_t msgsize = istream_.readBytesUntil(frame_end(), rxbuf_.data(), rxbuf_.max_size());
+            return msgsize > 0 && deserialize_message(msg, msgsize) == ERROR_OK;
+        }
+        /** Read one frame and return its id, or -1 */
+        long reply_id() {
+            StaticJsonDocument<svc::JDOC_SIZE> msg;
+            if (!read(msg))
+                return -1;
+            return msg[key_id()] | -1L;
+        }
+        using protocol_base<jsonrpc_default_keys>::duplex;
+        using protocol_base<jsonrpc_default_keys>::tx_room;
+
+     protected:
+        static_arraybuf<uint8_t, 256> static_buffer_;
+        static_arraybuf<uint8_t, 256> static_txbuf_;
+    };
+
+    /** Server on one end of a socketpair, test frames on the other */
+    template <class ServerT>
+    struct stand {
+        stand() : foo("foo", 1), server(link, link, dispatch_map), host(peer) {
+            int fds[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            REQUIRE(link.attach(fds[0]));
+            REQUIRE(peer.attach(fds[1]));
+            add_to<MapT, static_simple_prop<int, 4>::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        }
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo;
+        counting_fd link;
+        sys::Stream_PosixFd peer;
+        ServerT server;
+        frame_writer host;
+    };
+}
+
+TEST_CASE("process_messages drains a notification flood", "[process]") {
+    stand<static_json_server<MapT, jsonrpc_default_keys, 256, slip_null_framing, 256>> s;
+    // calls queued behind a burst of sets, as during a sequence upload
+    for (int i = 0; i < 40; i++)
+        s.host.send("!foo", -1, i);
+    for (int id = 1; id <= 5; id++)
+        s.host.send("?foo", id, 0);
+
+    size_t handled = 0;
+    REQUIRE(s.server.process_messages(1000000, handled) == ERROR_OK);
+    REQUIRE(handled == 45);
+    REQUIRE(s.foo.get() == 39);
+    // the five replies left in one write
+    REQUIRE(s.link.writes == 1);
+    for (int id = 1; id <= 5; id++)
+        REQUIRE(s.host.reply_id() == id);
+
+    SECTION("nothing waiting") {
+        REQUIRE(s.server.process_messages(1000, handled) == ERROR_OK);
+        REQUIRE(handled == 0);
+        REQUIRE(s.link.writes == 1);
+    }
+
+    SECTION("budget") {
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        // an exhausted budget still handles one message
+        REQUIRE(s.server.process_messages(0, handled) == ERROR_OK);
+        REQUIRE(handled == 1);
+        REQUIRE(s.server.process_messages(0, handled) == ERROR_OK);
+        REQUIRE(handled == 1);
+        REQUIRE(s.server.process_messages(1000000, handled) == ERROR_OK);
+        REQUIRE(handled == 1);
+        REQUIRE(s.link.writes == 4);
+    }
+}
+
+TEST_CASE("process_messages with one shared buffer", "[process]") {
+    stand<static_json_server<MapT, jsonrpc_default_keys, 256, slip_null_framing, 0>> s;
+    for (int id = 1; id <= 5; id++)
+        s.host.send("?foo", id, 0);
+    size_t handled = 0;
+    REQUIRE(s.server.process_messages(1000000, handled) == ERROR_OK);
+    REQUIRE(handled == 5);
+    REQUIRE(s.link.writes == 5);
+    for (int id = 1; id <= 5; id++)
+        REQUIRE(s.host.reply_id() == id);
+}
+
+TEST_CASE("process_messages flushes a full transmit buffer", "[process]") {
+    // 64 bytes hold only a few replies
+    stand<static_json_server<MapT, jsonrpc_default_keys, 256, slip_null_framing, 64>> s;
+    for (int id = 1; id <= 20; id++)
+        s.host.send("?foo", id, 0);
+    size_t handled = 0;
+    REQUIRE(s.server.process_messages(1000000, handled) == ERROR_OK);
+    REQUIRE(handled == 20);
+    REQUIRE(s.link.writes > 1);
+    REQUIRE(s.link.writes < 20);
+    for (int id = 1; id <= 20; id++)
+        REQUIRE(s.host.reply_id() == id);
+}
+
+TEST_CASE("check_messages coalesces replies to pipelined calls", "[process]") {
+    stand<static_json_server<MapT, jsonrpc_default_keys, 256, slip_null_framing, 256>> s;
+    s.server.coalesce(true, 1000000); // long enough for any test machine
+
+    SECTION("a lone call is answered at once") {
+        s.host.send("?foo", 1, 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 1);
+        REQUIRE(s.host.reply_id() == 1);
+    }
+
+    SECTION("replies wait while more calls are queued") {
+        for (int id = 1; id <= 5; id++)
+            s.host.send("?foo", id, 0);
+        for (int i = 0; i < 4; i++)
+            REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 1);
+        for (int id = 1; id <= 5; id++)
+            REQUIRE(s.host.reply_id() == id);
+    }
+
+    SECTION("flush") {
+        s.host.send("?foo", 1, 0);
+        s.host.send("?foo", 2, 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 0);
+        REQUIRE(s.server.flush() == ERROR_OK);
+        REQUIRE(s.link.writes == 1);
+        REQUIRE(s.host.reply_id() == 1);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.host.reply_id() == 2);
+    }
+
+    SECTION("pushes keep their place") {
+        // the reply to 1 is queued, and a push written directly must not overtake it
+        s.host.send("?foo", 1, 0);
+        s.host.send("?foo", 2, 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.server.notify("=foo", 3) == ERROR_OK);
+        REQUIRE(s.host.reply_id() == 1);
+        REQUIRE(s.host.reply_id() == -1);
+    }
+
+    SECTION("replies wait at most the hold time") {
+        s.server.coalesce(true, 20000);
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 0);
+        sys::delay(30);
+        // the next call must not keep 1 waiting while it reads 2
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 1);
+        REQUIRE(s.host.reply_id() == 1);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 2);
+        REQUIRE(s.host.reply_id() == 2);
+        REQUIRE(s.host.reply_id() == 3);
+    }
+
+    SECTION("no hold time") {
+        s.server.coalesce(true, 0);
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 1);
+        REQUIRE(s.host.reply_id() == 1);
+    }
+
+    SECTION("turned off") {
+        s.server.coalesce(false);
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        for (int i = 0; i < 3; i++)
+            REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(s.link.writes == 3);
+    }
+}
+
+TEST_CASE("separate receive and transmit buffers", "[process]") {
+    stand<static_json_server<MapT, jsonrpc_default_keys, 256, slip_null_framing, 256>> s;
+
+    SECTION("a decoded frame survives sending") {
+        frame_writer host(s.peer, true);
+        REQUIRE(host.duplex());
+        REQUIRE(s.server.notify("=name", "hello") == ERROR_OK);
+        StaticJsonDocument<svc::JDOC_SIZE> push;
+        REQUIRE(host.read(push));
+        // strings in push may point into the receive buffer
+        host.send("?foo", 1, 0);
+        JsonArray params = push[host.key_params()];
+        REQUIRE(params[0].as<sys::StringT>() == "hello");
+        REQUIRE(s.server.check_messages() == ERROR_OK);
+        REQUIRE(host.reply_id() == 1);
+    }
+
+    SECTION("dynamic servers queue replies too") {
+        dynamic_json_server<MapT, jsonrpc_default_keys> server(s.link, s.link, s.dispatch_map, 256);
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        size_t handled = 0;
+        REQUIRE(server.process_messages(1000000, handled) == ERROR_OK);
+        REQUIRE(handled == 3);
+        REQUIRE(s.link.writes == 1);
+        for (int id = 1; id <= 3; id++)
+            REQUIRE(s.host.reply_id() == id);
+    }
+
+    SECTION("shared buffer") {
+        REQUIRE_FALSE(s.host.duplex());
+    }
+
+    SECTION("a frame too big for the queue's room flushes it first") {
+        frame_writer host(s.peer, true);
+        frame_writer device(s.link);
+        int queued = 0;
+        while (host.tx_room() >= 64)
+            host.queue("?foo", ++queued, 0);
+        REQUIRE(host.tx_room() > 0);
+        // more than the queued frames leave room for
+        const char* text = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+        host.send("!name", 100, text);
+        StaticJsonDocument<svc::JDOC_SIZE> msg;
+        for (int id = 1; id <= queued; id++) {
+            REQUIRE(device.read(msg));
+            REQUIRE(msg[device.key_id()].as<int>() == id);
+        }
+        REQUIRE(device.read(msg));
+        REQUIRE(msg[device.key_id()].as<int>() == 100);
+        JsonArray params = msg[device.key_params()];
+        REQUIRE(params[0].as<sys::StringT>() == text);
+    }
+
+    SECTION("shared unless TX_SIZE is given") {
+        static_json_server<MapT, jsonrpc_default_keys, 256> server(s.link, s.link, s.dispatch_map);
+        for (int id = 1; id <= 3; id++)
+            s.host.send("?foo", id, 0);
+        size_t handled = 0;
+        REQUIRE(server.process_messages(1000000, handled) == ERROR_OK);
+        REQUIRE(handled == 3);
+        REQUIRE(s.link.writes == 3);
+        for (int id = 1; id <= 3; id++)
+            REQUIRE(s.host.reply_id() == id);
+    }
+}
+
+#endif // __unix__ || __APPLE__
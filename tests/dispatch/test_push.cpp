@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+// rdlmm properties build against MMDevice, which only the MSVC device tree has
+#if defined(_MSC_VER) && defined(__has_include)
+    #if __has_include(<DeviceBase.h>)
+        #define TEST_REMOTEPROP 1
+        #include <rdlmm/RemoteProp.h>
+    #endif
+#endif
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT     = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    using PushMapT = std::multimap<sys::StringT, json_stub>;
+
+    /** Client side of the pushes */
+    struct listener {
+        int foo       = 0;
+        double bar[2] = {0, 0};
+        int pushes    = 0;
+        void on_foo(const int v) {
+            foo = v;
+            pushes++;
+        }
+        void on_bar(const double v, int chan) {
+            bar[chan] = v;
+            pushes++;
+        }
+    };
+
+    /** Device and host joined by a loopback, foo published, bar not yet */
+    struct push_link {
+        push_link()
+            : foo("foo", 1),
+              bar0("bar0", 1.5),
+              bar1("bar1", 2.5),
+              bars("bar", all_bars, 2),
+              server(loopback.server(), loopback.server(), dispatch_map),
+              client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0) {
+            add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+            add_to<MapT, decltype(bars)::RootT>(dispatch_map, bars, bars.sequencable(-1), bars.read_only(-1));
+            server.publish(foo);
+            push_map.insert({"=foo", json_delegate<void, const int>::create<listener, &listener::on_foo>(&host).stub()});
+            push_map.insert({"=bar", json_delegate<void, const double, int>::create<listener, &listener::on_bar>(&host).stub()});
+            client.push_map(push_map);
+        }
+        ~push_link() {
+            if (runner.joinable())
+                stop();
+        }
+
+        /** Serve client calls on another thread until stop() */
+        void start() {
+            running = true;
+            runner  = std::thread([this]() {
+                while (running) {
+                    server.check_messages();
+                    sys::yield();
+                }
+            });
+        }
+
+        /** Join the server thread; props may then be set from this one */
+        void stop() {
+            running = false;
+            runner.join();
+        }
+
+        MapT dispatch_map;
+        PushMapT push_map;
+        listener host;
+        static_simple_prop<int, 8> foo;
+        static_simple_prop<double, 8> bar0, bar1;
+        decltype(bar0)::RootT* all_bars[2] = {&bar0, &bar1};
+        channel_prop<double> bars;
+        sys::Stream_LoopbackPair loopback;
+        static_json_server<MapT, jsonrpc_default_keys, 512> server;
+        static_json_client<jsonrpc_default_keys, 512> client;
+        std::atomic<bool> running;
+        std::thread runner;
+    };
+}
+
+TEST_CASE("@brief subscribes to pushes", "[push]") {
+    push_link ln;
+    bool accepted = false;
+    ln.start();
+
+    SECTION("published property") {
+        REQUIRE(ln.client.call_get("@foo", accepted, true) == ERROR_OK);
+        REQUIRE(accepted);
+        REQUIRE(ln.foo.subscribed());
+        // the push goes out before the reply, so it has arrived when call() returns
+        REQUIRE(ln.client.call("!foo", 42) == ERROR_OK);
+        REQUIRE(ln.host.foo == 42);
+        REQUIRE(ln.host.pushes == 1);
+        // unchanged values are not pushed
+        REQUIRE(ln.client.call("!foo", 42) == ERROR_OK);
+        REQUIRE(ln.host.pushes == 1);
+        // unsubscribe
+        REQUIRE(ln.client.call_get("@foo", accepted, false) == ERROR_OK);
+        REQUIRE_FALSE(accepted);
+        REQUIRE(ln.client.call("!foo", 43) == ERROR_OK);
+        REQUIRE(ln.host.pushes == 1);
+        ln.stop();
+    }
+
+    SECTION("unpublished property declines") {
+        REQUIRE(ln.client.call_get("@bar", accepted, true) == ERROR_OK);
+        REQUIRE_FALSE(accepted);
+        REQUIRE(ln.client.call("!bar", 3.5, 1) == ERROR_OK);
+        REQUIRE(ln.host.pushes == 0);
+        ln.stop();
+    }
+}
+
+TEST_CASE("=brief pushes route through the push map", "[push]") {
+    push_link ln;
+    bool accepted = false;
+    ln.start();
+    REQUIRE(ln.client.call_get("@foo", accepted, true) == ERROR_OK);
+    ln.stop();
+
+    SECTION("firmware-side set") {
+        ln.foo.set(7);
+        REQUIRE(ln.client.check_messages() == ERROR_OK);
+        REQUIRE(ln.host.foo == 7);
+        REQUIRE(ln.host.pushes == 1);
+    }
+
+    SECTION("channels share one brief") {
+        ln.server.publish(ln.bars);
+        REQUIRE(ln.bars.subscribe(true));
+        ln.bars.set(9.5, 1);
+        REQUIRE(ln.client.check_messages() == ERROR_OK);
+        REQUIRE(ln.host.bar[0] == 0);
+        REQUIRE(ln.host.bar[1] == 9.5);
+        REQUIRE(ln.host.pushes == 1);
+    }
+
+    SECTION("unknown pushes are dropped") {
+        REQUIRE(ln.server.notify("=nope", 1) == ERROR_OK);
+        ln.foo.set(8);
+        REQUIRE(ln.client.check_messages() == ERROR_OK);
+        REQUIRE(ln.host.foo == 8);
+        REQUIRE(ln.host.pushes == 1);
+    }
+}
+
+namespace {
+    /** Push handler that reads foo back through the client that got the push */
+    struct readback_listener {
+        json_client<jsonrpc_default_keys>* client;
+        int foo = 0;
+        int err = ERROR_JSON_NO_REPLY;
+        void on_foo(const int) {
+            err = client->call_get("?foo", foo);
+            REQUIRE(client->check_messages() == ERROR_OK);
+        }
+    };
+}
+
+TEST_CASE("push handlers may use the client", "[push]") {
+    push_link ln;
+    readback_listener reader;
+    reader.client = &ln.client;
+    ln.push_map.insert({"=foo", json_delegate<void, const int>::create<readback_listener, &readback_listener::on_foo>(&reader).stub()});
+    bool accepted = false;
+    ln.start();
+    REQUIRE(ln.client.call_get("@foo", accepted, true) == ERROR_OK);
+    // the push arrives ahead of the reply but is handled after it
+    REQUIRE(ln.client.call("!foo", 42) == ERROR_OK);
+    REQUIRE(reader.err == ERROR_OK);
+    REQUIRE(reader.foo == 42);
+    REQUIRE(ln.host.foo == 42);
+    REQUIRE(ln.client.call("!foo", 43) == ERROR_OK);
+    REQUIRE(reader.foo == 43);
+    REQUIRE(ln.host.pushes == 2);
+    ln.stop();
+}
+
+#ifdef TEST_REMOTEPROP
+
+namespace {
+    /** Just enough of a device for properties to link to */
+    struct fake_device {
+        ~fake_device() {
+            for (auto action : actions)
+                delete action;
+        }
+        int CreateProperty(const char*, const char*, MM::PropertyType, bool, MM::ActionFunctor* action, bool) {
+            actions.push_back(action);
+            return DEVICE_OK;
+        }
+        int SetProperty(const char*, const char*) { return DEVICE_OK; }
+        int SetPropertyLimits(const char*, double, double) { return DEVICE_OK; }
+        int SetAllowedValues(const char*, std::vector<sys::StringT>&) { return DEVICE_OK; }
+        int OnPropertyChanged(const char*, const char* value) {
+            changes.push_back(value);
+            return DEVICE_OK;
+        }
+        std::vector<MM::ActionFunctor*> actions;
+        std::vector<sys::StringT> changes;
+    };
+
+    using RemoteFooT = rdlmm::RemoteSimpleProp<fake_device, long, int>;
+}
+
+TEST_CASE("RemoteProp on_push updates the cached value", "[push]") {
+    push_link ln;
+    fake_device device;
+    RemoteFooT prop;
+    RemoteFooT::NotifyChangeFnT notify = &fake_device::OnPropertyChanged;
+    prop.setNotifyChange(notify);
+    ln.start();
+    REQUIRE(prop.create(&device, &ln.client, rdlmm::PropInfo<long>::build("Foo", 3).withBrief("foo")) == DEVICE_OK);
+    REQUIRE(ln.foo.get() == 3);
+
+    SECTION("subscribed") {
+        REQUIRE(prop.subscribe(ln.push_map) == DEVICE_OK);
+        REQUIRE(prop.subscribed());
+        ln.stop();
+        // firmware-side change: the cached get picks up the push, no round trip
+        ln.foo.set(5);
+        long value = 0;
+        REQUIRE(prop.GetCachedProperty(value) == DEVICE_OK);
+        REQUIRE(value == 5);
+        REQUIRE(device.changes.size() == 1);
+        REQUIRE(device.changes.back() == "5");
+        // nothing pushed, nothing changed
+        REQUIRE(prop.GetCachedProperty(value) == DEVICE_OK);
+        REQUIRE(value == 5);
+        REQUIRE(device.changes.size() == 1);
+    }
+
+    SECTION("not subscribed") {
+        ln.stop();
+        ln.foo.set(5);
+        long value = 0;
+        REQUIRE(prop.GetCachedProperty(value) == DEVICE_OK);
+        REQUIRE(value == 3);
+        REQUIRE(device.changes.empty());
+    }
+}
+
+TEST_CASE("RemoteProp SetAt schedules a server-side set", "[push]") {
+    push_link ln;
+    fake_device device;
+    RemoteFooT prop;
+    ln.start();
+    REQUIRE(prop.create(&device, &ln.client, rdlmm::PropInfo<long>::build("Foo", 3).withBrief("foo")) == DEVICE_OK);
+    // client and server share the clock here, so no clock_sync is needed
+    uint32_t due = sys::micros() + 50000;
+    REQUIRE(prop.SetAt(9, due) == DEVICE_OK);
+    REQUIRE(ln.foo.get() == 3);
+    while (ln.foo.get() != 9 && svc::time_before(sys::micros(), due + 1000000))
+        sys::delay(1);
+    REQUIRE(ln.foo.get() == 9);
+    REQUIRE_FALSE(svc::time_before(sys::micros(), due));
+    ln.stop();
+}
+
+TEST_CASE("RemoteProp uploads a sequence to firmware without credit calls", "[push]") {
+    push_link ln;
+    fake_device device;
+    RemoteFooT prop;
+    ln.dispatch_map.erase("%foo");
+    SECTION("packed") {}
+    SECTION("notifications") { ln.dispatch_map.erase("&foo"); }
+    ln.start();
+    REQUIRE(prop.create(&device, &ln.client, rdlmm::PropInfo<long>::build("Foo", 3).withBrief("foo").sequencable()) == DEVICE_OK);
+    std::vector<sys::StringT> seq = {"4", "5", "6"};
+    REQUIRE(prop.SetSequence(seq) == DEVICE_OK);
+    REQUIRE(prop.SetSequence(seq) == DEVICE_OK); // no longer asks for credit
+    ln.stop();
+    REQUIRE(ln.foo.size() == 3);
+    ln.foo.start();
+    for (int v = 4; v <= 6; v++) {
+        ln.foo.step();
+        REQUIRE(ln.foo.get() == v);
+    }
+}
+
+#endif // TEST_REMOTEPROP
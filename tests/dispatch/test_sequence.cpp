@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/ServerProperty.h>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    template <class PropT>
+    void upload(PropT& prop, std::initializer_list<int> values) {
+        prop.clear();
+        for (int v : values)
+            prop.add(v);
+    }
+
+    template <class PropT>
+    int play(PropT& prop) {
+        REQUIRE(prop.step());
+        return prop.get();
+    }
+}
+
+TEST_CASE("simple_prop single buffer sequence", "[sequence]") {
+    static_simple_prop<int, 4> prop("p", 0);
+    REQUIRE(prop.sequencable());
+    REQUIRE_FALSE(prop.double_buffered());
+    REQUIRE(prop.max_size() == 4);
+    REQUIRE_FALSE(prop.step()); // not started
+
+    upload(prop, {1, 2, 3, 4, 5});
+    REQUIRE(prop.size() == 4); // extra value dropped
+    prop.start();
+    REQUIRE(play(prop) == 1);
+    REQUIRE(play(prop) == 2);
+    REQUIRE(play(prop) == 3);
+    REQUIRE(play(prop) == 4);
+    REQUIRE(play(prop) == 1); // wrap
+
+    prop.stop();
+    REQUIRE_FALSE(prop.step());
+    REQUIRE(prop.get() == 1);
+}
+
+TEST_CASE("simple_prop double buffer publishes at start when stopped", "[sequence]") {
+    static_simple_prop<int, 4, true> prop("p", 0);
+    REQUIRE(prop.double_buffered());
+    REQUIRE(prop.max_size() == 4);
+
+    upload(prop, {1, 2});
+    REQUIRE(prop.size() == 2);
+    REQUIRE_FALSE(prop.step());
+    prop.start();
+    REQUIRE(play(prop) == 1);
+    REQUIRE(play(prop) == 2);
+
+    prop.stop();
+    upload(prop, {7, 8, 9});
+    REQUIRE(prop.size() == 3);
+    prop.start();
+    REQUIRE(play(prop) == 7);
+
+    // restart without an upload replays the same sequence
+    prop.stop();
+    prop.start();
+    REQUIRE(play(prop) == 7);
+}
+
+TEST_CASE("simple_prop double buffer uploads while playing", "[sequence]") {
+    dynamic_simple_prop<int> prop("p", 0, 4, false, true);
+    REQUIRE(prop.double_buffered());
+
+    upload(prop, {1, 2, 3});
+    prop.start();
+    REQUIRE(play(prop) == 1);
+
+    SECTION("upload does not disturb playback") {
+        upload(prop, {10, 20});
+        REQUIRE(prop.size() == 2);
+        REQUIRE(play(prop) == 2);
+        REQUIRE(play(prop) == 3);
+        REQUIRE(play(prop) == 1); // not published yet
+    }
+
+    SECTION("start while playing publishes at wrap") {
+        upload(prop, {10, 20});
+        prop.start();
+        REQUIRE(play(prop) == 2);
+        REQUIRE(play(prop) == 3);
+        REQUIRE(play(prop) == 10);
+        REQUIRE(play(prop) == 20);
+        REQUIRE(play(prop) == 10);
+    }
+
+    SECTION("stop before the wrap publishes at the next start") {
+        upload(prop, {10, 20});
+        prop.start();
+        prop.stop();
+        prop.start();
+        REQUIRE(play(prop) == 10);
+        REQUIRE(play(prop) == 20);
+        REQUIRE(play(prop) == 10); // published once, not swapped back
+    }
+
+    SECTION("an upload after the pending start is published with it") {
+        upload(prop, {10, 20});
+        prop.start();
+        prop.add(30);
+        prop.stop();
+        prop.start();
+        REQUIRE(play(prop) == 10);
+        REQUIRE(play(prop) == 20);
+        REQUIRE(play(prop) == 30);
+        REQUIRE(play(prop) == 10);
+    }
+
+    SECTION("clear cancels a pending publish") {
+        upload(prop, {10, 20});
+        prop.start();
+        prop.clear();
+        REQUIRE(play(prop) == 2);
+        REQUIRE(play(prop) == 3);
+        REQUIRE(play(prop) == 1);
+    }
+}
+
+TEST_CASE("stream_prop ring buffer credit", "[sequence]") {
+    static_stream_prop<int, 4> prop("p", 0);
+    REQUIRE(prop.sequencable());
+    REQUIRE(prop.max_size() == SERVERPROP_STREAM_MAX_SIZE);
+    REQUIRE(prop.credit() == 4);
+
+    upload(prop, {1, 2, 3, 4, 5});
+    REQUIRE(prop.size() == 4); // overrun dropped
+    REQUIRE(prop.credit() == 0);
+    REQUIRE_FALSE(prop.step()); // not started
+
+    prop.start();
+    REQUIRE(play(prop) == 1);
+    REQUIRE(play(prop) == 2);
+    REQUIRE(prop.credit() == 2);
+    prop.add(5);
+    prop.add(6);
+    REQUIRE(play(prop) == 3);
+    REQUIRE(play(prop) == 4);
+    REQUIRE(play(prop) == 5);
+    REQUIRE(play(prop) == 6);
+
+    // underrun holds the last value
+    REQUIRE_FALSE(prop.step());
+    REQUIRE(prop.get() == 6);
+    REQUIRE(prop.credit() == 4);
+
+    prop.add(7);
+    prop.stop();
+    prop.clear();
+    REQUIRE(prop.size() == 0);
+    REQUIRE(prop.credit() == 4);
+}
+
+TEST_CASE("stream_prop plays sequences longer than its buffer", "[sequence]") {
+    dynamic_stream_prop<int> prop("p", 0, 8);
+    const int length = 1000;
+    int sent = 0, played = 0;
+    prop.clear();
+    prop.start();
+    while (played < length) {
+        // client: never send more than the granted credit
+        for (long credit = prop.credit(); credit > 0 && sent < length; credit--)
+            prop.add(sent++);
+        REQUIRE(prop.size() <= 8);
+        // playback: a few triggers per feed
+        for (int i = 0; i < 3 && played < length; i++)
+            REQUIRE(play(prop) == played++);
+    }
+    REQUIRE_FALSE(prop.step());
+}
+
+TEST_CASE("packed sequence upload", "[sequence]") {
+    std::vector<long> ramp(1000);
+    for (size_t i = 0; i < ramp.size(); i++)
+        ramp[i] = 100 + 60 * static_cast<long>(i);
+    char text[64];
+    size_t packed;
+    delta_pack(text, sizeof(text), ramp.data(), ramp.size(), packed);
+    REQUIRE(packed == ramp.size());
+
+    SECTION("into a simple_prop") {
+        dynamic_simple_prop<long> prop("p", 0, 1000);
+        prop.clear();
+        REQUIRE(prop.add_packed(text) == 1000);
+        REQUIRE(prop.size() == 1000);
+        prop.start();
+        for (long v : ramp)
+            REQUIRE(play(prop) == v);
+    }
+
+    SECTION("into a stream_prop drops values past its credit") {
+        static_stream_prop<long, 16> prop("p", 0);
+        REQUIRE(prop.add_packed(text) == 16);
+        REQUIRE(prop.size() == 16);
+        prop.start();
+        REQUIRE(play(prop) == 100);
+    }
+
+    SECTION("not for floating point properties") {
+        static_simple_prop<float, 16> prop("p", 0);
+        REQUIRE(prop.add_packed(text) == -1);
+        REQUIRE(prop.size() == 0);
+    }
+
+    SECTION("corrupt text") {
+        static_simple_prop<long, 16> prop("p", 0);
+        REQUIRE(prop.add_packed("!!") == -1);
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/ServerLoop.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <rdl/JsonClient.h>
+    #include <rdl/JsonServer.h>
+    #include <rdl/ServerProperty.h>
+    #include <atomic>
+    #include <memory>
+    #include <sys/socket.h>
+    #include <thread>
+    #include <unordered_map>
+    #include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+    #include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT    = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    using ClientT = static_json_client<jsonrpc_default_keys, 256>;
+
+    /** Simulated device on one end of a socketpair */
+    struct device {
+        device() : foo("foo", 1), server(link, link, dispatch_map) {
+            int fds[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            REQUIRE(link.attach(fds[0]));
+            REQUIRE(host.attach(fds[1]));
+            add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        }
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo;
+        sys::Stream_PosixFd link; ///< device end, served by the loop
+        sys::Stream_PosixFd host; ///< client end
+        static_json_server<MapT, jsonrpc_default_keys, 256> server;
+    };
+}
+
+TEST_CASE("server_loop serves many devices on one thread", "[serverloop]") {
+    const int count = 50;
+    std::vector<std::unique_ptr<device>> devices;
+    server_loop loop;
+    REQUIRE(loop.valid());
+    for (int d = 0; d < count; d++) {
+        devices.emplace_back(new device());
+        REQUIRE(loop.add(devices.back()->link, devices.back()->server));
+    }
+    REQUIRE(loop.size() == count);
+    std::thread runner([&]() { loop.run(); });
+
+    std::vector<std::unique_ptr<ClientT>> clients;
+    for (auto& dev : devices)
+        clients.emplace_back(new ClientT(dev->host, dev->host, JSONRPC_DEFAULT_TIMEOUT, 0));
+    for (int round = 0; round < 4; round++) {
+        for (int d = 0; d < count; d++)
+            REQUIRE(clients[d]->call("!foo", 100 * round + d) == ERROR_OK);
+    }
+    for (int d = 0; d < count; d++) {
+        int value = -1;
+        REQUIRE(clients[d]->call_get("?foo", value) == ERROR_OK);
+        REQUIRE(value == 300 + d);
+    }
+    loop.stop();
+    runner.join();
+    REQUIRE(loop.frames() == 5 * count);
+    REQUIRE(loop.errors() == 0);
+}
+
+TEST_CASE("server_loop frame budget", "[serverloop]") {
+    device dev;
+    server_loop loop;
+    REQUIRE(loop.add(dev.link, dev.server));
+    ClientT client(dev.host, dev.host, JSONRPC_DEFAULT_TIMEOUT, 0);
+    // notifications get no reply, so they can all be queued before serving
+    const int frames = 2 * SERVER_LOOP_FRAME_BUDGET + 3;
+    for (int i = 0; i < frames; i++)
+        REQUIRE(client.notify("!foo", i) == ERROR_OK);
+    REQUIRE(loop.run_once(1000) == SERVER_LOOP_FRAME_BUDGET);
+    // the rest is served without waiting, even if it sits in the read-ahead buffer
+    uint32_t start = sys::millis();
+    REQUIRE(loop.run_once(1000) == SERVER_LOOP_FRAME_BUDGET);
+    REQUIRE(loop.run_once(1000) == 3);
+    REQUIRE(sys::millis() - start < 500);
+    REQUIRE(dev.foo.get() == frames - 1);
+}
+
+TEST_CASE("server_loop wakes for scheduled sets", "[serverloop]") {
+    device dev;
+    server_loop loop;
+    REQUIRE(loop.add(dev.link, dev.server));
+    uint32_t start = sys::micros();
+    REQUIRE(dev.foo.set_at(5, start + 20000));
+    // nothing arrives, but the loop must not sleep through the due time
+    while (dev.foo.get() != 5 && sys::micros() - start < 1000000)
+        REQUIRE(loop.run_once(1000) == 0);
+    REQUIRE(dev.foo.get() == 5);
+    uint32_t elapsed = sys::micros() - start;
+    REQUIRE(elapsed >= 20000);
+    REQUIRE(elapsed < 500000);
+}
+
+TEST_CASE("server_loop drops streams that hang up", "[serverloop]") {
+    device first, second;
+    server_loop loop;
+    REQUIRE(loop.add(first.link, first.server));
+    REQUIRE(loop.add(second.link, second.server));
+    first.host.close();
+    loop.run_once(1000);
+    REQUIRE(loop.size() == 1);
+    REQUIRE(first.link.hungUp());
+    REQUIRE(loop.remove(second.link));
+    REQUIRE_FALSE(loop.remove(second.link));
+    REQUIRE(loop.size() == 0);
+    REQUIRE(loop.run_once(0) == 0);
+}
+
+TEST_CASE("server_loop stop", "[serverloop]") {
+    server_loop loop;
+    loop.stop(); // before run(): run() returns at once
+    loop.run();
+    std::thread runner([&]() { loop.run(); });
+    sys::delay(20);
+    uint32_t start = sys::millis();
+    loop.stop();
+    runner.join();
+    REQUIRE(sys::millis() - start < 500);
+}
+
+#endif // __unix__ || __APPLE__
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT   = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    using IntT   = static_simple_prop<int, 1>;
+    using FloatT = static_simple_prop<double, 1>;
+
+    /** Device with foo and an n-channel bar, served on another thread */
+    struct snapshot_link {
+        snapshot_link(int nchans)
+            : foo("foo", 43),
+              server(loopback.server(), loopback.server(), dispatch_map),
+              client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0) {
+            for (int i = 0; i < nchans; i++) {
+                chans.emplace_back(new FloatT("bar" + std::to_string(i), 1.5 + i));
+                chan_ptrs.push_back(chans.back().get());
+            }
+            bars.reset(new channel_prop<double>("bar", chan_ptrs.data(), nchans));
+            add_to<MapT, IntT::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+            add_to<MapT, channel_prop<double>::RootT>(dispatch_map, *bars, bars->sequencable(-1), bars->read_only(-1));
+        }
+        ~snapshot_link() {
+            if (runner.joinable()) {
+                running = false;
+                runner.join();
+            }
+        }
+
+        /** Add scalar properties p0, p1 ... */
+        void add_props(int count) {
+            for (int i = 0; i < count; i++) {
+                extra.emplace_back(new IntT("p" + std::to_string(i), i));
+                add_to<MapT, IntT::RootT>(dispatch_map, *extra.back(), extra.back()->sequencable(), extra.back()->read_only());
+            }
+        }
+
+        void start() {
+            running = true;
+            runner  = std::thread([this]() {
+                while (running) {
+                    server.check_messages();
+                    sys::yield();
+                }
+            });
+        }
+
+        MapT dispatch_map;
+        IntT foo;
+        std::vector<std::unique_ptr<FloatT>> chans;
+        std::vector<FloatT::RootT*> chan_ptrs;
+        std::unique_ptr<channel_prop<double>> bars;
+        std::vector<std::unique_ptr<IntT>> extra;
+        sys::Stream_LoopbackPair loopback;
+        static_json_server<MapT, jsonrpc_default_keys, 1024> server;
+        static_json_client<jsonrpc_default_keys, 1024> client;
+        std::atomic<bool> running;
+        std::thread runner;
+    };
+}
+
+TEST_CASE("snapshot_stub", "[snapshot]") {
+    snapshot_link ln(2);
+    StaticJsonDocument<svc::SNAPSHOT_DOC_SIZE> doc;
+    JsonVariant target = doc.to<JsonObject>();
+    StaticJsonDocument<JSON_ARRAY_SIZE(0)> argdoc;
+    JsonArray args = argdoc.to<JsonArray>();
+
+    SECTION("scalar") {
+        REQUIRE(ln.dispatch_map.at("$foo").call(args, target) == ERROR_OK);
+        REQUIRE(doc["foo"].as<int>() == 43);
+    }
+
+    SECTION("channel") {
+        REQUIRE(ln.dispatch_map.at("$bar").call(args, target) == ERROR_OK);
+        JsonArray bar = doc["bar"];
+        REQUIRE(bar.size() == 2);
+        REQUIRE(bar[0].as<double>() == 1.5);
+        REQUIRE(bar[1].as<double>() == 2.5);
+    }
+
+    SECTION("needs an object") {
+        StaticJsonDocument<JSON_ARRAY_SIZE(0)> notobj;
+        JsonVariant bad = notobj.as<JsonVariant>();
+        REQUIRE(ln.dispatch_map.at("$foo").call(args, bad) == ERROR_JSON_INVALID_REQUEST);
+    }
+}
+
+TEST_CASE("$ device snapshot", "[snapshot]") {
+    StaticJsonDocument<svc::SNAPSHOT_DOC_SIZE> reply;
+    JsonVariant values;
+
+    SECTION("scalar and channel values") {
+        snapshot_link ln(3);
+        ln.start();
+        REQUIRE(ln.client.call_get_doc(svc::SNAPSHOT_METHOD, reply, values) == ERROR_OK);
+        REQUIRE(values["foo"].as<int>() == 43);
+        JsonArray bar = values["bar"];
+        REQUIRE(bar.size() == 3);
+        REQUIRE(bar[2].as<double>() == 3.5);
+        // the server keeps answering after the snapshot
+        REQUIRE(ln.client.call("!foo", 5) == ERROR_OK);
+        REQUIRE(ln.client.call_get_doc(svc::SNAPSHOT_METHOD, reply, values) == ERROR_OK);
+        REQUIRE(values["foo"].as<int>() == 5);
+    }
+
+    SECTION("full document") {
+        snapshot_link ln(JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES);
+        ln.add_props(JSONRPC_SNAPSHOT_MAX_VALUES - 2);
+        ln.start();
+        REQUIRE(ln.client.call_get_doc(svc::SNAPSHOT_METHOD, reply, values) == ERROR_OK);
+        REQUIRE(values.size() == JSONRPC_SNAPSHOT_MAX_VALUES);
+        REQUIRE(values["bar"].size() == JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES);
+    }
+
+    SECTION("too many properties") {
+        snapshot_link ln(1);
+        ln.add_props(JSONRPC_SNAPSHOT_MAX_VALUES + JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES);
+        ln.start();
+        REQUIRE(ln.client.call_get_doc(svc::SNAPSHOT_METHOD, reply, values) == ERROR_JSON_SNAPSHOT_FULL);
+        int foo = 0;
+        REQUIRE(ln.client.call_get("?foo", foo) == ERROR_OK);
+        REQUIRE(foo == 43);
+    }
+
+    SECTION("too many channel values") {
+        snapshot_link ln(JSONRPC_SNAPSHOT_MAX_VALUES + JSONRPC_SNAPSHOT_MAX_CHANNEL_VALUES - 1);
+        ln.start();
+        REQUIRE(ln.client.call_get_doc(svc::SNAPSHOT_METHOD, reply, values) == ERROR_JSON_SNAPSHOT_FULL);
+    }
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/sys_StreamT.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    #include <rdl/JsonClient.h>
+    #include <rdl/JsonServer.h>
+    #include <rdl/ServerProperty.h>
+    #include <atomic>
+    #include <stdlib.h>
+    #include <string>
+    #include <sys/wait.h>
+    #include <thread>
+    #include <unordered_map>
+    #include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+    #include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+
+    std::string socket_path(const char* name) {
+        const char* tmp = getenv("TMPDIR");
+        return std::string(tmp ? tmp : "/tmp") + "/rdl_" + name + "_" + std::to_string(::getpid());
+    }
+
+    /** Connected client and server ends of a Unix-domain or TCP socket */
+    struct socket_pair {
+        explicit socket_pair(bool tcp) {
+            sys::Socket_Listener listener;
+            std::string path = socket_path("test");
+            if (tcp) {
+                REQUIRE(listener.listenTcp("127.0.0.1", 0));
+                REQUIRE(listener.port() != 0);
+                REQUIRE(client.connectTcp("127.0.0.1", listener.port()));
+            } else {
+                REQUIRE(listener.listenUnix(path.c_str()));
+                REQUIRE(client.connectUnix(path.c_str()));
+            }
+            REQUIRE(listener.accept(server, 1000));
+        }
+        sys::Stream_Socket client;
+        sys::Stream_Socket server;
+    };
+
+    /** Device simulator: serve foo until the client hangs up */
+    void serve_foo(sys::Stream_Socket& link) {
+        MapT dispatch_map;
+        static_simple_prop<int, 4> foo("foo", 1);
+        add_to<MapT, decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
+        static_json_server<MapT, jsonrpc_default_keys, 256> server(link, link, dispatch_map);
+        while (!link.hungUp()) {
+            link.waitAvailable(10);
+            server.check_messages();
+        }
+    }
+
+    void call_foo(sys::Stream_Socket& link) {
+        static_json_client<jsonrpc_default_keys, 256> client(link, link, JSONRPC_DEFAULT_TIMEOUT, 0);
+        for (int i = 0; i < 200; i++) {
+            REQUIRE(client.call("!foo", i) == ERROR_OK);
+            int value = -1;
+            REQUIRE(client.call_get("?foo", value) == ERROR_OK);
+            REQUIRE(value == i);
+        }
+    }
+}
+
+TEST_CASE("Socket_Listener errors", "[socket]") {
+    sys::Socket_Listener listener;
+    REQUIRE_FALSE(listener.listenTcp("not an address", 0));
+    REQUIRE_FALSE(listener.isListening());
+    sys::Stream_Socket link;
+    REQUIRE_FALSE(listener.accept(link, 0));
+    REQUIRE_FALSE(link.connectUnix(socket_path("missing").c_str()));
+    REQUIRE_FALSE(link.isOpen());
+
+    REQUIRE(listener.listenTcp("127.0.0.1", 0));
+    uint32_t start = sys::millis();
+    REQUIRE_FALSE(listener.accept(link, 50));
+    REQUIRE(sys::millis() - start >= 40);
+}
+
+TEST_CASE("Socket_Listener Unix socket files", "[socket]") {
+    std::string path = socket_path("owner");
+    sys::Socket_Listener first;
+
+    SECTION("a live socket is not taken over") {
+        REQUIRE(first.listenUnix(path.c_str()));
+        sys::Socket_Listener second;
+        REQUIRE_FALSE(second.listenUnix(path.c_str()));
+        REQUIRE(errno == EADDRINUSE);
+        sys::Stream_Socket link;
+        REQUIRE(link.connectUnix(path.c_str()));
+    }
+
+    SECTION("a stale socket file is replaced") {
+        struct sockaddr_un addr;
+        REQUIRE(sys::svc::unix_address(path.c_str(), addr));
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+        ::close(fd); // leaves the file behind, as a crashed daemon would
+        REQUIRE(first.listenUnix(path.c_str()));
+        sys::Stream_Socket link;
+        REQUIRE(link.connectUnix(path.c_str()));
+    }
+}
+
+TEST_CASE("Stream_Socket transfers", "[socket]") {
+    bool tcp = GENERATE(false, true);
+    socket_pair pair(tcp);
+    REQUIRE(pair.client.noDelay() == tcp);
+    REQUIRE(pair.server.noDelay() == tcp);
+
+    SECTION("terminated frames") {
+        pair.client.write(reinterpret_cast<const uint8_t*>("one\0two"), 7);
+        REQUIRE(pair.server.waitAvailable(1000));
+        char frame[8];
+        REQUIRE(pair.server.readBytesUntil('\0', frame, sizeof(frame)) == 3);
+        REQUIRE(memcmp(frame, "one", 3) == 0);
+        REQUIRE(pair.server.peek() == 't');
+    }
+
+    SECTION("bulk transfer larger than the socket buffers") {
+        std::vector<uint8_t> sent(4 * 1024 * 1024);
+        for (size_t i = 0; i < sent.size(); i++)
+            sent[i] = static_cast<uint8_t>(i * 13 + (i >> 12));
+        std::vector<uint8_t> got(sent.size());
+        pair.server.setTimeout(5000);
+        std::thread reader([&]() {
+            size_t n = pair.server.readBytes(reinterpret_cast<char*>(got.data()), got.size());
+            got.resize(n);
+        });
+        pair.client.setTimeout(5000);
+        REQUIRE(pair.client.write(sent.data(), sent.size()) == sent.size());
+        reader.join();
+        REQUIRE(got == sent);
+    }
+
+    SECTION("hang up") {
+        pair.client.close();
+        REQUIRE(pair.server.waitAvailable(1000));
+        REQUIRE(pair.server.read() == -1);
+        REQUIRE(pair.server.hungUp());
+        // no SIGPIPE writing to a closed peer
+        const uint8_t data[64] = {0};
+        for (int i = 0; i < 4; i++)
+            pair.server.write(data, sizeof(data));
+        REQUIRE(pair.server.write(data, sizeof(data)) == 0);
+    }
+}
+
+TEST_CASE("json calls to a server process", "[socket]") {
+    bool tcp = GENERATE(false, true);
+    socket_pair pair(tcp);
+    pid_t child = ::fork();
+    REQUIRE(child >= 0);
+    if (child == 0) {
+        pair.client.close();
+        serve_foo(pair.server);
+        ::_exit(0);
+    }
+    pair.server.close();
+    call_foo(pair.client);
+    pair.client.close();
+    int status = -1;
+    REQUIRE(::waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+}
+
+#endif // __unix__ || __APPLE__
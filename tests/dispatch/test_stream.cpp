@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/sys_StreamT.h>
+#include <string>
+#include <thread>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace sys;
+
+namespace {
+    size_t put(svc::spsc_ring& ring, const char* str) {
+        return ring.write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+    }
+
+    std::string until(svc::spsc_ring& ring, size_t n, bool& found) {
+        uint8_t buf[64];
+        size_t count = ring.read_until('\0', buf, n < sizeof(buf) ? n : sizeof(buf), found);
+        return std::string(reinterpret_cast<char*>(buf), count);
+    }
+}
+
+TEST_CASE("spsc_ring read_until", "[stream]") {
+    svc::spsc_ring ring(16);
+    REQUIRE(ring.capacity() == 16);
+    bool found;
+
+    SECTION("frames") {
+        REQUIRE(ring.write(reinterpret_cast<const uint8_t*>("ab\0cd\0e"), 7) == 7);
+        REQUIRE(until(ring, 64, found) == "ab");
+        REQUIRE(found);
+        REQUIRE(until(ring, 64, found) == "cd");
+        REQUIRE(found);
+        // no terminator yet: the partial frame is taken, the rest follows later
+        REQUIRE(until(ring, 64, found) == "e");
+        REQUIRE_FALSE(found);
+        REQUIRE(ring.readable() == 0);
+    }
+
+    SECTION("wrap-around") {
+        uint8_t skip[12];
+        REQUIRE(put(ring, "0123456789ab") == 12);
+        REQUIRE(ring.read(skip, sizeof(skip)) == 12);
+        // the next frame straddles the end of the storage, its terminator too
+        REQUIRE(ring.write(reinterpret_cast<const uint8_t*>("wxyz-wrap\0"), 10) == 10);
+        REQUIRE(until(ring, 64, found) == "wxyz-wrap");
+        REQUIRE(found);
+        REQUIRE(ring.write(reinterpret_cast<const uint8_t*>("tail\0"), 5) == 5);
+        REQUIRE(until(ring, 64, found) == "tail");
+        REQUIRE(found);
+    }
+
+    SECTION("full buffer leaves the terminator unread") {
+        REQUIRE(ring.write(reinterpret_cast<const uint8_t*>("abcd\0ef\0"), 8) == 8);
+        REQUIRE(until(ring, 4, found) == "abcd");
+        REQUIRE_FALSE(found);
+        // the next read ends at once on the terminator, as with sys::Stream
+        REQUIRE(until(ring, 64, found) == "");
+        REQUIRE(found);
+        REQUIRE(until(ring, 64, found) == "ef");
+        REQUIRE(found);
+    }
+
+    SECTION("full ring") {
+        REQUIRE(put(ring, "0123456789abcdefXYZ") == 16);
+        REQUIRE(ring.writable() == 0);
+        REQUIRE(until(ring, 64, found) == "0123456789abcdef");
+        REQUIRE_FALSE(found);
+        REQUIRE(ring.writable() == 16);
+    }
+}
+
+TEST_CASE("Stream_Loopback readBytesUntil", "[stream]") {
+    Stream_LoopbackPair link(16);
+    Stream_Loopback& rx = link.server();
+    Stream_Loopback& tx = link.client();
+    char buf[8];
+
+    SECTION("full buffer") {
+        tx.write(reinterpret_cast<const uint8_t*>("abcd\0ef\0"), 8);
+        REQUIRE(rx.readBytesUntil('\0', buf, 4) == 4);
+        REQUIRE(rx.peek() == '\0');
+        REQUIRE(rx.readBytesUntil('\0', buf, sizeof(buf)) == 0);
+        REQUIRE(rx.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        REQUIRE(std::string(buf, 2) == "ef");
+    }
+
+    SECTION("timeout without a terminator") {
+        rx.setTimeout(30);
+        tx.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+        unsigned long start = sys::millis();
+        REQUIRE(rx.readBytesUntil('\0', buf, sizeof(buf)) == 3);
+        unsigned long elapsed = sys::millis() - start;
+        REQUIRE(elapsed >= 25);
+        REQUIRE(elapsed < 1000);
+        REQUIRE(std::string(buf, 3) == "abc");
+    }
+}
+
+TEST_CASE("Stream_Loopback write waits for room", "[stream]") {
+    Stream_LoopbackPair link(16);
+    Stream_Loopback& rx = link.server();
+    Stream_Loopback& tx = link.client();
+    std::string sent;
+    for (int i = 0; i < 100; i++)
+        sent += static_cast<char>('a' + i % 26);
+
+    SECTION("a write larger than the ring arrives whole") {
+        std::string got;
+        std::thread reader([&]() {
+            char buf[8];
+            while (got.size() < sent.size()) {
+                size_t n = rx.readBytes(buf, sizeof(buf));
+                got.append(buf, n);
+            }
+        });
+        REQUIRE(tx.write(reinterpret_cast<const uint8_t*>(sent.data()), sent.size()) == sent.size());
+        reader.join();
+        REQUIRE(got == sent);
+    }
+
+    SECTION("short only on timeout") {
+        tx.setTimeout(30);
+        unsigned long start = sys::millis();
+        REQUIRE(tx.write(reinterpret_cast<const uint8_t*>(sent.data()), sent.size()) == 16);
+        REQUIRE(sys::millis() - start >= 25);
+    }
+}
+
+TEST_CASE("Stream_StringT readBytesUntil", "[stream]") {
+    Stream_StringT ss;
+    char buf[8];
+
+    SECTION("frames") {
+        ss.write(reinterpret_cast<const uint8_t*>("ab\0cd\0"), 6);
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        REQUIRE(std::string(buf, 2) == "ab");
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        REQUIRE(std::string(buf, 2) == "cd");
+        REQUIRE(ss.available() == 0);
+    }
+
+    SECTION("partial frame completed by a later write") {
+        ss.setTimeout(30);
+        ss.write(reinterpret_cast<const uint8_t*>("ab"), 2);
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        ss.write(reinterpret_cast<const uint8_t*>("cd\0"), 3);
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        REQUIRE(std::string(buf, 2) == "cd");
+    }
+
+    SECTION("timeout without a terminator") {
+        ss.setTimeout(30);
+        ss.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+        unsigned long start = sys::millis();
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 3);
+        unsigned long elapsed = sys::millis() - start;
+        REQUIRE(elapsed >= 25);
+        REQUIRE(elapsed < 1000);
+        REQUIRE(std::string(buf, 3) == "abc");
+    }
+
+    SECTION("full buffer leaves the terminator unread") {
+        ss.write(reinterpret_cast<const uint8_t*>("abcd\0ef\0"), 8);
+        REQUIRE(ss.readBytesUntil('\0', buf, 4) == 4);
+        REQUIRE(ss.peek() == '\0');
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 0);
+        REQUIRE(ss.readBytesUntil('\0', buf, sizeof(buf)) == 2);
+        REQUIRE(std::string(buf, 2) == "ef");
+    }
+
+    SECTION("same frames as the per-character loop") {
+        const char wire[] = "one\0\0three\0four";
+        Stream_StringT other;
+        ss.write(reinterpret_cast<const uint8_t*>(wire), sizeof(wire) - 1);
+        other.write(reinterpret_cast<const uint8_t*>(wire), sizeof(wire) - 1);
+        ss.setTimeout(0);
+        other.setTimeout(0);
+        char obuf[8];
+        for (int i = 0; i < 5; i++) {
+            size_t n = ss.readBytesUntil('\0', buf, 4);
+            size_t m = other.sys::Stream::readBytesUntil('\0', obuf, 4);
+            REQUIRE(n == m);
+            REQUIRE(std::string(buf, n) == std::string(obuf, m));
+        }
+    }
+}
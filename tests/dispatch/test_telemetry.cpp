@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/JsonClient.h>
+#include <rdl/JsonServer.h>
+#include <rdl/ServerProperty.h>
+#include <rdl/Telemetry.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    /** Stands in for json_server::notify, keeping every pushed block */
+    struct block_recorder {
+        struct block {
+            std::string method;
+            unsigned long index;
+            uint32_t t0_us, period_us;
+            std::string packed;
+        };
+        template <typename... PARAMS>
+        int notify(const char* method, PARAMS... args) {
+            return record(method, args...);
+        }
+        int record(const char* method, unsigned long index, uint32_t t0_us, uint32_t period_us, const char* packed) {
+            blocks.push_back(block{method, index, t0_us, period_us, packed});
+            return ERROR_OK;
+        }
+        std::vector<block> blocks;
+    };
+
+    struct sample_log {
+        void sample(unsigned long index, uint32_t server_us, int value) {
+            indices.push_back(index);
+            times.push_back(server_us);
+            values.push_back(value);
+        }
+        std::vector<unsigned long> indices;
+        std::vector<uint32_t> times;
+        std::vector<int> values;
+    };
+
+    /** Source counting its own reads */
+    struct counter_prop : public static_simple_prop<int, 4> {
+        counter_prop() : static_simple_prop<int, 4>("adc", 0), reads(0) {}
+        virtual int get() const override { return 2000 + (reads++ % 7); }
+        mutable int reads;
+    };
+}
+
+TEST_CASE("telemetry_stream sampling and blocks", "[telemetry]") {
+    timer_queue& queue = timer_queue::instance();
+    const uint32_t period = TELEMETRY_MIN_PERIOD_US;
+    counter_prop adc;
+    static_telemetry_stream<int, 16> telemetry(adc);
+    block_recorder recorder;
+
+    REQUIRE_FALSE(telemetry.start(1000)); // not published yet
+    telemetry.publish_to(&recorder);
+    REQUIRE_FALSE(telemetry.start(period - 1));
+    REQUIRE(telemetry.start(period));
+    REQUIRE(telemetry.streaming());
+    uint32_t t0;
+    REQUIRE(queue.next_due(t0));
+
+    using ReceiverT = telemetry_receiver<int>;
+    sample_log log;
+    ReceiverT receiver(ReceiverT::sample_delegate::create<sample_log, &sample_log::sample>(&log));
+
+    SECTION("polled on time") {
+        for (uint32_t i = 0; i < 40; i++)
+            REQUIRE(queue.poll(t0 + i * period) == 1);
+        REQUIRE(adc.reads == 40);
+        // two full blocks, the last 8 samples wait for the third
+        REQUIRE(recorder.blocks.size() == 2);
+        REQUIRE(recorder.blocks[0].index == 0);
+        REQUIRE(recorder.blocks[0].t0_us == t0);
+        REQUIRE(recorder.blocks[1].index == 16);
+        REQUIRE(recorder.blocks[1].t0_us == t0 + 16 * period);
+        REQUIRE(telemetry.flush() == ERROR_OK);
+        REQUIRE(recorder.blocks.size() == 3);
+        REQUIRE(recorder.blocks[2].index == 32);
+        REQUIRE(recorder.blocks[2].t0_us == t0 + 32 * period);
+    }
+
+    SECTION("polled late") {
+        for (uint32_t i = 0; i < 4; i++)
+            REQUIRE(queue.poll(t0 + i * period) == 1);
+        // samples 4..6 are missed: the partial block goes out, sample 7 starts the next
+        REQUIRE(queue.poll(t0 + 7 * period + period / 2) == 1);
+        REQUIRE(recorder.blocks.size() == 1);
+        REQUIRE(recorder.blocks[0].index == 0);
+        REQUIRE(queue.poll(t0 + 8 * period) == 1);
+        REQUIRE(telemetry.flush() == ERROR_OK);
+        REQUIRE(recorder.blocks.size() == 2);
+        REQUIRE(recorder.blocks[1].index == 7);
+        REQUIRE(recorder.blocks[1].t0_us == t0 + 7 * period);
+    }
+
+    REQUIRE(telemetry.start(0));
+    REQUIRE_FALSE(telemetry.streaming());
+    REQUIRE(queue.empty());
+
+    for (auto& b : recorder.blocks) {
+        REQUIRE(b.method == "|adc");
+        REQUIRE(b.period_us == period);
+        receiver.on_block(b.index, b.t0_us, b.period_us, b.packed.c_str());
+    }
+    REQUIRE(receiver.received() == static_cast<unsigned long>(adc.reads));
+    REQUIRE(receiver.received() + receiver.lost() == log.indices.back() + 1);
+    for (size_t i = 0; i < log.values.size(); i++) {
+        REQUIRE(log.values[i] == static_cast<int>(2000 + i % 7));
+        REQUIRE(log.times[i] == t0 + log.indices[i] * period);
+    }
+}
+
+TEST_CASE("telemetry_receiver counts lost samples", "[telemetry]") {
+    using ReceiverT = telemetry_receiver<int>;
+    sample_log log;
+    ReceiverT receiver(ReceiverT::sample_delegate::create<sample_log, &sample_log::sample>(&log));
+    int values[] = {5, 6, 7, 8};
+    char text[32];
+    size_t packed;
+    delta_pack(text, sizeof(text), values, 4, packed);
+    REQUIRE(packed == 4);
+
+    receiver.on_block(0, 100, 10, text);
+    receiver.on_block(10, 200, 10, text); // samples 4..9 lost
+    receiver.on_block(14, 240, 10, "*");  // corrupt
+    REQUIRE(receiver.received() == 8);
+    REQUIRE(receiver.lost() == 6);
+    REQUIRE(log.indices.back() == 13);
+    REQUIRE(log.times.back() == 230);
+}
+
+TEST_CASE("telemetry over loopback", "[telemetry]") {
+    using MapT = std::unordered_map<sys::StringT, json_stub, sys::string_hash>;
+    MapT dispatch_map;
+    counter_prop adc;
+    static_telemetry_stream<int, 32> telemetry(adc);
+    add_to(dispatch_map, telemetry);
+
+    sys::Stream_LoopbackPair loopback;
+    static_json_server<MapT, jsonrpc_default_keys, 512> server(loopback.server(), loopback.server(), dispatch_map);
+    static_json_client<jsonrpc_default_keys, 512> client(loopback.client(), loopback.client(), JSONRPC_DEFAULT_TIMEOUT, 0);
+    server.publish(telemetry);
+
+    using ReceiverT = telemetry_receiver<int>;
+    sample_log log;
+    ReceiverT receiver(ReceiverT::sample_delegate::create<sample_log, &sample_log::sample>(&log));
+    MapT push_map;
+    receiver.add_to(push_map, "adc");
+    client.push_map(push_map);
+
+    std::atomic<bool> running(true);
+    std::thread server_thread([&]() {
+        while (running.load(std::memory_order_relaxed)) {
+            server.check_messages();
+            sys::yield();
+        }
+    });
+
+    bool ok = false;
+    REQUIRE(client.call_get("/adc", ok, 1000UL) == ERROR_OK); // 1 kHz
+    REQUIRE(ok);
+    uint32_t start = sys::micros();
+    while (receiver.received() < 200 && svc::time_before(sys::micros(), start + 2000000)) {
+        REQUIRE(client.check_messages() == ERROR_OK);
+        sys::yield();
+    }
+    REQUIRE(client.call_get("/adc", ok, 0UL) == ERROR_OK);
+    REQUIRE(ok);
+    running = false;
+    server_thread.join();
+
+    REQUIRE(receiver.received() >= 200);
+    REQUIRE(telemetry.dropped_blocks() == 0);
+    REQUIRE(log.indices.front() == 0);
+    for (size_t i = 1; i < log.indices.size(); i++) {
+        REQUIRE(log.indices[i] > log.indices[i - 1]);
+        REQUIRE(log.times[i] - log.times[i - 1] == (log.indices[i] - log.indices[i - 1]) * 1000);
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <rdl/TxPriority.h>
+#include <rdl/sys_timing.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+
+namespace {
+    /** tx_gate that can report how many transactions wait at each priority */
+    class test_gate : public svc::tx_gate {
+     public:
+        int waiting(tx_priority p) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            return waiting_[static_cast<int>(p)];
+        }
+
+        void wait_for_waiting(tx_priority p, int n) {
+            while (waiting(p) < n)
+                sys::yield();
+        }
+    };
+}
+
+TEST_CASE("bulk_scope sets the thread priority", "[txpriority]") {
+    REQUIRE(svc::tx_thread_priority() == tx_priority::control);
+    {
+        bulk_scope bulk;
+        REQUIRE(svc::tx_thread_priority() == tx_priority::bulk);
+        {
+            bulk_scope nested;
+            REQUIRE(svc::tx_thread_priority() == tx_priority::bulk);
+        }
+        REQUIRE(svc::tx_thread_priority() == tx_priority::bulk);
+        std::thread other([]() { REQUIRE(svc::tx_thread_priority() == tx_priority::control); });
+        other.join();
+    }
+    REQUIRE(svc::tx_thread_priority() == tx_priority::control);
+}
+
+TEST_CASE("tx_gate is reentrant", "[txpriority]") {
+    test_gate gate;
+    {
+        svc::tx_gate::guard outer(gate);
+        svc::tx_gate::guard inner(gate); // e.g. a push handler calling the client
+    }
+    svc::tx_gate::guard again(gate);
+}
+
+TEST_CASE("tx_gate lets control transactions go first", "[txpriority]") {
+    test_gate gate;
+    std::vector<int> order;
+    std::mutex order_mutex;
+    auto record = [&](int who) {
+        std::lock_guard<std::mutex> lk(order_mutex);
+        order.push_back(who);
+    };
+
+    gate.lock(tx_priority::bulk); // bulk frame in progress
+    std::thread bulk1([&]() {
+        bulk_scope bulk;
+        svc::tx_gate::guard tx(gate);
+        record(1);
+    });
+    gate.wait_for_waiting(tx_priority::bulk, 1);
+    std::thread bulk2([&]() {
+        bulk_scope bulk;
+        svc::tx_gate::guard tx(gate);
+        record(2);
+    });
+    gate.wait_for_waiting(tx_priority::bulk, 2);
+    std::thread control([&]() {
+        svc::tx_gate::guard tx(gate);
+        record(0);
+    });
+    gate.wait_for_waiting(tx_priority::control, 1);
+    gate.unlock();
+
+    bulk1.join();
+    bulk2.join();
+    control.join();
+    REQUIRE(order.size() == 3);
+    REQUIRE(order[0] == 0); // control overtook both waiting bulk transactions
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <rdl/CobsInPlace.h>
+#include <rdl/sys_StringT.h>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+using test_encoder = cobs_encoder;
+using test_decoder = cobs_decoder;
+using bytes        = std::vector<uint8_t>;
+
+namespace {
+    /** Encode src (out-of-place or in-place) into a buffer of bsize */
+    bytes encode(const bytes& src, size_t bsize, bool inplace) {
+        std::vector<uint8_t> buf(bsize);
+        const uint8_t* from = src.empty() ? (const uint8_t*)"" : src.data();
+        if (inplace)
+            from = (const uint8_t*)memcpy(buf.data(), from, src.size());
+        size_t ec_size      = test_encoder::encode(buf.data(), bsize, from, src.size());
+        return bytes(buf.begin(), buf.begin() + ec_size);
+    }
+
+    bytes decode(const bytes& src, size_t bsize, bool inplace) {
+        std::vector<uint8_t> buf(bsize > src.size() ? bsize : src.size());
+        const uint8_t* from = inplace ? (const uint8_t*)memcpy(buf.data(), src.data(), src.size()) : src.data();
+        size_t dc_size      = test_decoder::decode(buf.data(), bsize, from, src.size());
+        return bytes(buf.begin(), buf.begin() + dc_size);
+    }
+
+    bytes run(size_t n, uint8_t first = 1) {
+        bytes res(n);
+        for (size_t i = 0; i < n; i++)
+            res[i] = static_cast<uint8_t>(first + i % 255); // never 0
+        return res;
+    }
+}
+
+TEST_CASE("cobs_encoder reference vectors", "[cobs_encoder-01]") {
+    bool INPLACE = GENERATE(false, true);
+
+    WHEN("empty input") {
+        REQUIRE(2 == test_encoder::encoded_size((const uint8_t*)"", 0));
+        REQUIRE(bytes{0x01, 0x00} == encode(bytes{}, 20, INPLACE));
+    }
+
+    WHEN("single null") {
+        bytes src{0x00};
+        REQUIRE(3 == test_encoder::encoded_size(src.data(), src.size()));
+        REQUIRE(bytes{0x01, 0x01, 0x00} == encode(src, 20, INPLACE));
+    }
+
+    WHEN("nulls in the middle") {
+        bytes src{0x11, 0x22, 0x00, 0x33};
+        REQUIRE(6 == test_encoder::encoded_size(src.data(), src.size()));
+        REQUIRE(bytes{0x03, 0x11, 0x22, 0x02, 0x33, 0x00} == encode(src, 20, INPLACE));
+    }
+
+    WHEN("trailing null") {
+        bytes src{0x11, 0x00, 0x00};
+        REQUIRE(bytes{0x02, 0x11, 0x01, 0x01, 0x00} == encode(src, 20, INPLACE));
+    }
+
+    WHEN("SLIP specials are not escaped") {
+        bytes src{0xC0, 0xDB, 0xDC};
+        REQUIRE(bytes{0x04, 0xC0, 0xDB, 0xDC, 0x00} == encode(src, 20, INPLACE));
+    }
+
+    WHEN("buffer too small") {
+        bytes src{0x11, 0x22, 0x00, 0x33};
+        REQUIRE(encode(src, 5, INPLACE).empty());
+    }
+}
+
+TEST_CASE("cobs_encoder long runs", "[cobs_encoder-02]") {
+    bool INPLACE = GENERATE(false, true);
+
+    WHEN("254 bytes fit one code") {
+        bytes src = run(254);
+        bytes enc = encode(src, 300, INPLACE);
+        REQUIRE(256 == test_encoder::encoded_size(src.data(), src.size()));
+        REQUIRE(256 == enc.size());
+        REQUIRE(0xFF == enc[0]);
+        REQUIRE(0x00 == enc.back());
+    }
+
+    WHEN("255 bytes need a second code") {
+        bytes src = run(255);
+        bytes enc = encode(src, 300, INPLACE);
+        REQUIRE(258 == test_encoder::encoded_size(src.data(), src.size()));
+        REQUIRE(258 == enc.size());
+        REQUIRE(0xFF == enc[0]);
+        REQUIRE(0x02 == enc[255]);
+    }
+
+    WHEN("overhead is bounded") {
+        bytes src = run(1000);
+        bytes enc = encode(src, test_encoder::max_encoded_size(src.size()), INPLACE);
+        REQUIRE(enc.size() == test_encoder::encoded_size(src.data(), src.size()));
+        REQUIRE(enc.size() <= test_encoder::max_encoded_size(src.size()));
+        REQUIRE(enc.size() == 1000 + 4 + 1);
+    }
+}
+
+TEST_CASE("cobs_decoder", "[cobs_decoder-01]") {
+    bool INPLACE = GENERATE(false, true);
+
+    WHEN("reference vectors") {
+        REQUIRE(bytes{} == decode(bytes{0x01, 0x00}, 20, INPLACE));
+        REQUIRE(bytes{0x00} == decode(bytes{0x01, 0x01, 0x00}, 20, INPLACE));
+        REQUIRE(bytes{0x11, 0x22, 0x00, 0x33} == decode(bytes{0x03, 0x11, 0x22, 0x02, 0x33, 0x00}, 20, INPLACE));
+        // frame end is optional, as readBytesUntil strips it
+        REQUIRE(bytes{0x11, 0x22, 0x00, 0x33} == decode(bytes{0x03, 0x11, 0x22, 0x02, 0x33}, 20, INPLACE));
+        bytes src{0x03, 0x11, 0x22, 0x02, 0x33, 0x00};
+        REQUIRE(4 == test_decoder::decoded_size(src.data(), src.size()));
+    }
+
+    WHEN("bad encoding") {
+        // run longer than the frame
+        REQUIRE(decode(bytes{0x05, 0x11, 0x22, 0x00}, 20, INPLACE).empty());
+        REQUIRE(decode(bytes{0x05, 0x11, 0x22}, 20, INPLACE).empty());
+        // not enough room for results
+        REQUIRE(decode(bytes{0x03, 0x11, 0x22, 0x02, 0x33, 0x00}, 3, INPLACE).empty());
+    }
+
+    WHEN("round trip") {
+        bytes src = run(600);
+        for (size_t i = 0; i < src.size(); i += 97)
+            src[i] = 0;
+        src.push_back(0);
+        bytes enc = encode(src, test_encoder::max_encoded_size(src.size()), INPLACE);
+        REQUIRE(enc.size() == test_encoder::encoded_size(src.data(), src.size()));
+        for (size_t i = 0; i + 1 < enc.size(); i++)
+            REQUIRE(enc[i] != 0);
+        REQUIRE(src.size() == test_decoder::decoded_size(enc.data(), enc.size()));
+        REQUIRE(src == decode(enc, enc.size(), INPLACE));
+    }
+}
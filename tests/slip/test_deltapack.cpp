@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <rdl/DeltaPack.h>
+#include <climits>
+#include <string>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+using values = std::vector<long>;
+
+namespace {
+    /** Pack into a text buffer of tsize, returning the text */
+    std::string pack(const values& src, size_t tsize, size_t& packed) {
+        std::vector<char> text(tsize);
+        size_t len = delta_pack(text.data(), tsize, src.data(), src.size(), packed);
+        REQUIRE(len < tsize);
+        REQUIRE(text[len] == 0);
+        return std::string(text.data(), len);
+    }
+
+    values unpack(const std::string& text, long& count, long limit = 100000) {
+        values res;
+        count = delta_unpack(text.c_str(), limit, [&](long v) { res.push_back(v); });
+        return res;
+    }
+
+    /** Hand-made packed text from raw varints */
+    std::string varints(const std::vector<uint64_t>& us) {
+        uint8_t buf[128];
+        size_t size = 0;
+        for (uint64_t u : us)
+            REQUIRE(svc::put_varint(buf, size, sizeof(buf), u));
+        std::string text;
+        unsigned bits = 0;
+        int nbits     = 0;
+        for (size_t i = 0; i < size; i++) {
+            bits = (bits << 8) | buf[i];
+            nbits += 8;
+            while (nbits >= 6) {
+                nbits -= 6;
+                text += svc::base64_chars()[(bits >> nbits) & 0x3F];
+            }
+            bits &= (1u << nbits) - 1;
+        }
+        if (nbits > 0)
+            text += svc::base64_chars()[(bits << (6 - nbits)) & 0x3F];
+        return text;
+    }
+
+    values dac_ramp(long n, long from, long step) {
+        values res(n);
+        for (long i = 0; i < n; i++)
+            res[i] = from + i * step;
+        return res;
+    }
+}
+
+TEST_CASE("delta_pack round trip", "[deltapack-01]") {
+    size_t packed = 0;
+    long count    = 0;
+
+    WHEN("single value") {
+        std::string text = pack(values{-3}, 16, packed);
+        REQUIRE(packed == 1);
+        REQUIRE(values{-3} == unpack(text, count));
+        REQUIRE(count == 1);
+    }
+
+    WHEN("empty") {
+        REQUIRE(pack(values{}, 16, packed).empty());
+        REQUIRE(packed == 0);
+        REQUIRE(unpack("", count).empty());
+        REQUIRE(count == 0);
+    }
+
+    WHEN("mixed steps and repeats") {
+        values src{0, 0, 0, 5, 10, 15, -20, -20, 32767, -32768, 1, 2, 100000, 7};
+        std::string text = pack(src, 64, packed);
+        REQUIRE(packed == src.size());
+        REQUIRE(src == unpack(text, count));
+        REQUIRE(count == static_cast<long>(src.size()));
+    }
+
+    WHEN("text is JSON safe base64") {
+        std::string text = pack(dac_ramp(50, -1000, 37), 256, packed);
+        for (char c : text)
+            REQUIRE(svc::base64_value(c) >= 0);
+    }
+}
+
+TEST_CASE("delta_pack DAC ramp is small", "[deltapack-02]") {
+    size_t packed = 0;
+    long count    = 0;
+
+    WHEN("1000 point ramp") {
+        values src       = dac_ramp(1000, 0, 65);
+        std::string text = pack(src, 64, packed);
+        REQUIRE(packed == src.size());
+        REQUIRE(text.size() < 16);
+        REQUIRE(src == unpack(text, count));
+    }
+
+    WHEN("1000 point triangle") {
+        values src = dac_ramp(500, 0, 130);
+        values down = dac_ramp(500, 64870, -130);
+        src.insert(src.end(), down.begin(), down.end());
+        std::string text = pack(src, 64, packed);
+        REQUIRE(packed == src.size());
+        REQUIRE(src == unpack(text, count));
+    }
+
+    WHEN("1000 point noisy ramp") {
+        values src = dac_ramp(1000, 0, 65);
+        uint32_t lcg = 12345;
+        for (long& v : src) {
+            lcg = lcg * 1103515245u + 12345u;
+            v += (lcg >> 24) % 8;
+        }
+        std::string text = pack(src, 4096, packed);
+        REQUIRE(packed == src.size());
+        REQUIRE(text.size() < 3000); // two bytes per value, vs ~6000 as JSON numbers
+        REQUIRE(src == unpack(text, count));
+    }
+}
+
+TEST_CASE("delta_pack splits across strings", "[deltapack-03]") {
+    values src = dac_ramp(300, 0, 1);
+    for (size_t i = 0; i < src.size(); i += 7)
+        src[i] += 1000; // break up the runs
+
+    values res;
+    size_t from = 0;
+    while (from < src.size()) {
+        size_t packed = 0;
+        long count    = 0;
+        values chunk(src.begin() + from, src.end());
+        std::string text = pack(chunk, 33, packed);
+        REQUIRE(text.size() <= 32);
+        REQUIRE(packed > 0);
+        values part = unpack(text, count);
+        REQUIRE(count == static_cast<long>(packed));
+        res.insert(res.end(), part.begin(), part.end());
+        from += packed;
+    }
+    REQUIRE(src == res);
+}
+
+TEST_CASE("delta_unpack bad input", "[deltapack-04]") {
+    long count = 0;
+
+    WHEN("not base64") {
+        REQUIRE(unpack("AB*D", count).empty());
+        REQUIRE(count == -1);
+    }
+
+    WHEN("corrupt after good values") {
+        size_t packed    = 0;
+        std::string text = pack(values{1, 5, 2, 8}, 16, packed) + "*";
+        // checked before anything is added
+        REQUIRE(unpack(text, count).empty());
+        REQUIRE(count == -1);
+    }
+
+    WHEN("value overflows long") {
+        REQUIRE(unpack(varints({svc::zigzag(LONG_MAX), svc::zigzag(1) << 1}), count).empty());
+        REQUIRE(count == -1);
+        REQUIRE(unpack(varints({svc::zigzag(LONG_MIN), svc::zigzag(-1) << 1}), count).empty());
+        REQUIRE(count == -1);
+        // a long run overflows at its end
+        REQUIRE(unpack(varints({0, (svc::zigzag(1 << 20) << 1) | 1, uint64_t(1) << 50}), count).empty());
+        REQUIRE(count == -1);
+    }
+
+    WHEN("run count overflows") {
+        REQUIRE(unpack(varints({0, 1, UINT64_MAX}), count).empty());
+        REQUIRE(count == -1);
+    }
+
+    WHEN("truncated varint") {
+        // 0x80 starts a varint that never ends
+        REQUIRE(unpack("gA", count).empty());
+        REQUIRE(count == -1);
+    }
+
+    WHEN("null text") {
+        REQUIRE(-1 == delta_unpack(nullptr, 10, [](long) {}));
+    }
+}
+
+TEST_CASE("delta_unpack limit", "[deltapack-05]") {
+    long count = 0;
+
+    WHEN("values past the limit are dropped") {
+        size_t packed    = 0;
+        values src       = dac_ramp(1000, 0, 65);
+        std::string text = pack(src, 64, packed);
+        REQUIRE(unpack(text, count, 16) == values(src.begin(), src.begin() + 16));
+        REQUIRE(count == 16);
+        REQUIRE(unpack(text, count, 0).empty());
+        REQUIRE(count == 0);
+    }
+
+    WHEN("a huge run costs only the limit") {
+        // 2^62 repeats of zero
+        values res = unpack(varints({0, 1, uint64_t(1) << 62}), count, 10);
+        REQUIRE(count == 10);
+        REQUIRE(res == values(10, 0));
+    }
+}
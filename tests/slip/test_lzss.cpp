@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <rdl/LzssInPlace.h>
+#include <string>
+#include <vector>
+
+/**************************************************************************************
+ * INCLUDE/MAIN
+ **************************************************************************************/
+
+#include <catch.hpp>
+
+using namespace rdl;
+using test_encoder = lzss_encoder;
+using test_decoder = lzss_decoder;
+using bytes        = std::vector<uint8_t>;
+
+namespace {
+    bytes text(const char* str) {
+        return bytes(str, str + strlen(str));
+    }
+
+    /** Sequence upload style payload: a ramp of numbers */
+    bytes ramp(int n) {
+        std::string str = "{\"m\":\"+seq\",\"p\":[";
+        for (int i = 0; i < n; i++) {
+            if (i) str += ",";
+            str += std::to_string(1000 + 10 * i);
+        }
+        str += "]}";
+        return text(str.c_str());
+    }
+
+    bytes noise(size_t n) {
+        bytes res(n);
+        uint32_t lcg = 12345;
+        for (size_t i = 0; i < n; i++) {
+            lcg    = lcg * 1103515245u + 12345u;
+            res[i] = static_cast<uint8_t>(lcg >> 24);
+        }
+        return res;
+    }
+
+    /**
+     * Compress then decompress src in a buffer of bsize.
+     * SHIFTED works in place the way protocol_base does: the compressed
+     * message starts one byte after the source.
+     */
+    bytes roundtrip(const bytes& src, size_t bsize, bool shifted, size_t& zsize) {
+        bytes buf(bsize), out(bsize);
+        memcpy(buf.data(), src.data(), src.size());
+        if (shifted) {
+            zsize = test_encoder::encode(buf.data() + 1, bsize - 1, buf.data(), src.size());
+            if (zsize == 0) return bytes();
+            size_t dsize = test_decoder::decode(buf.data(), bsize, buf.data() + 1, zsize);
+            return bytes(buf.begin(), buf.begin() + dsize);
+        }
+        zsize = test_encoder::encode(out.data(), bsize, buf.data(), src.size());
+        if (zsize == 0) return bytes();
+        size_t dsize = test_decoder::decode(buf.data(), bsize, out.data(), zsize);
+        return bytes(buf.begin(), buf.begin() + dsize);
+    }
+}
+
+TEST_CASE("lzss_encoder/decoder round trip", "[lzss-01]") {
+    bool SHIFTED = GENERATE(false, true);
+    size_t zsize = 0;
+
+    WHEN("repeated text") {
+        bytes src = text("{\"foo\":1,\"foo\":1,\"foo\":1,\"foo\":1,\"foo\":1,\"foo\":1}");
+        REQUIRE(src == roundtrip(src, 256, SHIFTED, zsize));
+        REQUIRE(zsize < src.size() / 2);
+    }
+
+    WHEN("run of one byte uses overlapping copies") {
+        bytes src(200, 'a');
+        REQUIRE(src == roundtrip(src, 256, SHIFTED, zsize));
+        REQUIRE(zsize < 30);
+    }
+
+    WHEN("sequence ramp") {
+        bytes src = ramp(100);
+        REQUIRE(src == roundtrip(src, 1024, SHIFTED, zsize));
+        REQUIRE(zsize < src.size());
+    }
+
+    WHEN("full buffer") {
+        // in place, the first literal header needs free space past the message
+        bytes src = ramp(40);
+        bytes res = roundtrip(src, src.size() + 1, SHIFTED, zsize);
+        REQUIRE((SHIFTED ? bytes() : src) == res);
+        REQUIRE(src == roundtrip(src, src.size() + 8, SHIFTED, zsize));
+    }
+}
+
+TEST_CASE("lzss_encoder incompressible input", "[lzss-02]") {
+    bool SHIFTED = GENERATE(false, true);
+    size_t zsize = 1;
+
+    WHEN("random bytes") {
+        REQUIRE(roundtrip(noise(300), 512, SHIFTED, zsize).empty());
+        REQUIRE(zsize == 0);
+    }
+
+    WHEN("too short") {
+        REQUIRE(roundtrip(text("abc"), 16, SHIFTED, zsize).empty());
+        REQUIRE(zsize == 0);
+    }
+}
+
+TEST_CASE("lzss_decoder bad input", "[lzss-03]") {
+    uint8_t buf[32];
+
+    WHEN("literal run past the end") {
+        const uint8_t src[] = {0x05, 'a', 'b'};
+        REQUIRE(0 == test_decoder::decode(buf, sizeof(buf), src, sizeof(src)));
+    }
+
+    WHEN("copy before the start") {
+        const uint8_t src[] = {0x00, 'a', 0x80, 0x05};
+        REQUIRE(0 == test_decoder::decode(buf, sizeof(buf), src, sizeof(src)));
+    }
+
+    WHEN("truncated copy") {
+        const uint8_t src[] = {0x00, 'a', 0x80};
+        REQUIRE(0 == test_decoder::decode(buf, sizeof(buf), src, sizeof(src)));
+    }
+
+    WHEN("not enough room for results") {
+        const uint8_t src[] = {0x00, 'a', 0xF8, 0x00}; // 'a' then 18 more
+        REQUIRE(19 == test_decoder::decode(buf, sizeof(buf), src, sizeof(src)));
+        REQUIRE(0 == test_decoder::decode(buf, 10, src, sizeof(src)));
+    }
+}
@@ -46,14 +46,16 @@ rdl::channel_prop<double> bars("bar", all_bars, 4);
 // std::stringstream ss_toserver;
 // std::stringstream ss_fromserver;
 
-sys::Stream_StringT toserver;
-sys::Stream_StringT fromserver;
+// sys::Stream_StringT toserver;
+// sys::Stream_StringT fromserver;
+
+sys::Stream_LoopbackPair loopback;
 
 ////////// SERVER CODE /////////////
 
 #define SERVER_COL "\t\t\t\t"
 
-json_server<MapT, jsonrpc_default_keys> server = static_json_server<MapT, jsonrpc_default_keys, 512> (toserver, fromserver, dispatch_map);
+static_json_server<MapT, jsonrpc_default_keys, 512> server(loopback.server(), loopback.server(), dispatch_map);
 
 // rdl::debug_type<ClientT> __;
 // rdl::debug_type<decltype(server)>(server);
@@ -83,6 +85,9 @@ int setup_server() {
 
     bars.logger(&serverlogger);
 
+    // let clients subscribe to foo changes
+    server.publish(foo);
+
     return 0;
 }
 
@@ -120,7 +125,13 @@ int stop_server() {
 
 ////////// CLIENT CODE /////////////
 
-json_client<jsonrpc_default_keys> client = static_json_client<jsonrpc_default_keys, 512>(fromserver, toserver);
+static_json_client<jsonrpc_default_keys, 512> client(loopback.client(), loopback.client());
+
+MapT push_map;
+
+void foo_changed(const int value) {
+    std::cout << "CLIENT pushed foo = " << value << std::endl;
+}
 
 int main() {
 
@@ -161,8 +172,20 @@ int main() {
     }
 
 
+    bool subscribed = false;
+    push_map.insert(MapT::value_type("=foo", json_delegate<void, const int>::create<foo_changed>().stub()));
+    client.push_map(push_map);
+    client.call_get("@foo", subscribed, true);
+    cout << "subscribed to foo: " << (subscribed ? "yes" : "no") << endl;
+    cout << "foo.set(121)\n";
+    client.call("!foo", 121);
+
     sys::delay(500);
     stop_server();
 
+    cout << "server side foo.set(122)\n";
+    foo.set(122);
+    client.check_messages();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2022 MIT.  All rights reserved.
+ */
+
+/**************************************************************************************
+ * ardulingua_hub: share one Ardulingua device between several processes
+ *
+ *     ardulingua_hub /dev/ttyACM0 [-b baud] [-u socket_path] [-t tcp_port] [-a address]
+ *
+ * Owns the serial port and relays JSON-RPC frames between it and every process
+ * connected to the Unix-domain socket (default /tmp/ardulingua_hub.sock) or, with -t,
+ * a TCP port. Clients connect with sys::Stream_Socket and use json_client as if they
+ * owned the device. See rdl/JsonHub.h.
+ **************************************************************************************/
+
+#include <rdl/JsonHub.h>
+#include <rdl/sys_StreamT.h>
+#include <memory>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HUB_CLIENT_WRITE_TIMEOUT
+    #define HUB_CLIENT_WRITE_TIMEOUT 100
+#endif
+
+#ifndef HUB_BUFFER_SIZE
+    #define HUB_BUFFER_SIZE 1024
+#endif
+
+using namespace rdl;
+
+namespace {
+    volatile sig_atomic_t stopping = 0;
+
+    void stop(int) { stopping = 1; }
+
+    void usage(const char* self) {
+        fprintf(stderr, "usage: %s device [-b baud] [-u socket_path] [-t tcp_port] [-a address]\n", self);
+    }
+
+    /** Accept a waiting connection onto a free hub slot */
+    void accept_client(sys::Socket_Listener& listener, json_hub<jsonrpc_default_keys>& hub,
+                       std::unique_ptr<sys::Stream_Socket> (&conns)[JSONRPC_HUB_MAX_CLIENTS]) {
+        std::unique_ptr<sys::Stream_Socket> conn(new sys::Stream_Socket());
+        if (!listener.accept(*conn, 0))
+            return;
+        conn->setTimeout(HUB_CLIENT_WRITE_TIMEOUT);
+        int slot = hub.attach(*conn);
+        if (slot < 0) {
+            fprintf(stderr, "hub full, refusing a client\n");
+            return; // closed on return
+        }
+        conns[slot] = std::move(conn);
+        fprintf(stderr, "client %d connected\n", slot);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 2;
+    }
+    const char* device_path = argv[1];
+    unsigned long baud      = 115200;
+    const char* socket_path = "/tmp/ardulingua_hub.sock";
+    const char* address     = "127.0.0.1";
+    int tcp_port            = -1;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-b"))
+            baud = strtoul(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-u"))
+            socket_path = argv[i + 1];
+        else if (!strcmp(argv[i], "-t"))
+            tcp_port = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-a"))
+            address = argv[i + 1];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    sys::Stream_PosixSerial device;
+    if (!device.begin(device_path, baud)) {
+        perror(device_path);
+        return 1;
+    }
+    sys::Socket_Listener unix_listener, tcp_listener;
+    if (!unix_listener.listenUnix(socket_path)) {
+        perror(socket_path);
+        return 1;
+    }
+    if (tcp_port >= 0 && !tcp_listener.listenTcp(address, static_cast<uint16_t>(tcp_port))) {
+        perror(address);
+        return 1;
+    }
+    fprintf(stderr, "relaying %s on %s", device_path, socket_path);
+    if (tcp_listener.isListening())
+        fprintf(stderr, " and %s:%u", address, tcp_listener.port());
+    fprintf(stderr, "\n");
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    static_json_hub<jsonrpc_default_keys, HUB_BUFFER_SIZE> hub(device);
+    std::unique_ptr<sys::Stream_Socket> conns[JSONRPC_HUB_MAX_CLIENTS];
+
+    while (!stopping) {
+        struct pollfd fds[3 + JSONRPC_HUB_MAX_CLIENTS];
+        nfds_t nfds = 0;
+        fds[nfds++] = {device.fd(), POLLIN, 0};
+        fds[nfds++] = {unix_listener.fd(), POLLIN, 0};
+        if (tcp_listener.isListening())
+            fds[nfds++] = {tcp_listener.fd(), POLLIN, 0};
+        for (auto& conn : conns) {
+            if (conn)
+                fds[nfds++] = {conn->fd(), POLLIN, 0};
+        }
+        // wake at least every 100 ms to expire unanswered calls
+        if (::poll(fds, nfds, 100) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            accept_client(unix_listener, hub, conns);
+        if (tcp_listener.isListening() && (fds[2].revents & POLLIN))
+            accept_client(tcp_listener, hub, conns);
+
+        int err = hub.poll();
+        if (err != ERROR_OK)
+            fprintf(stderr, "relay error %d\n", err);
+
+        for (int slot = 0; slot < JSONRPC_HUB_MAX_CLIENTS; slot++) {
+            if (conns[slot] && conns[slot]->hungUp()) {
+                hub.detach(slot);
+                conns[slot].reset();
+                fprintf(stderr, "client %d left\n", slot);
+            }
+        }
+        if (device.hungUp()) {
+            fprintf(stderr, "%s closed\n", device_path);
+            return 1;
+        }
+    }
+    return 0;
+}